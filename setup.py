@@ -14,7 +14,8 @@ ext = Extension(
         '-I./src'
     ],
     extra_link_args=[
-        'wsp.a'
+        'wsp.a',
+        '-lpthread'
     ]
 )
 
@@ -36,6 +36,9 @@ PyMODINIT_FUNC initwsp(void) {
     PyModule_AddIntConstant(m, "MMAP", WSP_MMAP);
     PyModule_AddIntConstant(m, "FILE", WSP_FILE);
     PyModule_AddIntConstant(m, "MEMORY", WSP_MEMORY);
+    PyModule_AddIntConstant(m, "PREAD", WSP_PREAD);
+    PyModule_AddIntConstant(m, "URING", WSP_URING);
+    PyModule_AddIntConstant(m, "DIRECT", WSP_DIRECT);
 
     PyModule_AddIntConstant(m, "AVERAGE", WSP_AVERAGE);
     PyModule_AddIntConstant(m, "SUM", WSP_SUM);
@@ -66,6 +66,12 @@ int main(int argc, const char **argv) {
         printf("  points_size = %zu\n", archive->points_size);
         printf("\n");
 
+        // every point of the archive is read once, in order.
+        if (wsp_advise(&w, archive, 0, 0, WSP_ADVICE_SEQUENTIAL, &e) == WSP_ERROR) {
+            printf("%s: %s: %s\n", wsp_strerror(&e), strerror(e.syserr), path);
+            return 1;
+        }
+
         wsp_point_t points[archive->count];
 
         uint32_t count;
@@ -1,11 +1,15 @@
 // vim: foldmethod=marker
+#define _GNU_SOURCE
 
 #include "wsp.h"
 #include "wsp_private.h"
 #include "wsp_time.h"
+#include "wsp_rollup.h"
 
 #include <time.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -61,6 +65,14 @@ const char *wsp_error_strings[WSP_ERROR_SIZE] = {
     "Invalid I/O operation for this instance",
     /* WSP_ERROR_IO_OFFSET */
     "I/O operations on invalid offset and size",
+    /* WSP_ERROR_JOURNAL */
+    "Invalid journal",
+    /* WSP_ERROR_LOCK */
+    "Locking failed",
+    /* WSP_ERROR_THREAD */
+    "Thread failure",
+    /* WSP_ERROR_FULL */
+    "Queue is full",
 }; // static initialization }}}
 
 // wsp_strerror {{{
@@ -71,10 +83,12 @@ const char *wsp_strerror(
     return wsp_error_strings[e->type];
 } // wsp_strerror }}}
 
-// wsp_open {{{
-wsp_return_t wsp_open(
+// wsp_open_prepare {{{
+/*
+ * Set up a handle to be opened with the given mapping.
+ */
+static wsp_return_t wsp_open_prepare(
     wsp_t *w,
-    const char *path,
     wsp_mapping_t mapping,
     int flags,
     wsp_error_t *e
@@ -92,13 +106,41 @@ wsp_return_t wsp_open(
         return WSP_ERROR;
     }
 
+    /*
+     * Concurrent readers must not touch the state of the handle, which rules
+     * out mappings that read through a buffer of their own and rollups that
+     * are flushed before reading.
+     */
+    if (flags & WSP_CONCURRENT) {
+        if (mapping != WSP_MMAP && mapping != WSP_MEMORY) {
+            e->type = WSP_ERROR_IO_MODE;
+            return WSP_ERROR;
+        }
+
+        if (flags & (WSP_WINDOWED | WSP_LAZY)) {
+            e->type = WSP_ERROR_IO_MODE;
+            return WSP_ERROR;
+        }
+    }
+
     w->io = io;
     w->io_mapping = mapping;
+    w->flags = flags;
+    WSP_STATS_INIT(&w->stats);
 
-    if (w->io->open(w, path, flags, e) == WSP_ERROR) {
-        return WSP_ERROR;
-    }
+    return WSP_OK;
+} // wsp_open_prepare }}}
 
+// wsp_open_load {{{
+/*
+ * Load the header of a database once its mapping has been opened.
+ */
+static wsp_return_t wsp_open_load(
+    wsp_t *w,
+    int flags,
+    wsp_error_t *e
+)
+{
     wsp_metadata_t meta;
     WSP_METADATA_INIT(&meta);
 
@@ -115,9 +157,128 @@ wsp_return_t wsp_open(
         return WSP_ERROR;
     }
 
+    if (flags & WSP_INCREMENTAL) {
+        if (__wsp_rollup_init(w, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    if (flags & WSP_LAZY) {
+        w->lazy = calloc(1, sizeof(wsp_lazy_t));
+
+        if (w->lazy == NULL) {
+            e->type = WSP_ERROR_MALLOC;
+            return WSP_ERROR;
+        }
+    }
+
     return WSP_OK;
+} // wsp_open_load }}}
+
+// wsp_open {{{
+wsp_return_t wsp_open(
+    wsp_t *w,
+    const char *path,
+    wsp_mapping_t mapping,
+    int flags,
+    wsp_error_t *e
+)
+{
+    if (wsp_open_prepare(w, mapping, flags, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    if (w->io->open(w, path, flags, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    return wsp_open_load(w, flags, e);
 } // wsp_open }}}
 
+// wsp_open_fd {{{
+wsp_return_t wsp_open_fd(
+    wsp_t *w,
+    int fd,
+    wsp_mapping_t mapping,
+    int flags,
+    wsp_error_t *e
+)
+{
+    if (wsp_open_prepare(w, mapping, flags, e) == WSP_ERROR) {
+        close(fd);
+        return WSP_ERROR;
+    }
+
+    // mappings which are not backed by a file.
+    if (w->io->open_fd == NULL) {
+        close(fd);
+        e->type = WSP_ERROR_IO;
+        return WSP_ERROR;
+    }
+
+    if (w->io->open_fd(w, fd, flags, e) == WSP_ERROR) {
+        close(fd);
+        return WSP_ERROR;
+    }
+
+    if (wsp_open_load(w, flags, e) == WSP_ERROR) {
+        // closes the descriptor along with the handle.
+        wsp_error_t ignored;
+        wsp_close(w, &ignored);
+        return WSP_ERROR;
+    }
+
+    return WSP_OK;
+} // wsp_open_fd }}}
+
+// wsp_open_at {{{
+wsp_return_t wsp_open_at(
+    wsp_t *w,
+    int dirfd,
+    const char *path,
+    wsp_mapping_t mapping,
+    int flags,
+    wsp_error_t *e
+)
+{
+    int open_flags;
+
+    if (flags & WSP_WRITE) {
+        // the mappings read what they are about to partially overwrite.
+        open_flags = O_RDWR;
+    }
+    else if (flags & WSP_READ) {
+        open_flags = O_RDONLY;
+    }
+    else {
+        e->type = WSP_ERROR_IO_MODE;
+        return WSP_ERROR;
+    }
+
+#ifdef O_CLOEXEC
+    open_flags |= O_CLOEXEC;
+#endif
+
+#ifdef O_NOATIME
+    int fd = openat(dirfd, path, open_flags | O_NOATIME);
+
+    // only permitted for the owner of the file.
+    if (fd == -1 && errno == EPERM) {
+        fd = openat(dirfd, path, open_flags);
+    }
+#else
+    int fd = openat(dirfd, path, open_flags);
+#endif
+
+    if (fd == -1) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    return wsp_open_fd(w, fd, mapping, flags, e);
+} // wsp_open_at }}}
+
 // wsp_create {{{
 wsp_return_t wsp_create(
     const char *path,
@@ -219,6 +380,29 @@ wsp_return_t wsp_create(
 // wsp_close {{{
 wsp_return_t wsp_close(wsp_t *w, wsp_error_t *e)
 {
+    wsp_return_t result = WSP_OK;
+
+    if (w->lazy != NULL) {
+        // close regardless, but report the failure.
+        if (wsp_flush_rollups(w, e) == WSP_ERROR) {
+            result = WSP_ERROR;
+        }
+
+        free(w->lazy->entries);
+        free(w->lazy);
+        w->lazy = NULL;
+    }
+
+    __wsp_rollup_free(w);
+
+    if (w->sync != WSP_SYNC_NONE) {
+        if (__wsp_sync(w, w->sync == WSP_SYNC_FULL, e) == WSP_ERROR) {
+            result = WSP_ERROR;
+        }
+    }
+
+    __wsp_dirty_free(&w->dirty);
+
     if (w->archives != NULL) {
         uint32_t i;
 
@@ -244,14 +428,79 @@ wsp_return_t wsp_close(wsp_t *w, wsp_error_t *e)
     w->io_instance = NULL;
     w->archives = NULL;
     w->archives_size = 0;
+    w->flags = 0;
+    w->sync = WSP_SYNC_NONE;
+    w->sync_interval = 0;
+    // closing the descriptor released a lock that was still held.
+    w->lock_depth = 0;
     w->meta.aggregation = 0l;
     w->meta.max_retention = 0l;
     w->meta.x_files_factor = 0.0f;
     w->meta.archives_count = 0l;
 
-    return WSP_OK;
+    return result;
 } // wsp_close }}}
 
+// wsp_revalidate {{{
+wsp_return_t wsp_revalidate(
+    wsp_t *w,
+    wsp_error_t *e
+)
+{
+    wsp_return_t result = WSP_OK;
+    uint32_t i;
+
+    __wsp_write_begin(w);
+
+    for (i = 0; i < w->archives_count; i++) {
+        if (__wsp_load_base(w, w->archives + i, e) == WSP_ERROR) {
+            result = WSP_ERROR;
+            break;
+        }
+    }
+
+    __wsp_write_end(w);
+
+    if (result == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    __wsp_rollup_reset(w);
+
+    return WSP_OK;
+} // wsp_revalidate }}}
+
+// wsp_read_points {{{
+/*
+ * Read points relative to a base, the caller makes sure that the base and
+ * the points are read consistently.
+ */
+static wsp_return_t wsp_read_points(
+    wsp_t *w,
+    wsp_archive_t *archive,
+    wsp_point_t *base,
+    int offset,
+    uint32_t count,
+    wsp_point_t *result,
+    wsp_error_t *e
+)
+{
+    if (count >= archive->count) {
+        count = archive->count;
+    }
+
+    uint32_t from = __wsp_point_mod(offset, archive->count);
+    uint32_t until = __wsp_point_mod(offset + count, archive->count);
+
+    wsp_point_t points[count];
+
+    if (__wsp_fetch_read_points(w, archive, from, until, count, points, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    return __wsp_filter_points(base, archive, offset, count, points, result, e);
+} // wsp_read_points }}}
+
 // wsp_fetch_time_points {{{
 wsp_return_t wsp_fetch_time_points(
     wsp_t *w,
@@ -263,9 +512,7 @@ wsp_return_t wsp_fetch_time_points(
     wsp_error_t *e
 )
 {
-    wsp_point_t base;
-
-    if (__wsp_load_point(w, archive, 0, &base, e) == WSP_ERROR) {
+    if (archive != w->archives && wsp_flush_rollups(w, e) == WSP_ERROR) {
         return WSP_ERROR;
     }
 
@@ -276,21 +523,33 @@ wsp_return_t wsp_fetch_time_points(
 
     uint32_t from = wsp_time_floor(time_from, archive->spp) / archive->spp;
     uint32_t until = wsp_time_floor(time_until, archive->spp) / archive->spp;
-    int offset = from - (base.timestamp / archive->spp);
 
     uint32_t count = until - from + 1;
 
-    if (DEBUG) {
-        DEBUG_PRINTF(
-            "wsp_fetch_time_points: offset=%d, count=%u", offset, count
-        );
-    }
-
     if (count > archive->count) {
         count = archive->count;
     }
 
-    if (wsp_fetch_points(w, archive, offset, count, result, e) == WSP_ERROR) {
+    wsp_return_t r;
+    unsigned int seq;
+
+    // the offset depends on the base, which is read again if it changed.
+    do {
+        seq = __wsp_read_begin(w);
+
+        wsp_point_t base = archive->base;
+        int offset = from - (base.timestamp / archive->spp);
+
+        if (DEBUG) {
+            DEBUG_PRINTF(
+                "wsp_fetch_time_points: offset=%d, count=%u", offset, count
+            );
+        }
+
+        r = wsp_read_points(w, archive, &base, offset, count, result, e);
+    } while (__wsp_read_retry(w, seq));
+
+    if (r == WSP_ERROR) {
         return WSP_ERROR;
     }
 
@@ -309,30 +568,22 @@ wsp_return_t wsp_fetch_points(
     wsp_error_t *e
 )
 {
-    wsp_point_t base;
-
-    if (__wsp_load_point(w, archive, 0, &base, e) == WSP_ERROR) {
+    if (archive != w->archives && wsp_flush_rollups(w, e) == WSP_ERROR) {
         return WSP_ERROR;
     }
 
-    if (count >= archive->count) {
-        count = archive->count;
-    }
-
-    uint32_t from = __wsp_point_mod(offset, archive->count);
-    uint32_t until = __wsp_point_mod(offset + count, archive->count);
+    wsp_return_t r;
+    unsigned int seq;
 
-    wsp_point_t points[count];
+    do {
+        seq = __wsp_read_begin(w);
 
-    if (__wsp_fetch_read_points(w, archive, from, until, count, points, e) == WSP_ERROR) {
-        return WSP_ERROR;
-    }
+        wsp_point_t base = archive->base;
 
-    if (__wsp_filter_points(&base, archive, offset, count, points, result, e) == WSP_ERROR) {
-        return WSP_ERROR;
-    }
+        r = wsp_read_points(w, archive, &base, offset, count, result, e);
+    } while (__wsp_read_retry(w, seq));
 
-    return WSP_OK;
+    return r;
 } // wsp_fetch_points }}}
 
 // wsp_load_points {{{
@@ -349,128 +600,337 @@ wsp_return_t wsp_load_points(
         DEBUG_PRINTF("offset=%u, size=%u", offset, size);
     }
 
+    if (archive != w->archives && wsp_flush_rollups(w, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
     size_t read_offset = archive->offset + sizeof(wsp_point_b) * offset;
     size_t read_size = sizeof(wsp_point_b) * size;
 
-    wsp_point_b *buf = NULL;
+    unsigned int seq;
+
+    do {
+        seq = __wsp_read_begin(w);
+
+        wsp_point_b *buf = NULL;
+
+        if (w->io->read(w, read_offset, read_size, (void **)&buf, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+
+        __wsp_parse_points(buf, size, result);
 
-    if (w->io->read(w, read_offset, read_size, (void **)&buf, e) == WSP_ERROR) {
+        if (w->io_manual_buf) {
+            free(buf);
+        }
+    } while (__wsp_read_retry(w, seq));
+
+    return WSP_OK;
+} // wsp_load_points }}}
+
+// wsp_set_sync {{{
+wsp_return_t wsp_set_sync(
+    wsp_t *w,
+    wsp_sync_t policy,
+    wsp_time_t interval,
+    wsp_error_t *e
+)
+{
+    if (w->io == NULL) {
+        e->type = WSP_ERROR_NOT_OPEN;
         return WSP_ERROR;
     }
 
-    __wsp_parse_points(buf, size, result);
-
-    if (w->io_manual_buf) {
-        free(buf);
+    if (policy < WSP_SYNC_NONE || policy > WSP_SYNC_FULL) {
+        e->type = WSP_ERROR_IO_MODE;
+        return WSP_ERROR;
     }
 
+    w->sync = policy;
+    w->sync_interval = interval;
+    w->sync_last = wsp_time_now();
+
     return WSP_OK;
-} // wsp_load_points }}}
+} // wsp_set_sync }}}
 
-// wsp_point_index {{{
-inline static uint32_t wsp_point_index(
-    wsp_archive_t *archive,
-    wsp_point_t *base,
-    wsp_time_t floored
+// wsp_sync {{{
+wsp_return_t wsp_sync(
+    wsp_t *w,
+    wsp_error_t *e
 )
 {
-    wsp_time_t distance = floored - base->timestamp;
-    return (distance / archive->spp) % archive->count;
-} // wsp_point_index }}}
+    return __wsp_sync(w, 1, e);
+} // wsp_sync }}}
 
-// wsp_write_points {{{
-wsp_return_t wsp_write_points(
+// wsp_lock {{{
+wsp_return_t wsp_lock(
     wsp_t *w,
-    wsp_archive_t *archive,
-    wsp_point_t *points,
-    size_t length,
-    wsp_point_t *base,
     wsp_error_t *e
 )
 {
-    if (length == 0) {
-        e->type = WSP_ERROR_IO_OFFSET;
-        return WSP_ERROR;
+    if (!(w->flags & WSP_LOCK)) {
+        return WSP_OK;
     }
 
-    wsp_point_t base_point;
-    WSP_POINT_INIT(&base_point);
+    if (w->lock_depth++ > 0) {
+        return WSP_OK;
+    }
 
-    if (__wsp_load_point(w, archive, 0, &base_point, e) == WSP_ERROR) {
+    if (w->io->lock(w, 1, e) == WSP_ERROR) {
+        w->lock_depth = 0;
         return WSP_ERROR;
     }
 
-    uint32_t write_index = 0;
-
-    /* 
-     * this not is the first point being written
-     * This has the unfortunate circumstance that floored timestamps = 0 are
-     * not valid.
-     */
-    if (base_point.timestamp != 0) {
-        write_index = wsp_point_index(archive, &base_point, points[0].timestamp);
-    }
+    // another process might have written since the lock was last held.
+    if (wsp_revalidate(w, e) == WSP_ERROR) {
+        wsp_error_t unlock_e;
+        WSP_ERROR_INIT(&unlock_e);
 
-    if (__wsp_save_points(w, archive, write_index, points, length, e) == WSP_ERROR) {
+        w->io->lock(w, 0, &unlock_e);
+        w->lock_depth = 0;
         return WSP_ERROR;
     }
 
-    *base = base_point;
-
     return WSP_OK;
-} // wsp_write_points }}}
+} // wsp_lock }}}
 
-// wsp_aggregate_value {{{
-wsp_return_t wsp_aggregate_value(
+// wsp_unlock {{{
+wsp_return_t wsp_unlock(
     wsp_t *w,
-    time_t timestamp,
-    wsp_archive_t *cur,
-    wsp_archive_t *prev,
-    wsp_point_t *prev_base,
-    wsp_value_t *result,
-    int *skip,
     wsp_error_t *e
 )
 {
-    wsp_time_t floor = wsp_time_floor(timestamp, cur->spp);
-    uint32_t prev_index = wsp_point_index(prev, prev_base, floor);
-    uint32_t prev_count = cur->spp / prev->spp;
+    if (!(w->flags & WSP_LOCK)) {
+        return WSP_OK;
+    }
 
-    if (DEBUG) {
-        DEBUG_PRINTF("timestamp=%u", timestamp);
-        DEBUG_PRINTF("cur: spp=%u", cur->spp);
-        DEBUG_PRINTF("prev: spp=%u", prev->spp);
-        DEBUG_PRINTF("floor=%u", floor);
-        DEBUG_PRINTF("prev_index=%u", prev_index);
-        DEBUG_PRINTF("prev_points=%u", prev_count);
+    if (w->lock_depth == 0) {
+        e->type = WSP_ERROR_LOCK;
+        e->syserr = 0;
+        return WSP_ERROR;
     }
 
-    wsp_point_t prev_points[prev_count];
+    if (w->lock_depth > 1) {
+        w->lock_depth--;
+        return WSP_OK;
+    }
 
-    // Load array of points from the previous archive of points.
-    if (wsp_fetch_points(w, prev, prev_index, prev_count, prev_points, e) == WSP_ERROR) {
-        return WSP_ERROR;
+    wsp_return_t result = WSP_OK;
+
+    // unlock regardless, but report the failure.
+    if (w->lazy != NULL && wsp_flush_rollups(w, e) == WSP_ERROR) {
+        result = WSP_ERROR;
     }
 
-    wsp_value_t value = 0;
+    w->lock_depth = 0;
 
-    if (w->meta.aggregate(w, prev_points, prev_count, &value, skip, e) == WSP_ERROR) {
+    if (result == WSP_ERROR) {
+        wsp_error_t unlock_e;
+        WSP_ERROR_INIT(&unlock_e);
+
+        w->io->lock(w, 0, &unlock_e);
         return WSP_ERROR;
     }
 
-    *result = value;
-
-    return WSP_OK;
-} // wsp_aggregate_value }}}
+    return w->io->lock(w, 0, e);
+} // wsp_unlock }}}
 
-// wsp_update {{{
-wsp_return_t wsp_update(
+// wsp_unlock_after {{{
+/*
+ * Release the lock taken for an update, an error of the update is reported
+ * in favor of a failure to unlock.
+ */
+static wsp_return_t wsp_unlock_after(
     wsp_t *w,
-    wsp_point_input_t *point,
+    wsp_return_t result,
     wsp_error_t *e
 )
 {
-    wsp_time_t now = wsp_time_now();
+    if (result == WSP_OK) {
+        return wsp_unlock(w, e);
+    }
+
+    wsp_error_t unlock_e;
+    WSP_ERROR_INIT(&unlock_e);
+
+    wsp_unlock(w, &unlock_e);
+
+    return WSP_ERROR;
+} // wsp_unlock_after }}}
+
+// wsp_advise {{{
+wsp_return_t wsp_advise(
+    wsp_t *w,
+    wsp_archive_t *archive,
+    uint32_t offset,
+    uint32_t count,
+    wsp_advice_t advice,
+    wsp_error_t *e
+)
+{
+    if (archive == NULL) {
+        return w->io->advise(w, 0, 0, advice, e);
+    }
+
+    if (count == 0 || count > archive->count) {
+        count = archive->count;
+    }
+
+    offset %= archive->count;
+
+    uint32_t size_a = count;
+
+    if (offset + count > archive->count) {
+        size_a = archive->count - offset;
+    }
+
+    size_t advise_offset = WSP_POINT_OFFSET(archive, offset);
+    size_t advise_size = sizeof(wsp_point_b) * size_a;
+
+    if (w->io->advise(w, advise_offset, advise_size, advice, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    // wrap around.
+    if (size_a < count) {
+        advise_offset = WSP_POINT_OFFSET(archive, 0);
+        advise_size = sizeof(wsp_point_b) * (count - size_a);
+
+        if (w->io->advise(w, advise_offset, advise_size, advice, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    return WSP_OK;
+} // wsp_advise }}}
+
+// wsp_point_index {{{
+inline static uint32_t wsp_point_index(
+    wsp_archive_t *archive,
+    wsp_point_t *base,
+    wsp_time_t floored
+)
+{
+    // floored might be before the base point, so distance is signed.
+    int64_t distance = (int64_t)floored - (int64_t)base->timestamp;
+    return __wsp_point_mod(distance / (int64_t)archive->spp, archive->count);
+} // wsp_point_index }}}
+
+// wsp_write_points {{{
+wsp_return_t wsp_write_points(
+    wsp_t *w,
+    wsp_archive_t *archive,
+    wsp_point_t *points,
+    size_t length,
+    wsp_point_t *base,
+    wsp_error_t *e
+)
+{
+    if (length == 0) {
+        e->type = WSP_ERROR_IO_OFFSET;
+        return WSP_ERROR;
+    }
+
+    wsp_point_t base_point = archive->base;
+
+    uint32_t write_index = 0;
+
+    /* 
+     * this not is the first point being written
+     * This has the unfortunate circumstance that floored timestamps = 0 are
+     * not valid.
+     */
+    if (base_point.timestamp != 0) {
+        write_index = wsp_point_index(archive, &base_point, points[0].timestamp);
+    }
+
+    if (__wsp_save_points(w, archive, write_index, points, length, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    *base = base_point;
+
+    return WSP_OK;
+} // wsp_write_points }}}
+
+// wsp_aggregate_value {{{
+wsp_return_t wsp_aggregate_value(
+    wsp_t *w,
+    time_t timestamp,
+    wsp_archive_t *cur,
+    wsp_archive_t *prev,
+    wsp_point_t *prev_base,
+    wsp_value_t *result,
+    int *skip,
+    wsp_error_t *e
+)
+{
+    wsp_time_t floor = wsp_time_floor(timestamp, cur->spp);
+    // offset relative to the base point, wsp_fetch_points wraps it around.
+    int prev_index = ((int64_t)floor - (int64_t)prev_base->timestamp) / (int64_t)prev->spp;
+    uint32_t prev_count = cur->spp / prev->spp;
+
+    if (DEBUG) {
+        DEBUG_PRINTF("timestamp=%u", timestamp);
+        DEBUG_PRINTF("cur: spp=%u", cur->spp);
+        DEBUG_PRINTF("prev: spp=%u", prev->spp);
+        DEBUG_PRINTF("floor=%u", floor);
+        DEBUG_PRINTF("prev_index=%d", prev_index);
+        DEBUG_PRINTF("prev_points=%u", prev_count);
+    }
+
+    wsp_point_t prev_points[prev_count];
+
+    // Load array of points from the previous archive of points.
+    if (wsp_fetch_points(w, prev, prev_index, prev_count, prev_points, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    wsp_value_t value = 0;
+
+    if (w->meta.aggregate(w, prev_points, prev_count, &value, skip, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    *result = value;
+
+    return WSP_OK;
+} // wsp_aggregate_value }}}
+
+// wsp_rollup_value {{{
+/*
+ * Calculate the value of a bucket in cur after points have been written to
+ * the archive preceding it, all points must belong to the same bucket.
+ */
+static wsp_return_t wsp_rollup_value(
+    wsp_t *w,
+    wsp_archive_t *cur,
+    wsp_point_t *points,
+    size_t count,
+    wsp_value_t *value,
+    int *skip,
+    wsp_error_t *e
+)
+{
+    if (w->rollups != NULL) {
+        return __wsp_rollup_update(w, cur, points, count, value, skip, e);
+    }
+
+    wsp_archive_t *prev = cur - 1;
+
+    return wsp_aggregate_value(
+        w, points[0].timestamp, cur, prev, &prev->base, value, skip, e
+    );
+} // wsp_rollup_value }}}
+
+// wsp_update {{{
+wsp_return_t wsp_update(
+    wsp_t *w,
+    wsp_point_input_t *point,
+    wsp_error_t *e
+)
+{
+    wsp_time_t now = wsp_time_now();
     return wsp_update_now(w, point, now, e);
 } // wsp_update }}}
 
@@ -483,55 +943,657 @@ wsp_return_t wsp_update_many(
 )
 {
     wsp_time_t now = wsp_time_now();
+    return wsp_update_many_now(w, points, length, now, e);
+} // wsp_update_many }}}
+
+// wsp_batch_entry_cmp {{{
+static int wsp_batch_entry_cmp(const void *a, const void *b)
+{
+    const wsp_batch_entry_t *l = (const wsp_batch_entry_t *)a;
+    const wsp_batch_entry_t *r = (const wsp_batch_entry_t *)b;
+
+    if (l->archive != r->archive) {
+        return l->archive < r->archive ? -1 : 1;
+    }
+
+    if (l->point.timestamp != r->point.timestamp) {
+        return l->point.timestamp < r->point.timestamp ? -1 : 1;
+    }
+
+    if (l->order != r->order) {
+        return l->order < r->order ? -1 : 1;
+    }
+
+    return 0;
+} // wsp_batch_entry_cmp }}}
+
+// wsp_batch_coalesce {{{
+/*
+ * Collapse entries sorted with wsp_batch_entry_cmp that occupy the same slot
+ * of the same archive into the last one, returns the new length.
+ */
+static size_t wsp_batch_coalesce(
+    wsp_t *w,
+    wsp_batch_entry_t *entries,
+    size_t length
+)
+{
+    size_t n = 0;
     size_t i;
+
     for (i = 0; i < length; i++) {
-        wsp_point_input_t *point = points + i;
+        if (
+            n > 0 &&
+            entries[n - 1].archive == entries[i].archive &&
+            entries[n - 1].point.timestamp == entries[i].point.timestamp
+        ) {
+            entries[n - 1] = entries[i];
+            continue;
+        }
+
+        entries[n++] = entries[i];
+    }
+
+    w->stats.coalesced += length - n;
+
+    return n;
+} // wsp_batch_coalesce }}}
+
+// wsp_write_runs {{{
+/*
+ * Write a list of points sorted by timestamp, one wsp_write_points call for
+ * each run of points occupying contiguous slots.
+ */
+static wsp_return_t wsp_write_runs(
+    wsp_t *w,
+    wsp_archive_t *archive,
+    wsp_point_t *points,
+    size_t length,
+    wsp_error_t *e
+)
+{
+    wsp_point_t base;
+    size_t i = 0;
 
-        if (wsp_update_now(w, point, now, e) == WSP_ERROR) {
+    while (i < length) {
+        size_t j = i + 1;
+
+        while (
+            j < length &&
+            j - i < archive->count - 1 &&
+            points[j].timestamp == points[j - 1].timestamp + archive->spp
+        ) {
+            j++;
+        }
+
+        if (DEBUG) {
+            DEBUG_PRINTF(
+                "run: spp=%u, timestamp=%u, length=%zu",
+                archive->spp, points[i].timestamp, j - i
+            );
+        }
+
+        if (wsp_write_points(w, archive, points + i, j - i, &base, e) == WSP_ERROR) {
             return WSP_ERROR;
         }
+
+        i = j;
     }
 
     return WSP_OK;
-} // wsp_update_many }}}
+} // wsp_write_runs }}}
+
+// wsp_merge_written {{{
+/*
+ * Merge the directly written and the rolled up points of an archive into a
+ * single sorted list without duplicate slots, rolled up values take
+ * precedence since they are written last.
+ */
+static size_t wsp_merge_written(
+    wsp_point_t *direct,
+    size_t direct_length,
+    wsp_point_t *rolled,
+    size_t rolled_length,
+    wsp_point_t *result
+)
+{
+    size_t d = 0, r = 0, n = 0;
 
-// wsp_update {{{
-wsp_return_t wsp_update_now(
+    while (d < direct_length || r < rolled_length) {
+        wsp_point_t next;
+
+        if (r >= rolled_length) {
+            next = direct[d++];
+        }
+        else if (d >= direct_length) {
+            next = rolled[r++];
+        }
+        else if (direct[d].timestamp < rolled[r].timestamp) {
+            next = direct[d++];
+        }
+        else {
+            if (direct[d].timestamp == rolled[r].timestamp) {
+                d++;
+            }
+
+            next = rolled[r++];
+        }
+
+        if (n > 0 && result[n - 1].timestamp == next.timestamp) {
+            result[n - 1] = next;
+            continue;
+        }
+
+        result[n++] = next;
+    }
+
+    return n;
+} // wsp_merge_written }}}
+
+// wsp_batch_apply {{{
+/*
+ * Write and propagate entries sorted with wsp_batch_entry_cmp.
+ *
+ * WSP_BATCH_WRITE writes every entry to its archive, WSP_BATCH_PROPAGATE
+ * recomputes every affected bucket in the lower precision archives once.
+ * Propagating without writing is used to flush entries that have already
+ * been written by a lazy update.
+ */
+static wsp_return_t wsp_batch_apply(
     wsp_t *w,
-    wsp_point_input_t *point,
+    wsp_batch_entry_t *entries,
+    size_t length,
+    int mode,
+    wsp_error_t *e
+)
+{
+    /*
+     * Three buffers of points, each point in the batch can at most cause one
+     * written slot in every archive.
+     */
+    wsp_point_t *buffers = malloc(sizeof(wsp_point_t) * length * 3);
+
+    if (buffers == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        return WSP_ERROR;
+    }
+
+    wsp_point_t *direct = buffers;
+    wsp_point_t *rolled = buffers + length;
+    wsp_point_t *written = buffers + length * 2;
+
+    wsp_return_t result = WSP_ERROR;
+    size_t written_length = 0;
+    size_t position = 0;
+    uint32_t index;
+    size_t i;
+
+    for (index = 0; index < w->archives_count; index++) {
+        wsp_archive_t *cur = w->archives + index;
+        size_t direct_length = 0;
+        size_t rolled_length = 0;
+
+        // Recompute every bucket touched by the previous archive once.
+        i = 0;
+
+        while (i < written_length) {
+            wsp_time_t bucket = wsp_time_floor(written[i].timestamp, cur->spp);
+            size_t j = i + 1;
+
+            while (j < written_length && wsp_time_floor(written[j].timestamp, cur->spp) == bucket) {
+                j++;
+            }
+
+            wsp_value_t value = 0;
+            int skip = 0;
+
+            if (wsp_rollup_value(w, cur, written + i, j - i, &value, &skip, e) == WSP_ERROR) {
+                goto exit;
+            }
+
+            i = j;
+
+            if (skip) {
+                continue;
+            }
+
+            rolled[rolled_length].timestamp = bucket;
+            rolled[rolled_length].value = value;
+            rolled_length++;
+        }
+
+        while (position < length && entries[position].archive == index) {
+            direct[direct_length++] = entries[position++].point;
+        }
+
+        if (direct_length == 0 && rolled_length == 0) {
+            if (position >= length) {
+                break;
+            }
+
+            written_length = 0;
+            continue;
+        }
+
+        if (mode & WSP_BATCH_WRITE) {
+            if (wsp_write_runs(w, cur, direct, direct_length, e) == WSP_ERROR) {
+                goto exit;
+            }
+        }
+
+        if (wsp_write_runs(w, cur, rolled, rolled_length, e) == WSP_ERROR) {
+            goto exit;
+        }
+
+        if (!(mode & WSP_BATCH_PROPAGATE)) {
+            continue;
+        }
+
+        written_length = wsp_merge_written(
+            direct, direct_length, rolled, rolled_length, written
+        );
+    }
+
+    result = WSP_OK;
+
+exit:
+    free(buffers);
+    return result;
+} // wsp_batch_apply }}}
+
+// wsp_lazy_append {{{
+/*
+ * Remember points written to the highest precision archive of a lazy
+ * database so that they can be propagated by wsp_flush_rollups.
+ */
+static wsp_return_t wsp_lazy_append(
+    wsp_t *w,
+    wsp_batch_entry_t *entries,
+    size_t length,
+    wsp_error_t *e
+)
+{
+    wsp_lazy_t *lazy = w->lazy;
+
+    if (lazy->length + length > WSP_LAZY_MAX_PENDING) {
+        if (wsp_flush_rollups(w, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    if (lazy->length + length > lazy->capacity) {
+        size_t capacity = lazy->capacity == 0 ? 64 : lazy->capacity;
+
+        while (capacity < lazy->length + length) {
+            capacity *= 2;
+        }
+
+        wsp_batch_entry_t *tmp = realloc(
+            lazy->entries, sizeof(wsp_batch_entry_t) * capacity
+        );
+
+        if (tmp == NULL) {
+            e->type = WSP_ERROR_MALLOC;
+            return WSP_ERROR;
+        }
+
+        lazy->entries = tmp;
+        lazy->capacity = capacity;
+    }
+
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        wsp_batch_entry_t *entry = entries + i;
+
+        // nothing to propagate into.
+        if (entry->archive + 1 >= w->archives_count) {
+            continue;
+        }
+
+        if (lazy->length > 0) {
+            wsp_batch_entry_t *last = lazy->entries + lazy->length - 1;
+
+            if (last->archive == entry->archive && last->point.timestamp == entry->point.timestamp) {
+                last->point = entry->point;
+                continue;
+            }
+        }
+
+        wsp_batch_entry_t *next = lazy->entries + lazy->length++;
+        *next = *entry;
+        next->order = lazy->order++;
+    }
+
+    return WSP_OK;
+} // wsp_lazy_append }}}
+
+// wsp_flush_rollups {{{
+wsp_return_t wsp_flush_rollups(
+    wsp_t *w,
+    wsp_error_t *e
+)
+{
+    wsp_lazy_t *lazy = w->lazy;
+
+    if (lazy == NULL || lazy->length == 0) {
+        return WSP_OK;
+    }
+
+    if (wsp_lock(w, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    size_t length = lazy->length;
+
+    // detach so that fetches performed while propagating do not recurse.
+    lazy->length = 0;
+
+    qsort(lazy->entries, length, sizeof(wsp_batch_entry_t), wsp_batch_entry_cmp);
+
+    if (DEBUG) {
+        DEBUG_PRINTF("flushing %zu lazy entries", length);
+    }
+
+    if (wsp_batch_apply(w, lazy->entries, length, WSP_BATCH_PROPAGATE, e) == WSP_ERROR) {
+        // propagation is idempotent, keep everything for a retry.
+        lazy->length = length;
+        return wsp_unlock_after(w, WSP_ERROR, e);
+    }
+
+    return wsp_unlock_after(w, WSP_OK, e);
+} // wsp_flush_rollups }}}
+
+// wsp_update_many_now {{{
+wsp_return_t wsp_update_many_now(
+    wsp_t *w,
+    wsp_point_input_t *points,
+    size_t length,
     wsp_time_t now,
     wsp_error_t *e
 )
 {
-    wsp_time_t timestamp = point->timestamp;
-    wsp_value_t value = point->value;
+    if (length == 0) {
+        return WSP_OK;
+    }
 
-    if (timestamp > now) {
-        e->type = WSP_ERROR_FUTURE_TIMESTAMP;
+    wsp_batch_entry_t *entries = malloc(sizeof(wsp_batch_entry_t) * length);
+
+    if (entries == NULL) {
+        e->type = WSP_ERROR_MALLOC;
         return WSP_ERROR;
     }
 
-    wsp_time_t diff = now - timestamp;
+    wsp_return_t result = WSP_ERROR;
+    size_t i;
 
-    wsp_archive_t *low = NULL;
-    uint32_t low_size = 0;
+    // Validate the entire batch before anything is written.
+    for (i = 0; i < length; i++) {
+        wsp_point_input_t *point = points + i;
 
-    if (__wsp_find_highest_precision(diff, w, &low, &low_size, e) == WSP_ERROR) {
+        if (point->timestamp > now) {
+            e->type = WSP_ERROR_FUTURE_TIMESTAMP;
+            goto exit;
+        }
+
+        wsp_archive_t *low = NULL;
+        uint32_t low_size = 0;
+
+        if (__wsp_find_highest_precision(now - point->timestamp, w, &low, &low_size, e) == WSP_ERROR) {
+            goto exit;
+        }
+
+        wsp_batch_entry_t *entry = entries + i;
+        entry->archive = low - w->archives;
+        entry->order = i;
+        entry->point.timestamp = wsp_time_floor(point->timestamp, low->spp);
+        entry->point.value = point->value;
+    }
+
+    qsort(entries, length, sizeof(wsp_batch_entry_t), wsp_batch_entry_cmp);
+
+    // last write wins, only write and propagate each slot once.
+    length = wsp_batch_coalesce(w, entries, length);
+
+    // the whole batch is written under a single lock.
+    if (wsp_lock(w, e) == WSP_ERROR) {
+        goto exit;
+    }
+
+    if (w->lazy != NULL) {
+        result = wsp_batch_apply(w, entries, length, WSP_BATCH_WRITE, e);
+
+        if (result == WSP_OK) {
+            result = wsp_lazy_append(w, entries, length, e);
+        }
+    }
+    else {
+        result = wsp_batch_apply(
+            w, entries, length, WSP_BATCH_WRITE | WSP_BATCH_PROPAGATE, e
+        );
+    }
+
+    result = wsp_unlock_after(w, result, e);
+
+exit:
+    free(entries);
+    return result;
+} // wsp_update_many_now }}}
+
+// wsp_backfill_now {{{
+wsp_return_t wsp_backfill_now(
+    wsp_t *w,
+    wsp_point_input_t *points,
+    size_t length,
+    wsp_time_t now,
+    wsp_error_t *e
+)
+{
+    if (length == 0) {
+        return WSP_OK;
+    }
+
+    wsp_time_t max_retention = (wsp_time_t)w->meta.max_retention;
+    wsp_time_t oldest = now;
+    size_t i;
+
+    // Validate the entire range before anything is written.
+    for (i = 0; i < length; i++) {
+        if (points[i].timestamp > now) {
+            e->type = WSP_ERROR_FUTURE_TIMESTAMP;
+            return WSP_ERROR;
+        }
+
+        if (now - points[i].timestamp >= max_retention) {
+            continue;
+        }
+
+        if (points[i].timestamp < oldest) {
+            oldest = points[i].timestamp;
+        }
+    }
+
+    wsp_archive_t *archive = NULL;
+    uint32_t archive_size = 0;
+
+    if (__wsp_find_highest_precision(now - oldest, w, &archive, &archive_size, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    wsp_batch_entry_t *entries = malloc(sizeof(wsp_batch_entry_t) * length);
+    wsp_point_t *range = NULL;
+
+    if (entries == NULL) {
+        e->type = WSP_ERROR_MALLOC;
         return WSP_ERROR;
     }
 
-    wsp_point_t prev_base;
+    wsp_return_t result = WSP_ERROR;
+    int locked = 0;
+    size_t n = 0;
+
+    for (i = 0; i < length; i++) {
+        // points older than the database are dropped, like whisper does.
+        if (now - points[i].timestamp >= max_retention) {
+            continue;
+        }
+
+        entries[n].archive = archive - w->archives;
+        entries[n].order = i;
+        entries[n].point.timestamp = wsp_time_floor(points[i].timestamp, archive->spp);
+        entries[n].point.value = points[i].value;
+        n++;
+    }
+
+    if (n == 0) {
+        result = WSP_OK;
+        goto exit;
+    }
+
+    // input is expected to be sorted already, which makes this cheap.
+    qsort(entries, n, sizeof(wsp_batch_entry_t), wsp_batch_entry_cmp);
+    n = wsp_batch_coalesce(w, entries, n);
+
+    wsp_time_t until = entries[n - 1].point.timestamp;
+    wsp_time_t from = entries[0].point.timestamp;
+    uint32_t count = (until - from) / archive->spp + 1;
+
+    // the oldest points share their slots with the newest ones.
+    if (count > archive->count) {
+        count = archive->count;
+        from = until - (count - 1) * archive->spp;
+
+        size_t skip = 0;
+
+        while (entries[skip].point.timestamp < from) {
+            skip++;
+        }
+
+        n -= skip;
+        memmove(entries, entries + skip, sizeof(wsp_batch_entry_t) * n);
+
+        // the range must start with a new point, it anchors the write.
+        from = entries[0].point.timestamp;
+        count = (until - from) / archive->spp + 1;
+    }
+
+    range = malloc(sizeof(wsp_point_t) * count);
+
+    if (range == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        goto exit;
+    }
+
+    if (wsp_lock(w, e) == WSP_ERROR) {
+        goto exit;
+    }
+
+    locked = 1;
+
+    uint32_t index = 0;
+
+    if (archive->base.timestamp != 0) {
+        index = wsp_point_index(archive, &archive->base, from);
+    }
+
+    // slots in the range without a new point are written back unchanged.
+    if (__wsp_fetch_read_points(w, archive, index, (index + count) % archive->count, count, range, e) == WSP_ERROR) {
+        goto exit;
+    }
+
+    for (i = 0; i < n; i++) {
+        range[(entries[i].point.timestamp - from) / archive->spp] = entries[i].point;
+    }
+
+    if (DEBUG) {
+        DEBUG_PRINTF(
+            "backfill: spp=%u, from=%u, count=%u, points=%zu",
+            archive->spp, from, count, n
+        );
+    }
+
+    wsp_point_t base;
+
+    // a single write can not cover every slot, the last one goes separately.
+    uint32_t head = count < archive->count ? count : count - 1;
+
+    if (wsp_write_points(w, archive, range, head, &base, e) == WSP_ERROR) {
+        goto exit;
+    }
+
+    if (head < count && wsp_write_points(w, archive, range + head, count - head, &base, e) == WSP_ERROR) {
+        goto exit;
+    }
+
+    result = wsp_batch_apply(w, entries, n, WSP_BATCH_PROPAGATE, e);
+
+exit:
+    if (locked) {
+        result = wsp_unlock_after(w, result, e);
+    }
+
+    free(range);
+    free(entries);
+    return result;
+} // wsp_backfill_now }}}
+
+// wsp_backfill {{{
+wsp_return_t wsp_backfill(
+    wsp_t *w,
+    wsp_point_input_t *points,
+    size_t length,
+    wsp_error_t *e
+)
+{
+    return wsp_backfill_now(w, points, length, wsp_time_now(), e);
+} // wsp_backfill }}}
+
+// wsp_update_point {{{
+/*
+ * Write a single value to the archive selected for it and propagate it to
+ * the lower precision archives.
+ */
+static wsp_return_t wsp_update_point(
+    wsp_t *w,
+    wsp_archive_t *low,
+    uint32_t low_size,
+    wsp_time_t timestamp,
+    wsp_value_t value,
+    wsp_error_t *e
+)
+{
+    wsp_point_t base;
+
+    // Only write the highest precision archive, the rest is propagated by
+    // wsp_flush_rollups.
+    if (w->lazy != NULL) {
+        wsp_batch_entry_t entry = {
+            .archive = low - w->archives,
+            .order = 0,
+            .point = {
+                .timestamp = wsp_time_floor(timestamp, low->spp),
+                .value = value
+            }
+        };
+
+        if (wsp_write_points(w, low, &entry.point, 1, &base, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+
+        return wsp_lazy_append(w, &entry, 1, e);
+    }
+
     uint32_t i = 0;
     int skip = 0;
 
-    wsp_archive_t *prev = NULL;
+    wsp_point_t write_points[1];
 
     // Propagate changes to lower precision archive.
     for (i = 0; i < low_size; i++) {
         wsp_archive_t *cur = low + i;
 
-        if (prev != NULL) {
-            if (wsp_aggregate_value(w, timestamp, cur, prev, &prev_base, &value, &skip, e) == WSP_ERROR) {
+        if (i > 0) {
+            if (wsp_rollup_value(w, cur, write_points, 1, &value, &skip, e) == WSP_ERROR) {
                 return WSP_ERROR;
             }
 
@@ -540,23 +1602,110 @@ wsp_return_t wsp_update_now(
             }
         }
 
-        wsp_point_t write_points[] = {
-            {
-                .timestamp = wsp_time_floor(timestamp, cur->spp),
-                .value = value
-            }
-        };
+        write_points[0].timestamp = wsp_time_floor(timestamp, cur->spp);
+        write_points[0].value = value;
 
-        if (wsp_write_points(w, cur, write_points, 1, &prev_base, e) == WSP_ERROR) {
+        if (wsp_write_points(w, cur, write_points, 1, &base, e) == WSP_ERROR) {
             return WSP_ERROR;
         }
-
-        prev = cur;
     }
 
     return WSP_OK;
+} // wsp_update_point }}}
+
+// wsp_update {{{
+wsp_return_t wsp_update_now(
+    wsp_t *w,
+    wsp_point_input_t *point,
+    wsp_time_t now,
+    wsp_error_t *e
+)
+{
+    wsp_time_t timestamp = point->timestamp;
+
+    if (timestamp > now) {
+        e->type = WSP_ERROR_FUTURE_TIMESTAMP;
+        return WSP_ERROR;
+    }
+
+    wsp_time_t diff = now - timestamp;
+
+    wsp_archive_t *low = NULL;
+    uint32_t low_size = 0;
+
+    if (__wsp_find_highest_precision(diff, w, &low, &low_size, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    if (wsp_lock(w, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    wsp_return_t result = wsp_update_point(w, low, low_size, timestamp, point->value, e);
+
+    return wsp_unlock_after(w, result, e);
 } // wsp_update }}}
 
+// wsp_increment {{{
+wsp_return_t wsp_increment(
+    wsp_t *w,
+    wsp_time_t timestamp,
+    wsp_value_t delta,
+    wsp_error_t *e
+)
+{
+    wsp_time_t now = wsp_time_now();
+    return wsp_increment_now(w, timestamp, delta, now, e);
+} // wsp_increment }}}
+
+// wsp_increment_now {{{
+wsp_return_t wsp_increment_now(
+    wsp_t *w,
+    wsp_time_t timestamp,
+    wsp_value_t delta,
+    wsp_time_t now,
+    wsp_error_t *e
+)
+{
+    if (timestamp > now) {
+        e->type = WSP_ERROR_FUTURE_TIMESTAMP;
+        return WSP_ERROR;
+    }
+
+    wsp_archive_t *low = NULL;
+    uint32_t low_size = 0;
+
+    if (__wsp_find_highest_precision(now - timestamp, w, &low, &low_size, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    wsp_time_t floored = wsp_time_floor(timestamp, low->spp);
+    wsp_value_t value = delta;
+
+    // the stored value is read and written back under the same lock.
+    if (wsp_lock(w, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    if (low->base.timestamp != 0) {
+        uint32_t index = wsp_point_index(low, &low->base, floored);
+        wsp_point_t stored;
+
+        if (wsp_load_points(w, low, index, 1, &stored, e) == WSP_ERROR) {
+            return wsp_unlock_after(w, WSP_ERROR, e);
+        }
+
+        // a slot holding an older timestamp is stale and starts over.
+        if (stored.timestamp == floored && !isnan(stored.value)) {
+            value = stored.value + delta;
+        }
+    }
+
+    wsp_return_t result = wsp_update_point(w, low, low_size, timestamp, value, e);
+
+    return wsp_unlock_after(w, result, e);
+} // wsp_increment_now }}}
+
 // wsp_parse_factor {{{
 wsp_return_t wsp_parse_factor(
     const char *string,
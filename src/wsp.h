@@ -47,6 +47,8 @@ struct wsp_t;
 struct wsp_point_t;
 struct wsp_archive_t;
 struct wsp_metadata_t;
+struct wsp_rollup_t;
+struct wsp_lazy_t;
 
 typedef enum {
     WSP_ERROR = -1,
@@ -57,7 +59,10 @@ typedef enum {
     WSP_MAPPING_NONE = 0,
     WSP_FILE = 1,
     WSP_MMAP = 2,
-    WSP_MEMORY = 3
+    WSP_MEMORY = 3,
+    WSP_PREAD = 4,
+    WSP_URING = 5,
+    WSP_DIRECT = 6
 } wsp_mapping_t;
 
 typedef enum {
@@ -84,7 +89,11 @@ typedef enum {
     WSP_ERROR_IO_MISSING = 20,
     WSP_ERROR_IO_INVALID = 21,
     WSP_ERROR_IO_OFFSET = 22,
-    WSP_ERROR_SIZE = 23
+    WSP_ERROR_JOURNAL = 23,
+    WSP_ERROR_LOCK = 24,
+    WSP_ERROR_THREAD = 25,
+    WSP_ERROR_FULL = 26,
+    WSP_ERROR_SIZE = 27
 } wsp_errornum_t;
 
 /**
@@ -94,7 +103,33 @@ typedef enum {
     // open the database in write mode.
     WSP_READ = 0x01,
     // open the database in read mode.
-    WSP_WRITE = 0x02
+    WSP_WRITE = 0x02,
+    // keep running aggregates for the open bucket of every lower precision
+    // archive instead of re-reading the higher precision archive on every
+    // update, see wsp_rollup.h.
+    WSP_INCREMENTAL = 0x04,
+    // only write the highest precision archive on update, lower precision
+    // archives are rolled up by wsp_flush_rollups, wsp_close or before they
+    // are fetched from.
+    WSP_LAZY = 0x08,
+    // compare points with what is stored before writing them and leave
+    // unchanged points alone, this keeps mmap pages clean. Only has an effect
+    // on WSP_MMAP and WSP_MEMORY, where reading the stored points is free.
+    WSP_SKIP_UNCHANGED = 0x10,
+    // map WSP_MMAP databases in windows on demand instead of as a whole,
+    // see wsp_io_mmap.h.
+    WSP_WINDOWED = 0x20,
+    // read WSP_FILE and WSP_PREAD databases through the block cache shared
+    // by every handle in the process, see wsp_block_cache.h.
+    WSP_CACHED = 0x40,
+    // allow any number of threads to fetch points from the handle while a
+    // single thread updates it. Readers never block, they retry if an update
+    // raced with them. Only supported by WSP_MMAP and WSP_MEMORY without
+    // WSP_WINDOWED or WSP_LAZY.
+    WSP_CONCURRENT = 0x80,
+    // take an exclusive flock on the file for every update, like whisper
+    // does with LOCK = True, see wsp_lock.
+    WSP_LOCK = 0x100
 } wsp_flag_t;
 
 typedef enum {
@@ -105,6 +140,39 @@ typedef enum {
     WSP_MIN = 5
 } wsp_aggregation_t;
 
+/**
+ * Access pattern hints given with wsp_advise.
+ */
+typedef enum {
+    // no particular pattern, the kernel default.
+    WSP_ADVICE_NORMAL = 0,
+    // the range is read from start to end once, like whisper-dump does.
+    WSP_ADVICE_SEQUENTIAL = 1,
+    // the range is accessed a few points at a time, like a live writer.
+    WSP_ADVICE_RANDOM = 2,
+    // the range will be accessed soon, start reading it in.
+    WSP_ADVICE_WILLNEED = 3,
+    // the range will not be accessed soon.
+    WSP_ADVICE_DONTNEED = 4,
+    // read the range in now and wait for it.
+    WSP_ADVICE_POPULATE = 5
+} wsp_advice_t;
+
+/**
+ * Durability policies, see wsp_set_sync.
+ */
+typedef enum {
+    // leave writing dirty data back to the kernel.
+    WSP_SYNC_NONE = 0,
+    // start writeback of everything written when the database is closed.
+    WSP_SYNC_CLOSE = 1,
+    // start writeback of the ranges written every interval, and on close.
+    WSP_SYNC_PERIODIC = 2,
+    // like WSP_SYNC_PERIODIC, but wait with fsync for the data to reach the
+    // disk.
+    WSP_SYNC_FULL = 3
+} wsp_sync_t;
+
 typedef struct wsp_error_t wsp_error_t;
 typedef struct wsp_t wsp_t;
 typedef struct wsp_point_t wsp_point_t;
@@ -112,6 +180,8 @@ typedef struct wsp_archive_t wsp_archive_t;
 typedef struct wsp_archive_input_t wsp_archive_input_t;
 typedef struct wsp_point_input_t wsp_point_input_t;
 typedef struct wsp_metadata_t wsp_metadata_t;
+typedef struct wsp_rollup_t wsp_rollup_t;
+typedef struct wsp_lazy_t wsp_lazy_t;
 
 typedef double wsp_value_t;
 
@@ -185,6 +255,97 @@ typedef wsp_return_t(*wsp_io_write_f)(
     wsp_error_t *e
 );
 
+/**
+ * A single range of a vectored read or write.
+ */
+typedef struct {
+    // offset in the file.
+    long offset;
+    size_t size;
+    void *buf;
+} wsp_io_vec_t;
+
+/**
+ * I/O mapping vectored reader function, reads every range into its buffer
+ * in one operation where the mapping allows it.
+ *
+ * Like wsp_io_read_into_f this never allocates memory for the caller.
+ *
+ * w: Whisper database.
+ * vecs: Ranges to read.
+ * count: Number of ranges.
+ * e: Error object.
+ */
+typedef wsp_return_t(*wsp_io_readv_f)(
+    wsp_t *w,
+    wsp_io_vec_t *vecs,
+    int count,
+    wsp_error_t *e
+);
+
+/**
+ * I/O mapping vectored writer function, writes the buffer of every range in
+ * one operation where the mapping allows it.
+ *
+ * w: Whisper database.
+ * vecs: Ranges to write.
+ * count: Number of ranges.
+ * e: Error object.
+ */
+typedef wsp_return_t(*wsp_io_writev_f)(
+    wsp_t *w,
+    wsp_io_vec_t *vecs,
+    int count,
+    wsp_error_t *e
+);
+
+/**
+ * I/O mapping advise function, passes an access pattern hint for a range of
+ * the file on to the kernel or the caches of the mapping.
+ *
+ * w: Whisper database.
+ * offset: Offset of the range.
+ * size: Size of the range, zero means until the end of the file.
+ * advice: The hint.
+ * e: Error object.
+ */
+typedef wsp_return_t(*wsp_io_advise_f)(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    wsp_advice_t advice,
+    wsp_error_t *e
+);
+
+/**
+ * I/O mapping sync function, writes back the dirty ranges of the database
+ * and resets them.
+ *
+ * w: Whisper database.
+ * wait: Wait for the data to reach the disk if set, otherwise only start
+ * the writeback.
+ * e: Error object.
+ */
+typedef wsp_return_t(*wsp_io_sync_f)(
+    wsp_t *w,
+    int wait,
+    wsp_error_t *e
+);
+
+/**
+ * I/O mapping lock function, takes or releases an exclusive lock on the file
+ * which other processes respect.
+ *
+ * w: Whisper database.
+ * lock: Take the lock if set, otherwise release it.
+ * e: Error object.
+ */
+typedef wsp_return_t(*wsp_io_lock_f)(
+    wsp_t *w,
+    int lock,
+    wsp_error_t *e
+);
+
 /**
  * I/O mapping open function.
  *
@@ -199,6 +360,22 @@ typedef wsp_return_t(*wsp_io_open_f)(
     wsp_error_t *e
 );
 
+/**
+ * I/O mapping open function for a file which is already open. On success
+ * the mapping owns the descriptor, on failure it is left to the caller.
+ *
+ * w: Whisper database.
+ * fd: Descriptor of the open file.
+ * flags: Open flags.
+ * e: Error object.
+ */
+typedef wsp_return_t(*wsp_io_open_fd_f)(
+    wsp_t *w,
+    int fd,
+    int flags,
+    wsp_error_t *e
+);
+
 /**
  * Create the specified whisper database using the specified mapping.
  *
@@ -269,13 +446,64 @@ struct wsp_metadata_t {
 
 typedef struct {
     wsp_io_open_f open;
+    // NULL for mappings that are not backed by a file.
+    wsp_io_open_fd_f open_fd;
     wsp_io_close_f close;
     wsp_io_read_f read;
     wsp_io_read_into_f read_into;
     wsp_io_write_f write;
     wsp_io_create_f create;
+    wsp_io_readv_f readv;
+    wsp_io_writev_f writev;
+    wsp_io_advise_f advise;
+    wsp_io_sync_f sync;
+    wsp_io_lock_f lock;
 } wsp_io;
 
+/**
+ * Counters kept for every open database.
+ */
+typedef struct {
+    // points in a batch that were replaced by a later point for the same
+    // slot before being written.
+    uint64_t coalesced;
+    // segment writes that were skipped entirely with WSP_SKIP_UNCHANGED.
+    uint64_t skipped_writes;
+    // points that were not written because they were unchanged.
+    uint64_t skipped_points;
+} wsp_stats_t;
+
+#define WSP_STATS_INIT(s) do {\
+    (s)->coalesced = 0;\
+    (s)->skipped_writes = 0;\
+    (s)->skipped_points = 0;\
+} while(0)
+
+/**
+ * A range of the file which has been written to.
+ */
+typedef struct {
+    long offset;
+    size_t size;
+} wsp_range_t;
+
+/**
+ * Ranges written since the last sync, sorted and never overlapping or
+ * adjacent. Close ranges are merged when there are more than
+ * WSP_DIRTY_MAX_RANGES of them.
+ */
+typedef struct {
+    wsp_range_t *ranges;
+    size_t length;
+} wsp_dirty_t;
+
+#define WSP_DIRTY_MAX_RANGES 64
+
+#define WSP_DIRTY_INIT(d) do {\
+    (d)->ranges = NULL;\
+    (d)->length = 0;\
+} while(0)
+
 struct wsp_t {
     // metadata header
     wsp_metadata_t meta;
@@ -288,6 +516,9 @@ struct wsp_t {
     // indicates if I/O allocates an internal buffer that needs to be
     // de-allocated after it has been used.
     int io_manual_buf;
+    // indicates if reads return a view of the database instead of a copy,
+    // which makes them free.
+    int io_view;
     // archives
     // these are empty (NULL) until wsp_load_archives has been called.
     wsp_archive_t *archives;
@@ -296,16 +527,48 @@ struct wsp_t {
     // Real archive count that has *actually* been loaded.
     // This might differ from metadata if laoding fails.
     uint32_t archives_count;
+    // flags the database was opened with.
+    int flags;
+    // incremental rollup state, one for each archive.
+    // NULL unless opened with WSP_INCREMENTAL.
+    wsp_rollup_t *rollups;
+    // pending rollups, NULL unless opened with WSP_LAZY.
+    wsp_lazy_t *lazy;
+    // counters, reset when the database is opened.
+    wsp_stats_t stats;
+    // durability policy, see wsp_set_sync.
+    wsp_sync_t sync;
+    wsp_time_t sync_interval;
+    wsp_time_t sync_last;
+    // ranges written since the last sync, tracked by the WSP_MMAP, WSP_FILE
+    // and WSP_PREAD mappings.
+    wsp_dirty_t dirty;
+    // sequence counter of WSP_CONCURRENT handles, odd while an update is
+    // being written.
+    unsigned int seq;
+    // number of nested wsp_lock calls, the file is locked while non-zero.
+    unsigned int lock_depth;
 };
 
 #define WSP_INIT(w) do {\
     (w)->io_instance = NULL;\
     (w)->io_mapping = 0;\
     (w)->io_manual_buf = 0;\
+    (w)->io_view = 0;\
     (w)->io = NULL;\
     (w)->archives = NULL;\
     (w)->archives_size = 0;\
     (w)->archives_count = 0;\
+    (w)->flags = 0;\
+    (w)->rollups = NULL;\
+    (w)->lazy = NULL;\
+    WSP_STATS_INIT(&(w)->stats);\
+    (w)->sync = WSP_SYNC_NONE;\
+    (w)->sync_interval = 0;\
+    (w)->sync_last = 0;\
+    WSP_DIRTY_INIT(&(w)->dirty);\
+    (w)->seq = 0;\
+    (w)->lock_depth = 0;\
 } while(0)
 
 /**
@@ -314,7 +577,8 @@ struct wsp_t {
  * w: Whisper database handle, should have been initialized using WSP_INIT
  * prior to this function.
  * path: Path to the file containing the whisper database.
- * mapping: The file mapping method to use; WSP_MMAP or WSP_FILE.
+ * mapping: The file mapping method to use; WSP_MMAP, WSP_PREAD, WSP_URING,
+ * WSP_DIRECT or WSP_FILE.
  * flags: Open flags.
  * e: Error object.
  */
@@ -326,6 +590,53 @@ wsp_return_t wsp_open(
     wsp_error_t *e
 );
 
+/**
+ * Open a database from a file descriptor, which is useful to open files
+ * that are already open or were opened in a special way.
+ *
+ * The database takes ownership of the descriptor and closes it with
+ * wsp_close, it is also closed if opening fails. WSP_DIRECT changes the file
+ * status flags of the descriptor, which are shared with its duplicates, see
+ * wsp_io_direct.h.
+ *
+ * w: Whisper database handle, initialized using WSP_INIT.
+ * fd: Descriptor of the file, opened for reading and writing if flags
+ * contains WSP_WRITE.
+ * mapping: The file mapping method to use, any but WSP_MEMORY.
+ * flags: Open flags.
+ * e: Error object.
+ */
+wsp_return_t wsp_open_fd(
+    wsp_t *w,
+    int fd,
+    wsp_mapping_t mapping,
+    int flags,
+    wsp_error_t *e
+);
+
+/**
+ * Open a database relative to a directory descriptor, like openat(2).
+ *
+ * Writers that keep the descriptors of the directories they write to open
+ * avoid walking the full path for every open. The file is opened with
+ * O_CLOEXEC, and with O_NOATIME when the process is permitted to.
+ *
+ * w: Whisper database handle, initialized using WSP_INIT.
+ * dirfd: Descriptor of the directory, or AT_FDCWD.
+ * path: Path relative to dirfd.
+ * mapping: The file mapping method to use, any but WSP_MEMORY.
+ * flags: Open flags.
+ * e: Error object.
+ */
+wsp_return_t wsp_open_at(
+    wsp_t *w,
+    int dirfd,
+    const char *path,
+    wsp_mapping_t mapping,
+    int flags,
+    wsp_error_t *e
+);
+
 /**
  * Create the specified whisper database using the specified mapping.
  *
@@ -349,6 +660,10 @@ wsp_return_t wsp_create(
 /**
  * Close an already open whisper database.
  *
+ * Pending rollups of a WSP_LAZY database are flushed first, then the written
+ * ranges are synced as the policy set with wsp_set_sync asks for. The
+ * database is closed even if either fails, but WSP_ERROR is returned.
+ *
  * w: Whisper database.
  * e: Error object.
  */
@@ -357,6 +672,20 @@ wsp_return_t wsp_close(
     wsp_error_t *e
 );
 
+/**
+ * Reload the cached base point of every archive from the database.
+ *
+ * This is only necessary if the database might have been modified by
+ * something other than this handle since it was opened.
+ *
+ * w: Whisper database.
+ * e: Error object.
+ */
+wsp_return_t wsp_revalidate(
+    wsp_t *w,
+    wsp_error_t *e
+);
+
 /**
  * Same as wsp_update_now, but fetches the current timestamp from system.
  */
@@ -367,11 +696,23 @@ wsp_return_t wsp_update(
 );
 
 /**
- * Same as wsp_update but operates on an array of data.
+ * Propagate all pending updates of a database opened with WSP_LAZY to the
+ * lower precision archives.
  *
- * Internally invokes wsp_update_now in the same manner.
- * This function is _not_ atomic, updates will succeed in a linear fashion and
- * break whenever a single failure is encountered.
+ * Every affected bucket is recomputed once, no matter how many times it has
+ * been written to since the last flush. This is a no-op for databases that
+ * are not lazy.
+ *
+ * w: Whisper database.
+ * e: Error object.
+ */
+wsp_return_t wsp_flush_rollups(
+    wsp_t *w,
+    wsp_error_t *e
+);
+
+/**
+ * Same as wsp_update_many_now, but fetches the current timestamp from system.
  */
 wsp_return_t wsp_update_many(
     wsp_t *w,
@@ -380,6 +721,73 @@ wsp_return_t wsp_update_many(
     wsp_error_t *e
 );
 
+/**
+ * Same as wsp_increment_now, but fetches the current timestamp from system.
+ */
+wsp_return_t wsp_increment(
+    wsp_t *w,
+    wsp_time_t timestamp,
+    wsp_value_t delta,
+    wsp_error_t *e
+);
+
+/**
+ * Add to the value stored in the slot of a timestamp, in a single call.
+ *
+ * If the slot holds a point for the same (floored) timestamp delta is added
+ * to it, otherwise the slot is reset to delta. The result is propagated to
+ * the lower precision archives like any other update.
+ *
+ * w: Whisper database.
+ * timestamp: Timestamp of the counter.
+ * delta: Value to add.
+ * now: When 'now' is.
+ * e: Error object.
+ */
+wsp_return_t wsp_increment_now(
+    wsp_t *w,
+    wsp_time_t timestamp,
+    wsp_value_t delta,
+    wsp_time_t now,
+    wsp_error_t *e
+);
+
+/**
+ * Same as wsp_backfill_now, but fetches the current timestamp from system.
+ */
+wsp_return_t wsp_backfill(
+    wsp_t *w,
+    wsp_point_input_t *points,
+    size_t length,
+    wsp_error_t *e
+);
+
+/**
+ * Import a range of historical points.
+ *
+ * Every point is written to the highest precision archive which covers the
+ * oldest of them, the whole range is written with at most two I/O
+ * operations. Every affected bucket in the lower precision archives is then
+ * recomputed once.
+ *
+ * Points should be sorted by timestamp. Points older than the retention of
+ * the database are ignored, and if the range covers more slots than the
+ * archive has only the most recent ones are kept.
+ *
+ * w: Whisper database.
+ * points: Points to import.
+ * length: Number of points.
+ * now: When 'now' is.
+ * e: Error object.
+ */
+wsp_return_t wsp_backfill_now(
+    wsp_t *w,
+    wsp_point_input_t *points,
+    size_t length,
+    wsp_time_t now,
+    wsp_error_t *e
+);
+
 /**
  * Insert an update in the database.
  *
@@ -395,10 +803,32 @@ wsp_return_t wsp_update_now(
     wsp_error_t *e
 );
 
-wsp_return_t wsp_update_many(
+/**
+ * Insert a batch of updates in the database.
+ *
+ * Points are grouped by the archive they are written to and sorted by slot,
+ * each run of contiguous slots is written with a single I/O operation.
+ * Every affected bucket in the lower precision archives is then recomputed
+ * exactly once.
+ *
+ * Points which fall into the same slot are coalesced, only the one that comes
+ * last in the batch is written and they are counted in w->stats.coalesced.
+ *
+ * All points are validated before anything is written, if the batch contains
+ * a point in the future or outside of the retention of the database nothing
+ * will be written.
+ *
+ * w: Whisper database.
+ * points: Points to insert.
+ * length: Number of points to insert.
+ * now: When 'now' is.
+ * e: Error object.
+ */
+wsp_return_t wsp_update_many_now(
     wsp_t *w,
-    wsp_point_input_t *p,
+    wsp_point_input_t *points,
     size_t length,
+    wsp_time_t now,
     wsp_error_t *e
 );
 
@@ -420,6 +850,22 @@ wsp_return_t wsp_build_point(
     wsp_error_t *e
 );
 
+/**
+ * Structure to contain a single point read from an archive.
+ */
+struct wsp_point_t {
+    wsp_time_t timestamp;
+    wsp_value_t value;
+};
+
+/**
+ * Macro to initialize a single wsp_point_t.
+ */
+#define WSP_POINT_INIT(p) do { \
+    (p)->timestamp = 0; \
+    (p)->value = 0; \
+} while(0)
+
 struct wsp_archive_t {
     // absolute offset of archive in database.
     uint32_t offset;
@@ -430,6 +876,11 @@ struct wsp_archive_t {
     /* extra fields */
     size_t points_size;
     uint64_t retention;
+    // cached copy of the point in slot 0, which all other slots are relative
+    // to. Loaded with the archive and kept up to date by the writes of this
+    // library, use wsp_revalidate if the file might have been written by
+    // someone else.
+    wsp_point_t base;
 };
 
 // archive input structure.
@@ -448,6 +899,7 @@ struct wsp_point_input_t {
     (a)->offset = 0;\
     (a)->spp = 0;\
     (a)->count = 0;\
+    WSP_POINT_INIT(&(a)->base);\
 } while(0)
 
 wsp_return_t wsp_load_points(
@@ -503,6 +955,104 @@ wsp_return_t wsp_fetch_points(
     wsp_error_t *e
 );
 
+/**
+ * Set the durability policy of an open database.
+ *
+ * With WSP_SYNC_PERIODIC and WSP_SYNC_FULL the ranges written since the last
+ * sync are written back once interval seconds have passed, checked whenever
+ * points are written. An interval of zero only syncs on close.
+ *
+ * Written ranges are only tracked while the policy is not WSP_SYNC_NONE, so
+ * writes made before a policy is set are not written back by it.
+ *
+ * Fails with WSP_ERROR_NOT_OPEN if the database is not open and with
+ * WSP_ERROR_IO_MODE if the policy is unknown.
+ *
+ * w: Whisper database.
+ * policy: The policy.
+ * interval: Seconds between syncs.
+ * e: Error object.
+ */
+wsp_return_t wsp_set_sync(
+    wsp_t *w,
+    wsp_sync_t policy,
+    wsp_time_t interval,
+    wsp_error_t *e
+);
+
+/**
+ * Write back everything written to the database and wait for it to reach
+ * the disk, regardless of policy.
+ *
+ * w: Whisper database.
+ * e: Error object.
+ */
+wsp_return_t wsp_sync(
+    wsp_t *w,
+    wsp_error_t *e
+);
+
+/**
+ * Lock a database opened with WSP_LOCK against updates from other processes
+ * until the matching wsp_unlock.
+ *
+ * Every update takes the lock by itself, holding it across a batch of
+ * updates or a flush cycle costs a single flock pair instead of one per
+ * update. Calls nest, only the outermost pair locks and unlocks the file.
+ * The file is revalidated with wsp_revalidate when it is locked since
+ * another process might have written to it. Does nothing for databases
+ * opened without WSP_LOCK.
+ *
+ * w: Whisper database.
+ * e: Error object.
+ */
+wsp_return_t wsp_lock(
+    wsp_t *w,
+    wsp_error_t *e
+);
+
+/**
+ * Release a lock taken with wsp_lock.
+ *
+ * Pending rollups of a WSP_LAZY database are flushed before the file is
+ * unlocked, they would otherwise be applied on top of what other processes
+ * write in between.
+ *
+ * w: Whisper database.
+ * e: Error object.
+ */
+wsp_return_t wsp_unlock(
+    wsp_t *w,
+    wsp_error_t *e
+);
+
+/**
+ * Give a hint on how a range of an archive is going to be accessed.
+ *
+ * The range wraps around the end of the archive like wsp_load_points does.
+ * Hints are only hints, mappings which can not act on one ignore it.
+ *
+ * Use WSP_ADVICE_SEQUENTIAL before reading a whole archive,
+ * WSP_ADVICE_RANDOM for a database which only sees live updates,
+ * WSP_ADVICE_WILLNEED for the slots around the one being written and
+ * WSP_ADVICE_POPULATE right after wsp_open to fault everything in up front.
+ *
+ * w: Whisper database.
+ * archive: Archive the range belongs to, NULL for the whole file.
+ * offset: Index of the first point of the range.
+ * count: Number of points in the range, zero for the whole archive.
+ * advice: The hint.
+ * e: Error object.
+ */
+wsp_return_t wsp_advise(
+    wsp_t *w,
+    wsp_archive_t *archive,
+    uint32_t offset,
+    uint32_t count,
+    wsp_advice_t advice,
+    wsp_error_t *e
+);
+
 /* parse functions */
 wsp_return_t wsp_parse_factor(
     const char *string,
@@ -520,22 +1070,6 @@ wsp_return_t wsp_parse_point_input(
     wsp_point_input_t *point
 );
 
-/**
- * Structure to contain a single point read from an archive.
- */
-struct wsp_point_t {
-    wsp_time_t timestamp;
-    wsp_value_t value;
-};
-
-/**
- * Macro to initialize a single wsp_point_t.
- */
-#define WSP_POINT_INIT(p) do { \
-    (p)->timestamp = 0; \
-    (p)->value = 0; \
-} while(0)
-
 /**
  * Check that the io instance is of the expected type and assign it to self.
  *
@@ -0,0 +1,743 @@
+// vim: foldmethod=marker
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "wsp_block_cache.h"
+#include "wsp_debug.h"
+
+wsp_block_cache_t wsp_block_cache;
+
+static pthread_once_t __wsp_block_cache_once = PTHREAD_ONCE_INIT;
+
+// __wsp_block_cache_init {{{
+static void __wsp_block_cache_init(void)
+{
+    size_t max_blocks = WSP_BLOCK_CACHE_DEFAULT_SIZE / WSP_BLOCK_SIZE / WSP_BLOCK_CACHE_SHARDS;
+    int i;
+
+    for (i = 0; i < WSP_BLOCK_CACHE_SHARDS; i++) {
+        wsp_block_shard_t *s = wsp_block_cache.shards + i;
+        memset(s, 0, sizeof(wsp_block_shard_t));
+        pthread_mutex_init(&s->lock, NULL);
+        s->max_blocks = max_blocks;
+    }
+} // __wsp_block_cache_init }}}
+
+// __wsp_block_file_hash {{{
+static uint64_t __wsp_block_file_hash(
+    dev_t dev,
+    ino_t ino
+)
+{
+    uint64_t h = (uint64_t)ino * 0x9e3779b97f4a7c15ull;
+    h ^= (uint64_t)dev + 0x7f4a7c15ull + (h << 6) + (h >> 2);
+    return h ^ (h >> 29);
+} // __wsp_block_file_hash }}}
+
+// __wsp_block_hash {{{
+/*
+ * Hash of a block, derived from the hash of its file.
+ */
+static uint64_t __wsp_block_hash(
+    uint64_t file_hash,
+    uint64_t index
+)
+{
+    uint64_t h = file_hash ^ index * 0xc2b2ae3d27d4eb4full;
+    return h ^ (h >> 29);
+} // __wsp_block_hash }}}
+
+// __wsp_block_shard {{{
+/*
+ * Pick the shard of a file, the high bits of the hash are used so that the
+ * low bits still spread files and blocks over the tables of the shard.
+ */
+static wsp_block_shard_t *__wsp_block_shard(
+    uint64_t file_hash
+)
+{
+    pthread_once(&__wsp_block_cache_once, __wsp_block_cache_init);
+    return wsp_block_cache.shards + ((file_hash >> 48) & (WSP_BLOCK_CACHE_SHARDS - 1));
+} // __wsp_block_shard }}}
+
+// __wsp_block_shard_rehash {{{
+/*
+ * Size the hash tables of a shard for its budget.
+ */
+static wsp_return_t __wsp_block_shard_rehash(
+    wsp_block_shard_t *s
+)
+{
+    size_t table_size = 64;
+
+    while (table_size < s->max_blocks) {
+        table_size *= 2;
+    }
+
+    if (table_size == s->table_size) {
+        return WSP_OK;
+    }
+
+    wsp_block_t **table = calloc(table_size, sizeof(wsp_block_t *));
+    wsp_block_file_t **files = calloc(table_size, sizeof(wsp_block_file_t *));
+
+    if (table == NULL || files == NULL) {
+        free(table);
+        free(files);
+        return WSP_ERROR;
+    }
+
+    wsp_block_t *block;
+
+    for (block = s->head; block != NULL; block = block->next) {
+        // the first block of a file moves the file along.
+        uint64_t file_hash = __wsp_block_file_hash(block->file->dev, block->file->ino);
+
+        if (block->file->blocks == block) {
+            size_t slot = file_hash & (table_size - 1);
+            block->file->chain = files[slot];
+            files[slot] = block->file;
+        }
+
+        size_t slot = __wsp_block_hash(file_hash, block->index) & (table_size - 1);
+        block->chain = table[slot];
+        table[slot] = block;
+    }
+
+    free(s->table);
+    free(s->files);
+    s->table = table;
+    s->files = files;
+    s->table_size = table_size;
+
+    return WSP_OK;
+} // __wsp_block_shard_rehash }}}
+
+// __wsp_block_lru_unlink {{{
+static void __wsp_block_lru_unlink(
+    wsp_block_shard_t *s,
+    wsp_block_t *block
+)
+{
+    if (block->prev != NULL) {
+        block->prev->next = block->next;
+    }
+    else {
+        s->head = block->next;
+    }
+
+    if (block->next != NULL) {
+        block->next->prev = block->prev;
+    }
+    else {
+        s->tail = block->prev;
+    }
+
+    block->prev = NULL;
+    block->next = NULL;
+} // __wsp_block_lru_unlink }}}
+
+// __wsp_block_lru_push {{{
+static void __wsp_block_lru_push(
+    wsp_block_shard_t *s,
+    wsp_block_t *block
+)
+{
+    block->prev = NULL;
+    block->next = s->head;
+
+    if (s->head != NULL) {
+        s->head->prev = block;
+    }
+    else {
+        s->tail = block;
+    }
+
+    s->head = block;
+} // __wsp_block_lru_push }}}
+
+// __wsp_block_file_find {{{
+/*
+ * Look up a file in a locked shard whose tables are allocated.
+ *
+ * Returns the link to the file in its chain, which points to NULL if no
+ * blocks of the file are cached.
+ */
+static wsp_block_file_t **__wsp_block_file_find(
+    wsp_block_shard_t *s,
+    uint64_t file_hash,
+    dev_t dev,
+    ino_t ino
+)
+{
+    wsp_block_file_t **link = s->files + (file_hash & (s->table_size - 1));
+
+    while (*link != NULL && ((*link)->ino != ino || (*link)->dev != dev)) {
+        link = &(*link)->chain;
+    }
+
+    return link;
+} // __wsp_block_file_find }}}
+
+// __wsp_block_unlink {{{
+/*
+ * Take a block out of the tables and lists of its shard, the file goes away
+ * with its last block.
+ */
+static void __wsp_block_unlink(
+    wsp_block_shard_t *s,
+    wsp_block_t *block
+)
+{
+    wsp_block_file_t *file = block->file;
+    uint64_t file_hash = __wsp_block_file_hash(file->dev, file->ino);
+    size_t slot = __wsp_block_hash(file_hash, block->index) & (s->table_size - 1);
+    wsp_block_t **link = s->table + slot;
+
+    while (*link != block) {
+        link = &(*link)->chain;
+    }
+
+    *link = block->chain;
+
+    __wsp_block_lru_unlink(s, block);
+
+    if (block->file_prev != NULL) {
+        block->file_prev->file_next = block->file_next;
+    }
+    else {
+        file->blocks = block->file_next;
+    }
+
+    if (block->file_next != NULL) {
+        block->file_next->file_prev = block->file_prev;
+    }
+
+    block->file = NULL;
+
+    if (--file->count == 0) {
+        wsp_block_file_t **file_link = __wsp_block_file_find(s, file_hash, file->dev, file->ino);
+        *file_link = file->chain;
+        s->file_count--;
+        free(file);
+    }
+} // __wsp_block_unlink }}}
+
+// __wsp_block_remove {{{
+static void __wsp_block_remove(
+    wsp_block_shard_t *s,
+    wsp_block_t *block
+)
+{
+    __wsp_block_unlink(s, block);
+    s->count--;
+    free(block);
+} // __wsp_block_remove }}}
+
+// __wsp_block_file_drop {{{
+/*
+ * Remove every cached block of a file in a locked shard, which also removes
+ * the file.
+ */
+static void __wsp_block_file_drop(
+    wsp_block_shard_t *s,
+    wsp_block_file_t *file
+)
+{
+    size_t count = file->count;
+
+    s->generation++;
+
+    while (count-- > 0) {
+        __wsp_block_remove(s, file->blocks);
+    }
+} // __wsp_block_file_drop }}}
+
+// __wsp_block_find {{{
+/*
+ * Look up a block in a locked shard.
+ */
+static wsp_block_t *__wsp_block_find(
+    wsp_block_shard_t *s,
+    uint64_t hash,
+    const wsp_block_id_t *id,
+    uint64_t index
+)
+{
+    if (s->table == NULL) {
+        return NULL;
+    }
+
+    wsp_block_t *block;
+
+    for (block = s->table[hash & (s->table_size - 1)]; block != NULL; block = block->chain) {
+        if (block->index == index && block->file->ino == id->ino && block->file->dev == id->dev) {
+            return block;
+        }
+    }
+
+    return NULL;
+} // __wsp_block_find }}}
+
+// __wsp_block_insert {{{
+/*
+ * Fill a block in a locked shard, inserting it if it is not cached. The
+ * least recently used block is recycled if the shard is full. A file which
+ * has no cached blocks yet is remembered as the handle last saw it.
+ */
+static void __wsp_block_insert(
+    wsp_block_shard_t *s,
+    uint64_t file_hash,
+    uint64_t hash,
+    const wsp_block_id_t *id,
+    uint64_t index,
+    const void *data,
+    size_t length
+)
+{
+    wsp_block_t *block = __wsp_block_find(s, hash, id, index);
+
+    if (block != NULL) {
+        memcpy(block->data, data, length);
+        block->length = length;
+
+        if (s->head != block) {
+            __wsp_block_lru_unlink(s, block);
+            __wsp_block_lru_push(s, block);
+        }
+
+        return;
+    }
+
+    if (s->table == NULL && __wsp_block_shard_rehash(s) == WSP_ERROR) {
+        return;
+    }
+
+    // recycled before the file is looked up, it might be its last block.
+    if (s->count >= s->max_blocks) {
+        block = s->tail;
+        __wsp_block_unlink(s, block);
+        s->evictions++;
+    }
+    else {
+        block = malloc(sizeof(wsp_block_t));
+
+        if (block == NULL) {
+            return;
+        }
+
+        s->count++;
+    }
+
+    wsp_block_file_t **link = __wsp_block_file_find(s, file_hash, id->dev, id->ino);
+    wsp_block_file_t *file = *link;
+
+    if (file == NULL) {
+        file = malloc(sizeof(wsp_block_file_t));
+
+        if (file == NULL) {
+            s->count--;
+            free(block);
+            return;
+        }
+
+        file->dev = id->dev;
+        file->ino = id->ino;
+        file->mtime = id->mtime;
+        file->size = id->size;
+        file->blocks = NULL;
+        file->count = 0;
+        file->chain = NULL;
+        *link = file;
+        s->file_count++;
+    }
+
+    block->file = file;
+    block->index = index;
+    block->length = length;
+    memcpy(block->data, data, length);
+
+    size_t slot = hash & (s->table_size - 1);
+    block->chain = s->table[slot];
+    s->table[slot] = block;
+
+    __wsp_block_lru_push(s, block);
+
+    block->file_prev = NULL;
+    block->file_next = file->blocks;
+
+    if (file->blocks != NULL) {
+        file->blocks->file_prev = block;
+    }
+
+    file->blocks = block;
+    file->count++;
+} // __wsp_block_insert }}}
+
+// __wsp_block_cache_read {{{
+wsp_return_t __wsp_block_cache_read(
+    const wsp_block_id_t *id,
+    long offset,
+    size_t size,
+    void *buf,
+    wsp_block_fill_f fill,
+    void *ctx,
+    wsp_error_t *e
+)
+{
+    if (offset + (off_t)size > id->size) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = 0;
+        return WSP_ERROR;
+    }
+
+    uint64_t file_hash = __wsp_block_file_hash(id->dev, id->ino);
+    wsp_block_shard_t *s = __wsp_block_shard(file_hash);
+
+    char *p = (char *)buf;
+    char tmp[WSP_BLOCK_SIZE];
+
+    while (size > 0) {
+        uint64_t index = offset / WSP_BLOCK_SIZE;
+        size_t start = offset % WSP_BLOCK_SIZE;
+        size_t length = WSP_BLOCK_SIZE - start;
+
+        if (length > size) {
+            length = size;
+        }
+
+        uint64_t hash = __wsp_block_hash(file_hash, index);
+
+        pthread_mutex_lock(&s->lock);
+
+        wsp_block_t *block = __wsp_block_find(s, hash, id, index);
+
+        if (block != NULL && start + length <= block->length) {
+            memcpy(p, block->data + start, length);
+            s->hits++;
+
+            if (s->head != block) {
+                __wsp_block_lru_unlink(s, block);
+                __wsp_block_lru_push(s, block);
+            }
+
+            pthread_mutex_unlock(&s->lock);
+
+            p += length;
+            offset += length;
+            size -= length;
+            continue;
+        }
+
+        s->misses++;
+        uint64_t generation = s->generation;
+
+        pthread_mutex_unlock(&s->lock);
+
+        off_t block_offset = (off_t)index * WSP_BLOCK_SIZE;
+        size_t block_length = WSP_BLOCK_SIZE;
+
+        if (block_offset + (off_t)block_length > id->size) {
+            block_length = id->size - block_offset;
+        }
+
+        if (fill(ctx, block_offset, block_length, tmp, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+
+        memcpy(p, tmp + start, length);
+
+        pthread_mutex_lock(&s->lock);
+
+        // a write raced with the read, what was read might be stale.
+        if (s->generation == generation) {
+            __wsp_block_insert(s, file_hash, hash, id, index, tmp, block_length);
+        }
+
+        pthread_mutex_unlock(&s->lock);
+
+        p += length;
+        offset += length;
+        size -= length;
+    }
+
+    return WSP_OK;
+} // __wsp_block_cache_read }}}
+
+// __wsp_block_cache_store {{{
+void __wsp_block_cache_store(
+    const wsp_block_id_t *id,
+    uint64_t index,
+    const void *data,
+    size_t length
+)
+{
+    uint64_t file_hash = __wsp_block_file_hash(id->dev, id->ino);
+    wsp_block_shard_t *s = __wsp_block_shard(file_hash);
+
+    pthread_mutex_lock(&s->lock);
+    s->generation++;
+    __wsp_block_insert(s, file_hash, __wsp_block_hash(file_hash, index), id, index, data, length);
+    pthread_mutex_unlock(&s->lock);
+} // __wsp_block_cache_store }}}
+
+// __wsp_block_cache_update {{{
+void __wsp_block_cache_update(
+    const wsp_block_id_t *id,
+    long offset,
+    size_t size,
+    const void *buf
+)
+{
+    uint64_t file_hash = __wsp_block_file_hash(id->dev, id->ino);
+    wsp_block_shard_t *s = __wsp_block_shard(file_hash);
+    const char *p = (const char *)buf;
+
+    pthread_mutex_lock(&s->lock);
+
+    s->generation++;
+
+    while (size > 0) {
+        uint64_t index = offset / WSP_BLOCK_SIZE;
+        size_t start = offset % WSP_BLOCK_SIZE;
+        size_t length = WSP_BLOCK_SIZE - start;
+
+        if (length > size) {
+            length = size;
+        }
+
+        wsp_block_t *block = __wsp_block_find(s, __wsp_block_hash(file_hash, index), id, index);
+
+        if (block != NULL) {
+            if (start + length <= block->length) {
+                memcpy(block->data + start, p, length);
+            }
+            else {
+                // the file grew past the cached block.
+                __wsp_block_remove(s, block);
+            }
+        }
+
+        p += length;
+        offset += length;
+        size -= length;
+    }
+
+    pthread_mutex_unlock(&s->lock);
+} // __wsp_block_cache_update }}}
+
+// __wsp_block_cache_invalidate {{{
+void __wsp_block_cache_invalidate(
+    dev_t dev,
+    ino_t ino
+)
+{
+    uint64_t file_hash = __wsp_block_file_hash(dev, ino);
+    wsp_block_shard_t *s = __wsp_block_shard(file_hash);
+
+    pthread_mutex_lock(&s->lock);
+
+    s->generation++;
+
+    if (s->table != NULL) {
+        wsp_block_file_t *file = *__wsp_block_file_find(s, file_hash, dev, ino);
+
+        if (file != NULL) {
+            __wsp_block_file_drop(s, file);
+        }
+    }
+
+    pthread_mutex_unlock(&s->lock);
+} // __wsp_block_cache_invalidate }}}
+
+// __wsp_block_cache_validate {{{
+void __wsp_block_cache_validate(
+    wsp_block_id_t *id,
+    const struct stat *st
+)
+{
+    id->dev = st->st_dev;
+    id->ino = st->st_ino;
+    id->mtime = st->st_mtim;
+    id->size = st->st_size;
+
+    uint64_t file_hash = __wsp_block_file_hash(id->dev, id->ino);
+    wsp_block_shard_t *s = __wsp_block_shard(file_hash);
+
+    pthread_mutex_lock(&s->lock);
+
+    // nothing to check if nothing of the file is cached.
+    if (s->table != NULL) {
+        wsp_block_file_t *file = *__wsp_block_file_find(s, file_hash, id->dev, id->ino);
+
+        if (file != NULL && (
+            file->mtime.tv_sec != id->mtime.tv_sec ||
+            file->mtime.tv_nsec != id->mtime.tv_nsec ||
+            file->size != id->size
+        )) {
+            __wsp_block_file_drop(s, file);
+        }
+    }
+
+    pthread_mutex_unlock(&s->lock);
+} // __wsp_block_cache_validate }}}
+
+// __wsp_block_cache_remember {{{
+void __wsp_block_cache_remember(
+    wsp_block_id_t *id,
+    int fn
+)
+{
+    struct stat st;
+
+    // what is cached stays as it was, the next check drops it.
+    if (fstat(fn, &st) == -1) {
+        return;
+    }
+
+    id->mtime = st.st_mtim;
+    id->size = st.st_size;
+
+    uint64_t file_hash = __wsp_block_file_hash(id->dev, id->ino);
+    wsp_block_shard_t *s = __wsp_block_shard(file_hash);
+
+    pthread_mutex_lock(&s->lock);
+
+    if (s->table != NULL) {
+        wsp_block_file_t *file = *__wsp_block_file_find(s, file_hash, id->dev, id->ino);
+
+        if (file != NULL) {
+            file->mtime = id->mtime;
+            file->size = id->size;
+        }
+    }
+
+    pthread_mutex_unlock(&s->lock);
+} // __wsp_block_cache_remember }}}
+
+// __wsp_block_cache_revalidate {{{
+void __wsp_block_cache_revalidate(
+    wsp_block_id_t *id,
+    int fn
+)
+{
+    struct stat st;
+
+    // without a stat there is no telling what changed.
+    if (fstat(fn, &st) == -1) {
+        __wsp_block_cache_invalidate(id->dev, id->ino);
+        return;
+    }
+
+    __wsp_block_cache_validate(id, &st);
+} // __wsp_block_cache_revalidate }}}
+
+// __wsp_block_cache_invalidate_fd {{{
+void __wsp_block_cache_invalidate_fd(
+    int fn
+)
+{
+    struct stat st;
+
+    if (fstat(fn, &st) == -1) {
+        return;
+    }
+
+    __wsp_block_cache_invalidate(st.st_dev, st.st_ino);
+} // __wsp_block_cache_invalidate_fd }}}
+
+// wsp_block_cache_set_size {{{
+wsp_return_t wsp_block_cache_set_size(
+    size_t size,
+    wsp_error_t *e
+)
+{
+    pthread_once(&__wsp_block_cache_once, __wsp_block_cache_init);
+
+    size_t max_blocks = size / WSP_BLOCK_SIZE / WSP_BLOCK_CACHE_SHARDS;
+
+    if (max_blocks == 0) {
+        max_blocks = 1;
+    }
+
+    wsp_return_t result = WSP_OK;
+    int i;
+
+    for (i = 0; i < WSP_BLOCK_CACHE_SHARDS; i++) {
+        wsp_block_shard_t *s = wsp_block_cache.shards + i;
+
+        pthread_mutex_lock(&s->lock);
+
+        s->max_blocks = max_blocks;
+
+        while (s->count > s->max_blocks) {
+            s->evictions++;
+            __wsp_block_remove(s, s->tail);
+        }
+
+        if (s->table != NULL && __wsp_block_shard_rehash(s) == WSP_ERROR) {
+            e->type = WSP_ERROR_MALLOC;
+            result = WSP_ERROR;
+        }
+
+        pthread_mutex_unlock(&s->lock);
+    }
+
+    return result;
+} // wsp_block_cache_set_size }}}
+
+// wsp_block_cache_stats {{{
+void wsp_block_cache_stats(
+    wsp_block_cache_stats_t *stats
+)
+{
+    pthread_once(&__wsp_block_cache_once, __wsp_block_cache_init);
+
+    memset(stats, 0, sizeof(wsp_block_cache_stats_t));
+
+    int i;
+
+    for (i = 0; i < WSP_BLOCK_CACHE_SHARDS; i++) {
+        wsp_block_shard_t *s = wsp_block_cache.shards + i;
+
+        pthread_mutex_lock(&s->lock);
+        stats->hits += s->hits;
+        stats->misses += s->misses;
+        stats->evictions += s->evictions;
+        stats->count += s->count;
+        stats->files += s->file_count;
+        stats->max_blocks += s->max_blocks;
+        pthread_mutex_unlock(&s->lock);
+    }
+} // wsp_block_cache_stats }}}
+
+// wsp_block_cache_free {{{
+void wsp_block_cache_free(void)
+{
+    pthread_once(&__wsp_block_cache_once, __wsp_block_cache_init);
+
+    int i;
+
+    for (i = 0; i < WSP_BLOCK_CACHE_SHARDS; i++) {
+        wsp_block_shard_t *s = wsp_block_cache.shards + i;
+
+        pthread_mutex_lock(&s->lock);
+
+        s->generation++;
+
+        while (s->head != NULL) {
+            __wsp_block_remove(s, s->head);
+        }
+
+        free(s->table);
+        free(s->files);
+        s->table = NULL;
+        s->files = NULL;
+        s->table_size = 0;
+
+        pthread_mutex_unlock(&s->lock);
+    }
+} // wsp_block_cache_free }}}
@@ -0,0 +1,284 @@
+// vim: foldmethod=marker
+/**
+ * Bounded LRU cache of file blocks shared by every open database.
+ *
+ * Used by mappings which do not read through a memory map, the cache never
+ * holds more than its configured budget. Blocks are identified by the device
+ * and inode of the file they belong to, so they survive closing and opening a
+ * database again: a process which keeps reopening the same files is served
+ * from memory without touching the file.
+ *
+ * The cache is split into WSP_BLOCK_CACHE_SHARDS shards, each with its own
+ * lock, table and LRU list, so handles in different threads rarely contend.
+ * All blocks of a file live in the same shard, together with what the cache
+ * last saw of the file. Data is copied in and out under the shard lock, no
+ * pointer into the cache is ever handed out.
+ *
+ * The cache remembers the modification time and size of every file it holds
+ * blocks for, and forgets them together with the last block of the file.
+ * When a file is opened again and either of them has changed, another
+ * process wrote to it and its blocks are dropped. Handles which write update
+ * what is remembered right after each write. Writes by other processes while
+ * a handle is open are only seen when it is locked with WSP_LOCK, and changes
+ * within the timestamp granularity of the file system can go unnoticed.
+ */
+#ifndef _WSP_BLOCK_CACHE_H_
+#define _WSP_BLOCK_CACHE_H_
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "wsp.h"
+
+/**
+ * Size and alignment of a single block.
+ */
+#define WSP_BLOCK_SIZE 4096
+
+/**
+ * Default budget of the cache in bytes.
+ */
+#define WSP_BLOCK_CACHE_DEFAULT_SIZE (64 * 1024 * 1024)
+
+/**
+ * Number of independently locked shards, a power of two. The budget is split
+ * evenly between them.
+ */
+#define WSP_BLOCK_CACHE_SHARDS 16
+
+typedef struct wsp_block_t wsp_block_t;
+typedef struct wsp_block_file_t wsp_block_file_t;
+
+struct wsp_block_t {
+    // file the block belongs to.
+    wsp_block_file_t *file;
+    uint64_t index;
+    // number of valid bytes, less than WSP_BLOCK_SIZE at the end of a file.
+    size_t length;
+    /* lru list, most recently used first */
+    wsp_block_t *prev;
+    wsp_block_t *next;
+    /* hash chain */
+    wsp_block_t *chain;
+    /* blocks of the same file */
+    wsp_block_t *file_prev;
+    wsp_block_t *file_next;
+    char data[WSP_BLOCK_SIZE];
+};
+
+/**
+ * What the cache last saw of a file which it holds blocks for.
+ */
+struct wsp_block_file_t {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    off_t size;
+    // cached blocks of the file, the file is dropped with the last of them.
+    wsp_block_t *blocks;
+    size_t count;
+    /* hash chain */
+    wsp_block_file_t *chain;
+};
+
+/**
+ * Identity of a file read through the cache, and what the handle reading it
+ * last saw of it.
+ */
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    off_t size;
+} wsp_block_id_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    wsp_block_t **table;
+    // files with cached blocks, there are never more of them than blocks.
+    wsp_block_file_t **files;
+    // size of both tables.
+    size_t table_size;
+    // number of cached blocks.
+    size_t count;
+    // number of files with cached blocks.
+    size_t file_count;
+    // maximum number of cached blocks.
+    size_t max_blocks;
+    // bumped on every write, blocks read from the file while it changed are
+    // not cached.
+    uint64_t generation;
+    wsp_block_t *head;
+    wsp_block_t *tail;
+    /* statistics */
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} wsp_block_shard_t;
+
+typedef struct {
+    wsp_block_shard_t shards[WSP_BLOCK_CACHE_SHARDS];
+} wsp_block_cache_t;
+
+/**
+ * Counters of the block cache, summed over all shards.
+ */
+typedef struct {
+    // block lookups which were served from the cache.
+    uint64_t hits;
+    // block lookups which had to read the file.
+    uint64_t misses;
+    // blocks dropped to stay within the budget.
+    uint64_t evictions;
+    // number of cached blocks.
+    size_t count;
+    // number of files with cached blocks.
+    size_t files;
+    // maximum number of cached blocks.
+    size_t max_blocks;
+} wsp_block_cache_stats_t;
+
+/**
+ * Read part of a file into a buffer for the block cache.
+ *
+ * ctx: Context passed to __wsp_block_cache_read.
+ * offset: Offset of the block in the file, always a multiple of
+ *         WSP_BLOCK_SIZE.
+ * size: Number of bytes to read, WSP_BLOCK_SIZE except at the end of a file.
+ * buf: Buffer to read into.
+ * e: Error object.
+ */
+typedef wsp_return_t (*wsp_block_fill_f)(
+    void *ctx,
+    long offset,
+    size_t size,
+    void *buf,
+    wsp_error_t *e
+);
+
+/**
+ * The cache shared by all databases.
+ */
+extern wsp_block_cache_t wsp_block_cache;
+
+/**
+ * Set the memory budget of the block cache in bytes, evicting blocks if the
+ * cache currently holds more than that.
+ *
+ * size: Budget in bytes, at least one block per shard is always kept.
+ * e: Error object.
+ */
+wsp_return_t wsp_block_cache_set_size(
+    size_t size,
+    wsp_error_t *e
+);
+
+/**
+ * Sum up the counters of the block cache.
+ *
+ * stats: Filled with the counters.
+ */
+void wsp_block_cache_stats(
+    wsp_block_cache_stats_t *stats
+);
+
+/**
+ * Release every block held by the cache.
+ */
+void wsp_block_cache_free(void);
+
+/**
+ * Read a range of a file through the cache, blocks which are not cached are
+ * read with fill and cached.
+ *
+ * id: Identity of the file, its size bounds the range.
+ * offset: Offset to read from.
+ * size: Number of bytes to read.
+ * buf: Buffer to read into.
+ * fill: Function which reads blocks which are not cached.
+ * ctx: Passed to fill.
+ * e: Error object.
+ */
+wsp_return_t __wsp_block_cache_read(
+    const wsp_block_id_t *id,
+    long offset,
+    size_t size,
+    void *buf,
+    wsp_block_fill_f fill,
+    void *ctx,
+    wsp_error_t *e
+);
+
+/**
+ * Replace a whole block after it was written to the file.
+ *
+ * Caching is best effort, a block which can not be allocated is left out.
+ */
+void __wsp_block_cache_store(
+    const wsp_block_id_t *id,
+    uint64_t index,
+    const void *data,
+    size_t length
+);
+
+/**
+ * Update the cached blocks overlapping a range after it was written to the
+ * file, blocks which are not cached are left alone.
+ */
+void __wsp_block_cache_update(
+    const wsp_block_id_t *id,
+    long offset,
+    size_t size,
+    const void *buf
+);
+
+/**
+ * Remove every block belonging to a file.
+ */
+void __wsp_block_cache_invalidate(
+    dev_t dev,
+    ino_t ino
+);
+
+/**
+ * Identify a file and check it against what the cache last saw of it, every
+ * block belonging to it is removed if it has changed.
+ *
+ * id: Filled with the identity of the file.
+ * st: Result of fstat on the file.
+ */
+void __wsp_block_cache_validate(
+    wsp_block_id_t *id,
+    const struct stat *st
+);
+
+/**
+ * Remember the modification time and size of the file open as fn right after
+ * it was written through the cache, so that the write is not mistaken for
+ * one made by another process.
+ */
+void __wsp_block_cache_remember(
+    wsp_block_id_t *id,
+    int fn
+);
+
+/**
+ * Check the file open as fn against what the cache last saw of it, like
+ * __wsp_block_cache_validate. Every block belonging to id is removed if the
+ * file can not be stat:ed.
+ */
+void __wsp_block_cache_revalidate(
+    wsp_block_id_t *id,
+    int fn
+);
+
+/**
+ * Remove every block belonging to the file open as fn, if it can be
+ * identified.
+ */
+void __wsp_block_cache_invalidate_fd(
+    int fn
+);
+
+#endif /* _WSP_BLOCK_CACHE_H_ */
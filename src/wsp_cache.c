@@ -0,0 +1,533 @@
+// vim: foldmethod=marker
+#include "wsp_cache.h"
+#include "wsp_private.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wsp_debug.h"
+
+#define WSP_CACHE_TABLE_SIZE 1024
+
+// __wsp_cache_find {{{
+/*
+ * Find the link pointing to the entry for path, the link points to NULL if
+ * there is no such entry.
+ */
+static wsp_cache_entry_t **__wsp_cache_find(
+    wsp_cache_t *c,
+    const char *path,
+    uint32_t hash
+)
+{
+    wsp_cache_entry_t **link = c->table + (hash & (c->table_size - 1));
+
+    while (*link != NULL) {
+        if ((*link)->hash == hash && strcmp((*link)->path, path) == 0) {
+            break;
+        }
+
+        link = &(*link)->next;
+    }
+
+    return link;
+} // __wsp_cache_find }}}
+
+// __wsp_cache_grow {{{
+/*
+ * Double the size of the hash table.
+ */
+static wsp_return_t __wsp_cache_grow(
+    wsp_cache_t *c,
+    wsp_error_t *e
+)
+{
+    size_t table_size = c->table_size * 2;
+    wsp_cache_entry_t **table = calloc(table_size, sizeof(wsp_cache_entry_t *));
+
+    if (table == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        return WSP_ERROR;
+    }
+
+    size_t i;
+
+    for (i = 0; i < c->table_size; i++) {
+        wsp_cache_entry_t *entry = c->table[i];
+
+        while (entry != NULL) {
+            wsp_cache_entry_t *next = entry->next;
+            wsp_cache_entry_t **link = table + (entry->hash & (table_size - 1));
+            entry->next = *link;
+            *link = entry;
+            entry = next;
+        }
+    }
+
+    free(c->table);
+    c->table = table;
+    c->table_size = table_size;
+
+    return WSP_OK;
+} // __wsp_cache_grow }}}
+
+// __wsp_cache_flush_entry {{{
+/*
+ * Write all points of an entry to its database and remove it from the cache.
+ *
+ * Like carbon, points which the database can never accept because they are
+ * in the future or outside of its retention are dropped one by one and the
+ * rest is written. The points are dropped even if they could not be written.
+ */
+static wsp_return_t __wsp_cache_flush_entry(
+    wsp_cache_t *c,
+    wsp_cache_entry_t *entry,
+    wsp_error_t *e
+)
+{
+    wsp_return_t result = WSP_OK;
+    // points which are still to be written.
+    size_t written = entry->length;
+
+    wsp_t w;
+    WSP_INIT(&w);
+
+    if (DEBUG) {
+        DEBUG_PRINTF("flush: %s (%zu points)", entry->path, entry->length);
+    }
+
+    if (wsp_open(&w, entry->path, c->mapping, c->flags | WSP_READ | WSP_WRITE, e) == WSP_ERROR) {
+        result = WSP_ERROR;
+    }
+    else {
+        wsp_time_t now = wsp_time_now();
+        wsp_time_t max_retention = (wsp_time_t)w.meta.max_retention;
+        size_t i;
+
+        written = 0;
+
+        for (i = 0; i < entry->length; i++) {
+            wsp_point_input_t *point = entry->points + i;
+
+            if (point->timestamp > now) {
+                c->last_error.type = WSP_ERROR_FUTURE_TIMESTAMP;
+                c->failed++;
+                continue;
+            }
+
+            if (now - point->timestamp >= max_retention) {
+                c->last_error.type = WSP_ERROR_RETENTION;
+                c->failed++;
+                continue;
+            }
+
+            entry->points[written++] = *point;
+        }
+
+        if (wsp_update_many_now(&w, entry->points, written, now, e) == WSP_ERROR) {
+            result = WSP_ERROR;
+        }
+
+        wsp_error_t close_e;
+        WSP_ERROR_INIT(&close_e);
+
+        if (wsp_close(&w, &close_e) == WSP_ERROR && result == WSP_OK) {
+            *e = close_e;
+            result = WSP_ERROR;
+        }
+    }
+
+    if (result == WSP_ERROR) {
+        c->failed += written;
+        c->last_error = *e;
+    }
+    else {
+        c->flushes++;
+        c->flushed_points += written;
+    }
+
+    wsp_cache_entry_t **link = __wsp_cache_find(c, entry->path, entry->hash);
+    *link = entry->next;
+
+    c->metrics--;
+    c->points -= entry->length;
+
+    free(entry->points);
+    free(entry);
+
+    return result;
+} // __wsp_cache_flush_entry }}}
+
+// __wsp_cache_entry_cmp {{{
+static int __wsp_cache_largest_cmp(const void *a, const void *b)
+{
+    const wsp_cache_entry_t *l = *(wsp_cache_entry_t * const *)a;
+    const wsp_cache_entry_t *r = *(wsp_cache_entry_t * const *)b;
+
+    if (l->length != r->length) {
+        return l->length > r->length ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static int __wsp_cache_oldest_cmp(const void *a, const void *b)
+{
+    const wsp_cache_entry_t *l = *(wsp_cache_entry_t * const *)a;
+    const wsp_cache_entry_t *r = *(wsp_cache_entry_t * const *)b;
+
+    if (l->added != r->added) {
+        return l->added < r->added ? -1 : 1;
+    }
+
+    return 0;
+} // __wsp_cache_entry_cmp }}}
+
+// __wsp_cache_flush_ordered {{{
+/*
+ * Flush metrics in the order of the strategy, until count metrics have been
+ * flushed or the cache holds no more than limit points.
+ */
+static wsp_return_t __wsp_cache_flush_ordered(
+    wsp_cache_t *c,
+    size_t count,
+    size_t limit,
+    wsp_error_t *e
+)
+{
+    if (c->metrics == 0) {
+        return WSP_OK;
+    }
+
+    wsp_cache_entry_t **entries = malloc(sizeof(wsp_cache_entry_t *) * c->metrics);
+
+    if (entries == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        return WSP_ERROR;
+    }
+
+    size_t length = 0;
+    size_t i;
+
+    for (i = 0; i < c->table_size; i++) {
+        wsp_cache_entry_t *entry;
+
+        for (entry = c->table[i]; entry != NULL; entry = entry->next) {
+            entries[length++] = entry;
+        }
+    }
+
+    if (c->strategy == WSP_CACHE_OLDEST) {
+        qsort(entries, length, sizeof(wsp_cache_entry_t *), __wsp_cache_oldest_cmp);
+    }
+    else {
+        qsort(entries, length, sizeof(wsp_cache_entry_t *), __wsp_cache_largest_cmp);
+    }
+
+    if (count == 0 || count > length) {
+        count = length;
+    }
+
+    wsp_return_t result = WSP_OK;
+
+    for (i = 0; i < count && c->points > limit; i++) {
+        wsp_error_t flush_e;
+        WSP_ERROR_INIT(&flush_e);
+
+        if (__wsp_cache_flush_entry(c, entries[i], &flush_e) == WSP_ERROR && result == WSP_OK) {
+            *e = flush_e;
+            result = WSP_ERROR;
+        }
+    }
+
+    free(entries);
+
+    return result;
+} // __wsp_cache_flush_ordered }}}
+
+// wsp_cache_open {{{
+wsp_return_t wsp_cache_open(
+    wsp_cache_t *c,
+    wsp_mapping_t mapping,
+    int flags,
+    wsp_error_t *e
+)
+{
+    if (c->table != NULL) {
+        e->type = WSP_ERROR_ALREADY_OPEN;
+        return WSP_ERROR;
+    }
+
+    c->table = calloc(WSP_CACHE_TABLE_SIZE, sizeof(wsp_cache_entry_t *));
+
+    if (c->table == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        return WSP_ERROR;
+    }
+
+    c->table_size = WSP_CACHE_TABLE_SIZE;
+    c->mapping = mapping;
+    c->flags = flags;
+
+    return WSP_OK;
+} // wsp_cache_open }}}
+
+// wsp_cache_add {{{
+wsp_return_t wsp_cache_add(
+    wsp_cache_t *c,
+    const char *path,
+    wsp_point_input_t *points,
+    size_t length,
+    wsp_error_t *e
+)
+{
+    if (c->table == NULL) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    if (length == 0) {
+        return WSP_OK;
+    }
+
+    size_t path_length = strlen(path);
+    uint32_t hash = __wsp_fnv1a(path, path_length);
+    wsp_cache_entry_t **link = __wsp_cache_find(c, path, hash);
+    wsp_cache_entry_t *entry = *link;
+
+    if (entry == NULL) {
+        entry = malloc(sizeof(wsp_cache_entry_t) + path_length + 1);
+
+        if (entry == NULL) {
+            e->type = WSP_ERROR_MALLOC;
+            return WSP_ERROR;
+        }
+
+        entry->hash = hash;
+        entry->added = wsp_time_now();
+        entry->points = NULL;
+        entry->length = 0;
+        entry->capacity = 0;
+        entry->next = NULL;
+        memcpy(entry->path, path, path_length + 1);
+
+        *link = entry;
+        c->metrics++;
+    }
+
+    if (entry->length + length > entry->capacity) {
+        size_t capacity = entry->capacity == 0 ? 8 : entry->capacity;
+
+        while (capacity < entry->length + length) {
+            capacity *= 2;
+        }
+
+        wsp_point_input_t *tmp = realloc(
+            entry->points, sizeof(wsp_point_input_t) * capacity
+        );
+
+        if (tmp == NULL) {
+            e->type = WSP_ERROR_MALLOC;
+            return WSP_ERROR;
+        }
+
+        entry->points = tmp;
+        entry->capacity = capacity;
+    }
+
+    memcpy(entry->points + entry->length, points, sizeof(wsp_point_input_t) * length);
+    entry->length += length;
+    c->points += length;
+
+    if (c->max_points_per_metric != 0 && entry->length >= c->max_points_per_metric) {
+        wsp_error_t flush_e;
+        WSP_ERROR_INIT(&flush_e);
+        __wsp_cache_flush_entry(c, entry, &flush_e);
+    }
+
+    if (c->max_points != 0 && c->points > c->max_points) {
+        size_t limit = c->max_points * WSP_CACHE_LOW_WATER / 100;
+
+        wsp_error_t flush_e;
+        WSP_ERROR_INIT(&flush_e);
+
+        // metrics which could not be written are counted in c->failed.
+        if (__wsp_cache_flush_ordered(c, 0, limit, &flush_e) == WSP_ERROR && flush_e.type == WSP_ERROR_MALLOC) {
+            *e = flush_e;
+            return WSP_ERROR;
+        }
+    }
+
+    if (c->metrics > c->table_size * 2) {
+        if (__wsp_cache_grow(c, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    return WSP_OK;
+} // wsp_cache_add }}}
+
+// wsp_cache_flush_metric {{{
+wsp_return_t wsp_cache_flush_metric(
+    wsp_cache_t *c,
+    const char *path,
+    wsp_error_t *e
+)
+{
+    if (c->table == NULL) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    uint32_t hash = __wsp_fnv1a(path, strlen(path));
+    wsp_cache_entry_t *entry = *__wsp_cache_find(c, path, hash);
+
+    if (entry == NULL) {
+        return WSP_OK;
+    }
+
+    return __wsp_cache_flush_entry(c, entry, e);
+} // wsp_cache_flush_metric }}}
+
+// wsp_cache_flush {{{
+wsp_return_t wsp_cache_flush(
+    wsp_cache_t *c,
+    size_t count,
+    wsp_error_t *e
+)
+{
+    if (c->table == NULL) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    return __wsp_cache_flush_ordered(c, count, 0, e);
+} // wsp_cache_flush }}}
+
+// wsp_cache_flush_expired {{{
+wsp_return_t wsp_cache_flush_expired(
+    wsp_cache_t *c,
+    wsp_time_t now,
+    wsp_error_t *e
+)
+{
+    if (c->table == NULL) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    if (c->max_age == 0) {
+        return WSP_OK;
+    }
+
+    wsp_return_t result = WSP_OK;
+    size_t i;
+
+    for (i = 0; i < c->table_size; i++) {
+        wsp_cache_entry_t *entry = c->table[i];
+
+        while (entry != NULL) {
+            wsp_cache_entry_t *next = entry->next;
+
+            if (entry->added + c->max_age <= now) {
+                wsp_error_t flush_e;
+                WSP_ERROR_INIT(&flush_e);
+
+                if (__wsp_cache_flush_entry(c, entry, &flush_e) == WSP_ERROR && result == WSP_OK) {
+                    *e = flush_e;
+                    result = WSP_ERROR;
+                }
+            }
+
+            entry = next;
+        }
+    }
+
+    return result;
+} // wsp_cache_flush_expired }}}
+
+// wsp_cache_fetch_time_points {{{
+wsp_return_t wsp_cache_fetch_time_points(
+    wsp_cache_t *c,
+    const char *path,
+    wsp_t *w,
+    wsp_archive_t *archive,
+    wsp_time_t time_from,
+    wsp_time_t time_until,
+    wsp_point_t *result,
+    uint32_t *size,
+    wsp_error_t *e
+)
+{
+    if (c->table == NULL) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    if (wsp_fetch_time_points(w, archive, time_from, time_until, result, size, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    uint32_t hash = __wsp_fnv1a(path, strlen(path));
+    wsp_cache_entry_t *entry = *__wsp_cache_find(c, path, hash);
+
+    if (entry == NULL || *size == 0) {
+        return WSP_OK;
+    }
+
+    wsp_time_t from = wsp_time_floor(time_from, archive->spp);
+    size_t i;
+
+    // in insertion order, so the last cached point for a slot wins.
+    for (i = 0; i < entry->length; i++) {
+        wsp_time_t floored = wsp_time_floor(entry->points[i].timestamp, archive->spp);
+
+        if (floored < from) {
+            continue;
+        }
+
+        uint32_t index = (floored - from) / archive->spp;
+
+        if (index >= *size) {
+            continue;
+        }
+
+        result[index].timestamp = floored;
+        result[index].value = entry->points[i].value;
+    }
+
+    return WSP_OK;
+} // wsp_cache_fetch_time_points }}}
+
+// wsp_cache_close {{{
+wsp_return_t wsp_cache_close(
+    wsp_cache_t *c,
+    wsp_error_t *e
+)
+{
+    if (c->table == NULL) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    wsp_return_t result = WSP_OK;
+    size_t i;
+
+    for (i = 0; i < c->table_size; i++) {
+        while (c->table[i] != NULL) {
+            wsp_error_t flush_e;
+            WSP_ERROR_INIT(&flush_e);
+
+            if (__wsp_cache_flush_entry(c, c->table[i], &flush_e) == WSP_ERROR && result == WSP_OK) {
+                *e = flush_e;
+                result = WSP_ERROR;
+            }
+        }
+    }
+
+    free(c->table);
+    c->table = NULL;
+    c->table_size = 0;
+
+    return result;
+} // wsp_cache_close }}}
@@ -0,0 +1,210 @@
+// vim: foldmethod=marker
+/**
+ * In-process write-back point cache.
+ *
+ * The cache accepts points for many databases, holds them in memory keyed by
+ * path and writes them in batches through wsp_update_many. This is the
+ * equivalent of the cache in carbon, but without leaving the writer.
+ *
+ * Flushing is controlled by the following policies, each of them can be
+ * disabled by setting it to 0.
+ *
+ * - max_points_per_metric: A metric is flushed as soon as it holds this many
+ *   points.
+ * - max_points: When the cache holds more points than this, metrics are
+ *   flushed according to the strategy until it holds no more than
+ *   WSP_CACHE_LOW_WATER percent of the limit.
+ * - max_age: wsp_cache_flush_expired flushes every metric which has held
+ *   points for at least this many seconds.
+ *
+ * Points which cannot be written are dropped, they are counted in failed and
+ * the error is kept in last_error. Points in the future or outside of the
+ * retention of their database are dropped one by one, the rest of the metric
+ * is still written. Flushes done by wsp_cache_add only show up there, the
+ * explicit flush functions also report the first metric which could not be
+ * written after trying every other one.
+ *
+ * Example:
+ *
+ *   wsp_cache_t c;
+ *   WSP_CACHE_INIT(&c);
+ *
+ *   c.max_points = 1000000;
+ *
+ *   if (wsp_cache_open(&c, WSP_MMAP, 0, &e) == WSP_ERROR) {
+ *       ...
+ *   }
+ *
+ *   wsp_cache_add(&c, "/data/a/b.wsp", points, length, &e);
+ *   ...
+ *   wsp_cache_close(&c, &e);
+ */
+#ifndef _WSP_CACHE_H_
+#define _WSP_CACHE_H_
+
+#include "wsp.h"
+
+/**
+ * Percentage of max_points the cache is flushed down to once it is full, so
+ * that the metrics are not ordered again on every add.
+ */
+#define WSP_CACHE_LOW_WATER 90
+
+/**
+ * Order in which metrics are flushed when the cache is full.
+ */
+typedef enum {
+    // metrics holding the most points first, like carbon's 'max'.
+    WSP_CACHE_LARGEST = 1,
+    // metrics which have held points for the longest time first.
+    WSP_CACHE_OLDEST = 2
+} wsp_cache_strategy_t;
+
+typedef struct wsp_cache_entry_t wsp_cache_entry_t;
+
+struct wsp_cache_entry_t {
+    uint32_t hash;
+    // when the first point currently in the entry was added.
+    wsp_time_t added;
+    wsp_point_input_t *points;
+    size_t length;
+    size_t capacity;
+    wsp_cache_entry_t *next;
+    char path[];
+};
+
+typedef struct {
+    // hash table of entries, the size is always a power of two.
+    wsp_cache_entry_t **table;
+    size_t table_size;
+    // number of metrics in the cache.
+    size_t metrics;
+    // number of points in the cache.
+    size_t points;
+    // mapping and extra flags used when opening databases.
+    wsp_mapping_t mapping;
+    int flags;
+    /* policies */
+    size_t max_points;
+    size_t max_points_per_metric;
+    wsp_time_t max_age;
+    wsp_cache_strategy_t strategy;
+    /* statistics */
+    uint64_t flushes;
+    uint64_t flushed_points;
+    uint64_t failed;
+    wsp_error_t last_error;
+} wsp_cache_t;
+
+#define WSP_CACHE_INIT(c) do {\
+    (c)->table = NULL;\
+    (c)->table_size = 0;\
+    (c)->metrics = 0;\
+    (c)->points = 0;\
+    (c)->mapping = WSP_MAPPING_NONE;\
+    (c)->flags = 0;\
+    (c)->max_points = 0;\
+    (c)->max_points_per_metric = 0;\
+    (c)->max_age = 0;\
+    (c)->strategy = WSP_CACHE_LARGEST;\
+    (c)->flushes = 0;\
+    (c)->flushed_points = 0;\
+    (c)->failed = 0;\
+    WSP_ERROR_INIT(&(c)->last_error);\
+} while(0)
+
+/**
+ * Prepare a cache for use.
+ *
+ * c: Cache, should have been initialized using WSP_CACHE_INIT.
+ * mapping: The mapping to use when writing to databases.
+ * flags: Extra open flags, WSP_READ and WSP_WRITE are always set.
+ * e: Error object.
+ */
+wsp_return_t wsp_cache_open(
+    wsp_cache_t *c,
+    wsp_mapping_t mapping,
+    int flags,
+    wsp_error_t *e
+);
+
+/**
+ * Add points for a single metric to the cache.
+ *
+ * This might flush the metric, or other metrics, according to the policies of
+ * the cache.
+ *
+ * c: Cache.
+ * path: Path of the database the points belong to.
+ * points: Points to add.
+ * length: Number of points.
+ * e: Error object.
+ */
+wsp_return_t wsp_cache_add(
+    wsp_cache_t *c,
+    const char *path,
+    wsp_point_input_t *points,
+    size_t length,
+    wsp_error_t *e
+);
+
+/**
+ * Write all cached points of a single metric to its database.
+ */
+wsp_return_t wsp_cache_flush_metric(
+    wsp_cache_t *c,
+    const char *path,
+    wsp_error_t *e
+);
+
+/**
+ * Write up to count metrics to their databases in the order of the
+ * configured strategy, 0 flushes every metric.
+ */
+wsp_return_t wsp_cache_flush(
+    wsp_cache_t *c,
+    size_t count,
+    wsp_error_t *e
+);
+
+/**
+ * Write every metric that has held points for at least max_age seconds.
+ */
+wsp_return_t wsp_cache_flush_expired(
+    wsp_cache_t *c,
+    wsp_time_t now,
+    wsp_error_t *e
+);
+
+/**
+ * Same as wsp_fetch_time_points, but merges points that are still in the
+ * cache into the result.
+ *
+ * Cached points replace whatever is stored in the slot they would be written
+ * to, they are not aggregated when fetching from lower precision archives.
+ *
+ * c: Cache.
+ * path: Path of the database, used to look up cached points.
+ * w: The database at path, opened by the caller.
+ */
+wsp_return_t wsp_cache_fetch_time_points(
+    wsp_cache_t *c,
+    const char *path,
+    wsp_t *w,
+    wsp_archive_t *archive,
+    wsp_time_t time_from,
+    wsp_time_t time_until,
+    wsp_point_t *result,
+    uint32_t *size,
+    wsp_error_t *e
+);
+
+/**
+ * Flush everything and release all resources held by the cache.
+ */
+wsp_return_t wsp_cache_close(
+    wsp_cache_t *c,
+    wsp_error_t *e
+);
+
+#endif /* _WSP_CACHE_H_ */
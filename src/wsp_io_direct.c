@@ -0,0 +1,618 @@
+// vim: foldmethod=marker
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "wsp_io_direct.h"
+#include "wsp_io_pread.h"
+#include "wsp_block_cache.h"
+#include "wsp_private.h"
+#include "wsp_debug.h"
+
+// __wsp_direct_fill {{{
+/*
+ * Read a block of the file for the block cache, through the aligned block
+ * buffer of the handle.
+ */
+static wsp_return_t __wsp_direct_fill(
+    void *ctx,
+    long offset,
+    size_t size,
+    void *buf,
+    wsp_error_t *e
+)
+{
+    wsp_io_direct_inst_t *self = (wsp_io_direct_inst_t *)ctx;
+    size_t done = 0;
+
+    // always request whole blocks, the last one comes back short.
+    while (done < size) {
+        ssize_t r = pread(
+            self->fn, (char *)self->block + done, WSP_BLOCK_SIZE - done,
+            offset + done
+        );
+
+        if (r == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (r <= 0) {
+            e->type = WSP_ERROR_IO;
+            e->syserr = r == -1 ? errno : 0;
+            return WSP_ERROR;
+        }
+
+        done += r;
+    }
+
+    memcpy(buf, self->block, size);
+
+    return WSP_OK;
+} // __wsp_direct_fill }}}
+
+// __wsp_direct_store {{{
+/*
+ * Write the block buffer of the handle through to the file and cache it.
+ */
+static wsp_return_t __wsp_direct_store(
+    wsp_io_direct_inst_t *self,
+    uint64_t index,
+    size_t length,
+    wsp_error_t *e
+)
+{
+    off_t offset = (off_t)index * WSP_BLOCK_SIZE;
+    int partial = self->direct && length < WSP_BLOCK_SIZE;
+
+    /*
+     * O_DIRECT needs whole blocks, which would extend the file past its
+     * last partial block. Write that one through the page cache instead.
+     */
+    if (partial) {
+        int fl = fcntl(self->fn, F_GETFL);
+
+        if (fl == -1 || fcntl(self->fn, F_SETFL, fl & ~O_DIRECT) == -1) {
+            e->type = WSP_ERROR_IO;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
+    }
+
+    wsp_return_t result = WSP_OK;
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t r = pwrite(
+            self->fn, (char *)self->block + done, length - done,
+            offset + done
+        );
+
+        if (r == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (r == -1) {
+            e->type = WSP_ERROR_IO;
+            e->syserr = errno;
+            result = WSP_ERROR;
+            break;
+        }
+
+        done += r;
+    }
+
+    if (partial) {
+        int fl = fcntl(self->fn, F_GETFL);
+
+        if (fl == -1 || fcntl(self->fn, F_SETFL, fl | O_DIRECT) == -1) {
+            // reported over a failed write, the descriptor lost O_DIRECT.
+            e->type = WSP_ERROR_IO;
+            e->syserr = errno;
+            result = WSP_ERROR;
+        }
+    }
+
+    if (result == WSP_ERROR) {
+        // the file might hold any part of the write, forget what is cached.
+        __wsp_block_cache_invalidate(self->file.dev, self->file.ino);
+        return WSP_ERROR;
+    }
+
+    __wsp_block_cache_store(&self->file, index, self->block, length);
+
+    return WSP_OK;
+} // __wsp_direct_store }}}
+
+/*
+ * Open function for WSP_DIRECT mappings which takes a descriptor that is
+ * already open. The descriptor is left alone if opening fails.
+ *
+ * See wsp_open_fd_f for documentation on arguments.
+ */
+// __wsp_io_open_fd__direct {{{
+static int __wsp_io_open_fd__direct(
+    wsp_t *w,
+    int fn,
+    int flags,
+    wsp_error_t *e
+)
+{
+    int direct = 1;
+    int fl = fcntl(fn, F_GETFL);
+
+    if (fl == -1) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    if (!(fl & O_DIRECT) && fcntl(fn, F_SETFL, fl | O_DIRECT) == -1) {
+        // not supported by the file system.
+        if (errno != EINVAL) {
+            e->type = WSP_ERROR_IO;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
+
+        direct = 0;
+    }
+
+    struct stat st;
+
+    if (fstat(fn, &st) == -1) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    wsp_io_direct_inst_t *self = malloc(sizeof(wsp_io_direct_inst_t));
+
+    if (self == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    if (posix_memalign(&self->block, WSP_BLOCK_SIZE, WSP_BLOCK_SIZE) != 0) {
+        free(self);
+        e->type = WSP_ERROR_MALLOC;
+        return WSP_ERROR;
+    }
+
+    self->fn = fn;
+    self->direct = direct;
+    self->scratch = NULL;
+    self->scratch_size = 0;
+
+    __wsp_block_cache_validate(&self->file, &st);
+
+    w->io_instance = self;
+    w->io_mapping = WSP_DIRECT;
+    w->io_manual_buf = 0;
+    w->io_view = 0;
+
+    return WSP_OK;
+} // __wsp_io_open_fd__direct }}}
+
+/*
+ * Open function for WSP_DIRECT mappings.
+ *
+ * See wsp_open_f for documentation on arguments.
+ */
+// __wsp_io_open__direct {{{
+static int __wsp_io_open__direct(
+    wsp_t *w,
+    const char *path,
+    int flags,
+    wsp_error_t *e
+)
+{
+    int open_flags;
+
+    if (flags & WSP_READ && flags & WSP_WRITE) {
+        open_flags = O_RDWR;
+    }
+    else if (flags & WSP_READ) {
+        open_flags = O_RDONLY;
+    }
+    else if (flags & WSP_WRITE) {
+        // blocks are read before they are partially written.
+        open_flags = O_RDWR;
+    }
+    else {
+        e->type = WSP_ERROR_IO_MODE;
+        return WSP_ERROR;
+    }
+
+    int fn = open(path, open_flags | O_DIRECT);
+
+    // not supported by the file system.
+    if (fn == -1 && errno == EINVAL) {
+        fn = open(path, open_flags);
+    }
+
+    if (fn == -1) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    if (__wsp_io_open_fd__direct(w, fn, flags, e) == WSP_ERROR) {
+        close(fn);
+        return WSP_ERROR;
+    }
+
+    return WSP_OK;
+} // __wsp_io_open__direct }}}
+
+/*
+ * Close function for WSP_DIRECT mappings.
+ *
+ * See wsp_close_f for documentation on arguments.
+ */
+// __wsp_io_close__direct {{{
+static int __wsp_io_close__direct(
+    wsp_t *w,
+    wsp_error_t *e
+)
+{
+    wsp_io_direct_inst_t *self;
+    WSP_IO_CHECK(w, WSP_DIRECT, wsp_io_direct_inst_t, self, e);
+
+    close(self->fn);
+
+    free(self->block);
+    free(self->scratch);
+    free(self);
+
+    w->io_instance = NULL;
+
+    return WSP_OK;
+} // __wsp_io_close__direct }}}
+
+/*
+ * No memory allocation reader function for WSP_DIRECT mappings.
+ *
+ * See wsp_read_into_f for documentation on arguments.
+ */
+// __wsp_io_read_into__direct {{{
+static int __wsp_io_read_into__direct(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    void *buf,
+    wsp_error_t *e
+)
+{
+    wsp_io_direct_inst_t *self;
+    WSP_IO_CHECK(w, WSP_DIRECT, wsp_io_direct_inst_t, self, e);
+
+    return __wsp_block_cache_read(
+        &self->file, offset, size, buf,
+        __wsp_direct_fill, self, e
+    );
+} // __wsp_io_read_into__direct }}}
+
+/*
+ * Reader function for WSP_DIRECT mappings, reads into the scratch buffer of
+ * the handle.
+ *
+ * See wsp_read_f for documentation on arguments.
+ */
+// __wsp_io_read__direct {{{
+static int __wsp_io_read__direct(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    void **buf,
+    wsp_error_t *e
+)
+{
+    wsp_io_direct_inst_t *self;
+    WSP_IO_CHECK(w, WSP_DIRECT, wsp_io_direct_inst_t, self, e);
+
+    if (size > self->scratch_size) {
+        void *tmp = realloc(self->scratch, size);
+
+        if (tmp == NULL) {
+            e->type = WSP_ERROR_MALLOC;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
+
+        self->scratch = tmp;
+        self->scratch_size = size;
+    }
+
+    if (__wsp_io_read_into__direct(w, offset, size, self->scratch, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    *buf = self->scratch;
+
+    return WSP_OK;
+} // __wsp_io_read__direct }}}
+
+// __wsp_direct_write {{{
+/*
+ * Write a range one block at a time, reading in the blocks which are only
+ * partially replaced.
+ */
+static wsp_return_t __wsp_direct_write(
+    wsp_io_direct_inst_t *self,
+    long offset,
+    size_t size,
+    const void *buf,
+    wsp_error_t *e
+)
+{
+    if (offset + (off_t)size > self->file.size) {
+        e->type = WSP_ERROR_IO;
+        return WSP_ERROR;
+    }
+
+    const char *p = (const char *)buf;
+
+    while (size > 0) {
+        uint64_t index = offset / WSP_BLOCK_SIZE;
+        size_t start = offset % WSP_BLOCK_SIZE;
+        size_t length = WSP_BLOCK_SIZE - start;
+
+        if (length > size) {
+            length = size;
+        }
+
+        off_t block_offset = (off_t)index * WSP_BLOCK_SIZE;
+        size_t block_length = WSP_BLOCK_SIZE;
+
+        if (block_offset + (off_t)block_length > self->file.size) {
+            block_length = self->file.size - block_offset;
+        }
+
+        // read-modify-write unless the whole block is replaced.
+        int overwrite = start == 0 && length == block_length;
+
+        if (!overwrite) {
+            wsp_return_t r = __wsp_block_cache_read(
+                &self->file, block_offset, block_length,
+                self->block, __wsp_direct_fill, self, e
+            );
+
+            if (r == WSP_ERROR) {
+                return WSP_ERROR;
+            }
+        }
+
+        memcpy((char *)self->block + start, p, length);
+
+        if (__wsp_direct_store(self, index, block_length, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+
+        p += length;
+        offset += length;
+        size -= length;
+    }
+
+    return WSP_OK;
+} // __wsp_direct_write }}}
+
+/*
+ * Writer function for WSP_DIRECT mappings.
+ *
+ * See wsp_write_f for documentation on arguments.
+ */
+// __wsp_io_write__direct {{{
+static int __wsp_io_write__direct(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    void *buf,
+    wsp_error_t *e
+)
+{
+    wsp_io_direct_inst_t *self;
+    WSP_IO_CHECK(w, WSP_DIRECT, wsp_io_direct_inst_t, self, e);
+
+    if (__wsp_direct_write(self, offset, size, buf, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    __wsp_block_cache_remember(&self->file, self->fn);
+
+    return WSP_OK;
+} // __wsp_io_write__direct }}}
+
+/*
+ * Create function for WSP_DIRECT mappings.
+ */
+// __wsp_io_create__direct {{{
+static wsp_return_t __wsp_io_create__direct(
+    const char *path,
+    size_t size,
+    wsp_archive_t *created_archives,
+    size_t count,
+    wsp_metadata_t *metadata,
+    wsp_error_t *e
+)
+{
+    // stale blocks of a previous file are dropped by the pread mapping.
+    return wsp_io_pread.create(path, size, created_archives, count, metadata, e);
+} // __wsp_io_create__direct }}}
+
+/*
+ * Vectored reader function for WSP_DIRECT mappings.
+ *
+ * See wsp_readv_f for documentation on arguments.
+ */
+// __wsp_io_readv__direct {{{
+static int __wsp_io_readv__direct(
+    wsp_t *w,
+    wsp_io_vec_t *vecs,
+    int count,
+    wsp_error_t *e
+)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (__wsp_io_read_into__direct(w, vecs[i].offset, vecs[i].size, vecs[i].buf, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    return WSP_OK;
+} // __wsp_io_readv__direct }}}
+
+/*
+ * Vectored writer function for WSP_DIRECT mappings.
+ *
+ * See wsp_writev_f for documentation on arguments.
+ */
+// __wsp_io_writev__direct {{{
+static int __wsp_io_writev__direct(
+    wsp_t *w,
+    wsp_io_vec_t *vecs,
+    int count,
+    wsp_error_t *e
+)
+{
+    wsp_io_direct_inst_t *self;
+    WSP_IO_CHECK(w, WSP_DIRECT, wsp_io_direct_inst_t, self, e);
+
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (__wsp_direct_write(self, vecs[i].offset, vecs[i].size, vecs[i].buf, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    __wsp_block_cache_remember(&self->file, self->fn);
+
+    return WSP_OK;
+} // __wsp_io_writev__direct }}}
+
+/*
+ * Advise function for WSP_DIRECT mappings, the page cache is
+ * bypassed so only requests to read a range in are acted on, by loading it
+ * into the block cache.
+ *
+ * See wsp_advise_f for documentation on arguments.
+ */
+// __wsp_io_advise__direct {{{
+static int __wsp_io_advise__direct(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    wsp_advice_t advice,
+    wsp_error_t *e
+)
+{
+    wsp_io_direct_inst_t *self;
+    WSP_IO_CHECK(w, WSP_DIRECT, wsp_io_direct_inst_t, self, e);
+
+    if (advice != WSP_ADVICE_WILLNEED && advice != WSP_ADVICE_POPULATE) {
+        return WSP_OK;
+    }
+
+    if (size == 0) {
+        size = self->file.size - offset;
+    }
+
+    uint64_t index = offset / WSP_BLOCK_SIZE;
+    uint64_t last = (offset + size - 1) / WSP_BLOCK_SIZE;
+
+    for (; index <= last; index++) {
+        off_t block_offset = (off_t)index * WSP_BLOCK_SIZE;
+        size_t block_length = WSP_BLOCK_SIZE;
+
+        if (block_offset + (off_t)block_length > self->file.size) {
+            block_length = self->file.size - block_offset;
+        }
+
+        wsp_return_t r = __wsp_block_cache_read(
+            &self->file, block_offset, block_length,
+            self->block, __wsp_direct_fill, self, e
+        );
+
+        if (r == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    return WSP_OK;
+} // __wsp_io_advise__direct }}}
+
+/*
+ * Sync function for WSP_DIRECT mappings.
+ *
+ * See wsp_sync_f for documentation on arguments.
+ */
+// __wsp_io_sync__direct {{{
+static int __wsp_io_sync__direct(
+    wsp_t *w,
+    int wait,
+    wsp_error_t *e
+)
+{
+    wsp_io_direct_inst_t *self;
+    WSP_IO_CHECK(w, WSP_DIRECT, wsp_io_direct_inst_t, self, e);
+
+    // writes go through to the file, only the disk might still cache them.
+    if (wait && fsync(self->fn) == -1) {
+        e->type = WSP_ERROR_FSYNC;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    return WSP_OK;
+} // __wsp_io_sync__direct }}}
+
+/*
+ * Lock function for WSP_DIRECT mappings.
+ *
+ * See wsp_lock_f for documentation on arguments.
+ */
+// __wsp_io_lock__direct {{{
+static int __wsp_io_lock__direct(
+    wsp_t *w,
+    int lock,
+    wsp_error_t *e
+)
+{
+    wsp_io_direct_inst_t *self;
+    WSP_IO_CHECK(w, WSP_DIRECT, wsp_io_direct_inst_t, self, e);
+
+    if (__wsp_flock(self->fn, lock, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    // blocks cached before the lock are kept unless other writers changed
+    // the file since.
+    if (lock) {
+        __wsp_block_cache_revalidate(&self->file, self->fn);
+    }
+
+    return WSP_OK;
+} // __wsp_io_lock__direct }}}
+
+wsp_io wsp_io_direct = {
+    .open = __wsp_io_open__direct,
+    .open_fd = __wsp_io_open_fd__direct,
+    .close = __wsp_io_close__direct,
+    .read = __wsp_io_read__direct,
+    .read_into = __wsp_io_read_into__direct,
+    .write = __wsp_io_write__direct,
+    .create = __wsp_io_create__direct,
+    .readv = __wsp_io_readv__direct,
+    .writev = __wsp_io_writev__direct,
+    .advise = __wsp_io_advise__direct,
+    .sync = __wsp_io_sync__direct,
+    .lock = __wsp_io_lock__direct
+};
@@ -0,0 +1,42 @@
+#ifndef _WSP_IO_DIRECT_H_
+#define _WSP_IO_DIRECT_H_
+
+#include <sys/types.h>
+
+#include "wsp.h"
+#include "wsp_block_cache.h"
+
+/**
+ * Direct I/O which bypasses the kernel page cache.
+ *
+ * Files are opened with O_DIRECT and all I/O is done in aligned blocks of
+ * WSP_BLOCK_SIZE through the shared block cache in wsp_block_cache.h, whose
+ * budget is the only memory spent on caching whisper data. Points which do
+ * not line up with blocks are written with a read-modify-write of the blocks
+ * they touch, writes go through to the file immediately.
+ *
+ * File systems which do not support O_DIRECT fall back to regular I/O, the
+ * block cache is used either way.
+ *
+ * O_DIRECT is a file status flag, a descriptor passed to wsp_open_fd has it
+ * set for as long as the database is open, and so has every duplicate of
+ * that descriptor. It is cleared for the duration of writes to the last
+ * block when that block is partial.
+ */
+extern wsp_io wsp_io_direct;
+
+typedef struct {
+    // descriptor used for aligned block I/O.
+    int fn;
+    // set if fn was opened with O_DIRECT.
+    int direct;
+    // identity of the file in the block cache.
+    wsp_block_id_t file;
+    // WSP_BLOCK_SIZE bytes aligned for O_DIRECT, blocks are read and written
+    // through it.
+    void *block;
+    void *scratch;
+    size_t scratch_size;
+} wsp_io_direct_inst_t;
+
+#endif /* _WSP_IO_DIRECT_H_ */
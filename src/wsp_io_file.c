@@ -2,10 +2,137 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include "wsp_io_file.h"
+#include "wsp_block_cache.h"
 #include "wsp_private.h"
 
+// __wsp_file_identify {{{
+/*
+ * Look up the identity of the file in the block cache if opened with
+ * WSP_CACHED.
+ */
+static wsp_return_t __wsp_file_identify(
+    wsp_io_file_inst_t *self,
+    int fn,
+    int flags,
+    wsp_error_t *e
+)
+{
+    self->cached = (flags & WSP_CACHED) != 0;
+
+    if (!self->cached) {
+        return WSP_OK;
+    }
+
+    struct stat st;
+
+    if (fstat(fn, &st) == -1) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    __wsp_block_cache_validate(&self->file, &st);
+
+    return WSP_OK;
+} // __wsp_file_identify }}}
+
+// __wsp_file_fill {{{
+/*
+ * Read a block of the file for the block cache.
+ */
+static wsp_return_t __wsp_file_fill(
+    void *ctx,
+    long offset,
+    size_t size,
+    void *buf,
+    wsp_error_t *e
+)
+{
+    wsp_io_file_inst_t *self = (wsp_io_file_inst_t *)ctx;
+
+    if (fseek(self->fd, offset, SEEK_SET) == -1) {
+        e->type = WSP_ERROR_OFFSET;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    if (fread(buf, size, 1, self->fd) != 1) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    return WSP_OK;
+} // __wsp_file_fill }}}
+
+/*
+ * Open function for WSP_FILE mappings which takes a descriptor that is
+ * already open. The descriptor is left alone if opening fails.
+ *
+ * See wsp_open_fd_f for documentation on arguments.
+ */
+// __wsp_io_open_fd__file {{{
+static int __wsp_io_open_fd__file(
+    wsp_t *w,
+    int fn,
+    int flags,
+    wsp_error_t *e
+)
+{
+    const char *mode;
+
+    if (flags & WSP_READ && flags & WSP_WRITE) {
+        mode = "rb+";
+    }
+    else if (flags & WSP_READ) {
+        mode = "rb";
+    }
+    else if (flags & WSP_WRITE) {
+        // the file is already open, never truncate it.
+        mode = "rb+";
+    }
+    else {
+        e->type = WSP_ERROR_IO_MODE;
+        return WSP_ERROR;
+    }
+
+    // allocate first, a stream can not be closed without its descriptor.
+    wsp_io_file_inst_t *self = malloc(sizeof(wsp_io_file_inst_t));
+
+    if (self == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    if (__wsp_file_identify(self, fn, flags, e) == WSP_ERROR) {
+        free(self);
+        return WSP_ERROR;
+    }
+
+    FILE *fd = fdopen(fn, mode);
+
+    if (!fd) {
+        free(self);
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    self->fd = fd;
+
+    w->io_instance = self;
+    w->io_mapping = WSP_FILE;
+    w->io_manual_buf = 1;
+    w->io_view = 0;
+    w->io = &wsp_io_file;
+
+    return WSP_OK;
+} // __wsp_io_open_fd__file }}}
+
 /*
  * Open function for WSP_FILE mappings.
  *
@@ -54,9 +181,21 @@ static int __wsp_io_open__file(
 
     self->fd = fd;
 
+    if (__wsp_file_identify(self, fileno(fd), flags, e) == WSP_ERROR) {
+        fclose(fd);
+        free(self);
+        return WSP_ERROR;
+    }
+
+    // the file was truncated, anything cached for it is stale.
+    if (mode[0] == 'w') {
+        __wsp_block_cache_invalidate_fd(fileno(fd));
+    }
+
     w->io_instance = self;
     w->io_mapping = WSP_FILE;
     w->io_manual_buf = 1;
+    w->io_view = 0;
     w->io = &wsp_io_file;
 
     return WSP_OK;
@@ -102,9 +241,16 @@ static int __wsp_io_read_into__file(
     wsp_io_file_inst_t *self;
     WSP_IO_CHECK(w, WSP_FILE, wsp_io_file_inst_t, self, e);
 
+    if (self->cached) {
+        return __wsp_block_cache_read(
+            &self->file, offset, size, buf,
+            __wsp_file_fill, self, e
+        );
+    }
+
     FILE* fd = self->fd;
 
-    if (ftell(fd) != offset) {
+    if (fseek(fd, offset, SEEK_SET) == -1) {
         e->type = WSP_ERROR_OFFSET;
         e->syserr = errno;
         return WSP_ERROR;
@@ -133,11 +279,6 @@ static int __wsp_io_read__file(
     wsp_error_t *e
 )
 {
-    wsp_io_file_inst_t *self;
-    WSP_IO_CHECK(w, WSP_FILE, wsp_io_file_inst_t, self, e);
-
-    FILE* fd = self->fd;
-
     void *tmp = malloc(size);
 
     if (tmp == NULL) {
@@ -146,17 +287,8 @@ static int __wsp_io_read__file(
         return WSP_ERROR;
     }
 
-    if (ftell(fd) != offset) {
+    if (__wsp_io_read_into__file(w, offset, size, tmp, e) == WSP_ERROR) {
         free(tmp);
-        e->type = WSP_ERROR_OFFSET;
-        e->syserr = errno;
-        return WSP_ERROR;
-    }
-
-    if (fread(tmp, size, 1, fd) != 1) {
-        free(tmp);
-        e->type = WSP_ERROR_IO;
-        e->syserr = errno;
         return WSP_ERROR;
     }
 
@@ -196,7 +328,19 @@ static int __wsp_io_write__file(
         return WSP_ERROR;
     }
 
-    return WSP_OK;
+    if (self->cached) {
+        // other handles fill the cache from the file, it has to be there.
+        if (fflush(fd) == EOF) {
+            e->type = WSP_ERROR_IO;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
+
+        __wsp_block_cache_update(&self->file, offset, size, buf);
+        __wsp_block_cache_remember(&self->file, fileno(fd));
+    }
+
+    return __wsp_dirty_add(w, offset, size, e);
 } // __wsp_io_write__file }}}
 
 /*
@@ -229,6 +373,9 @@ wsp_return_t __wsp_io_create__file(
         return WSP_ERROR;
     }
 
+    // blocks of a previous file with the same inode are stale.
+    __wsp_block_cache_invalidate_fd(fn);
+
     if (ftruncate(fn, size) == -1) {
         fclose(fp);
         e->type = WSP_ERROR_FTRUNCATE;
@@ -272,11 +419,190 @@ wsp_return_t __wsp_io_create__file(
     return WSP_OK;
 } // __wsp_io_create__mmap }}}
 
+/*
+ * Vectored reader function for WSP_FILE mappings.
+ *
+ * See wsp_readv_f for documentation on arguments.
+ */
+// __wsp_io_readv__file {{{
+static int __wsp_io_readv__file(
+    wsp_t *w,
+    wsp_io_vec_t *vecs,
+    int count,
+    wsp_error_t *e
+)
+{
+    wsp_io_file_inst_t *self;
+    WSP_IO_CHECK(w, WSP_FILE, wsp_io_file_inst_t, self, e);
+
+    if (self->cached) {
+        int i;
+
+        for (i = 0; i < count; i++) {
+            if (__wsp_io_read_into__file(w, vecs[i].offset, vecs[i].size, vecs[i].buf, e) == WSP_ERROR) {
+                return WSP_ERROR;
+            }
+        }
+
+        return WSP_OK;
+    }
+
+    FILE* fd = self->fd;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (fseek(fd, vecs[i].offset, SEEK_SET) == -1) {
+            e->type = WSP_ERROR_OFFSET;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
+
+        if (fread(vecs[i].buf, vecs[i].size, 1, fd) != 1) {
+            e->type = WSP_ERROR_IO;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
+    }
+
+    return WSP_OK;
+} // __wsp_io_readv__file }}}
+
+/*
+ * Vectored writer function for WSP_FILE mappings.
+ *
+ * See wsp_writev_f for documentation on arguments.
+ */
+// __wsp_io_writev__file {{{
+static int __wsp_io_writev__file(
+    wsp_t *w,
+    wsp_io_vec_t *vecs,
+    int count,
+    wsp_error_t *e
+)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (__wsp_io_write__file(w, vecs[i].offset, vecs[i].size, vecs[i].buf, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    return WSP_OK;
+} // __wsp_io_writev__file }}}
+
+/*
+ * Advise function for WSP_FILE mappings.
+ *
+ * See wsp_advise_f for documentation on arguments.
+ */
+// __wsp_io_advise__file {{{
+static int __wsp_io_advise__file(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    wsp_advice_t advice,
+    wsp_error_t *e
+)
+{
+    wsp_io_file_inst_t *self;
+    WSP_IO_CHECK(w, WSP_FILE, wsp_io_file_inst_t, self, e);
+
+    return __wsp_fadvise(fileno(self->fd), offset, size, advice, e);
+} // __wsp_io_advise__file }}}
+
+/*
+ * Sync function for WSP_FILE mappings, the stream is flushed first.
+ *
+ * See wsp_sync_f for documentation on arguments.
+ */
+// __wsp_io_sync__file {{{
+static int __wsp_io_sync__file(
+    wsp_t *w,
+    int wait,
+    wsp_error_t *e
+)
+{
+    wsp_io_file_inst_t *self;
+    WSP_IO_CHECK(w, WSP_FILE, wsp_io_file_inst_t, self, e);
+
+    if (fflush(self->fd) == EOF) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    int fn = fileno(self->fd);
+
+    if (wait) {
+        if (fsync(fn) == -1) {
+            e->type = WSP_ERROR_FSYNC;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
+
+        return WSP_OK;
+    }
+
+    return __wsp_dirty_writeback(w, fn, e);
+} // __wsp_io_sync__file }}}
+
+/*
+ * Lock function for WSP_FILE mappings, the stream is flushed before
+ * unlocking.
+ *
+ * See wsp_lock_f for documentation on arguments.
+ */
+// __wsp_io_lock__file {{{
+static int __wsp_io_lock__file(
+    wsp_t *w,
+    int lock,
+    wsp_error_t *e
+)
+{
+    wsp_io_file_inst_t *self;
+    WSP_IO_CHECK(w, WSP_FILE, wsp_io_file_inst_t, self, e);
+
+    // buffered writes have to reach the file while it is still locked.
+    if (!lock && fflush(self->fd) == EOF) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    if (__wsp_flock(fileno(self->fd), lock, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    if (lock) {
+        // drop what was buffered before the lock, other writers may have
+        // changed it since.
+        if (fflush(self->fd) == EOF) {
+            e->type = WSP_ERROR_IO;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
+
+        // cached blocks are kept unless another writer changed the file.
+        if (self->cached) {
+            __wsp_block_cache_revalidate(&self->file, fileno(self->fd));
+        }
+    }
+
+    return WSP_OK;
+} // __wsp_io_lock__file }}}
+
 wsp_io wsp_io_file = {
     .open = __wsp_io_open__file,
+    .open_fd = __wsp_io_open_fd__file,
     .close = __wsp_io_close__file,
     .read = __wsp_io_read__file,
     .read_into = __wsp_io_read_into__file,
     .write = __wsp_io_write__file,
-    .create = __wsp_io_create__file
+    .create = __wsp_io_create__file,
+    .readv = __wsp_io_readv__file,
+    .writev = __wsp_io_writev__file,
+    .advise = __wsp_io_advise__file,
+    .sync = __wsp_io_sync__file,
+    .lock = __wsp_io_lock__file
 };
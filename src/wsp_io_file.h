@@ -1,16 +1,29 @@
 #ifndef _WSP_IO_FILE_H_
 #define _WSP_IO_FILE_H_
 
+#include <stdio.h>
+#include <sys/types.h>
+
 #include "wsp.h"
+#include "wsp_block_cache.h"
 
 /**
  * Regular file based I/O, this has the benefit of being insanely portable but
  * typically slower.
+ *
+ * Opened with WSP_CACHED, reads go through the block cache in
+ * wsp_block_cache.h which every cached handle in the process shares, so
+ * reopening a hot file is served from memory. Writes are flushed and update
+ * the cache immediately.
  */
 extern wsp_io wsp_io_file;
 
 typedef struct {
     FILE *fd;
+    // set if opened with WSP_CACHED.
+    int cached;
+    // identity of the file in the block cache, only set if cached.
+    wsp_block_id_t file;
 } wsp_io_file_inst_t;
 
 #endif /* _WSP_IO_FILE_H_ */
@@ -35,6 +35,7 @@ static int __wsp_io_open__memory(
     self->file = mf;
 
     w->io_instance = self;
+    w->io_view = 1;
 
     return WSP_OK;
 } // __wsp_io_open__memory }}}
@@ -155,7 +156,7 @@ wsp_return_t __wsp_io_create__memory(
 {
     off_t archives_offset = sizeof(wsp_metadata_b);
 
-    char *buf = malloc(size);
+    char *buf = calloc(1, size);
 
     if (buf == NULL) {
         e->type = WSP_ERROR_MALLOC;
@@ -170,6 +171,102 @@ wsp_return_t __wsp_io_create__memory(
     return WSP_OK;
 } // __wsp_io_create__memory }}}
 
+/*
+ * Vectored reader function for WSP_MEMORY mappings.
+ *
+ * See wsp_readv_f for documentation on arguments.
+ */
+// __wsp_io_readv__memory {{{
+static int __wsp_io_readv__memory(
+    wsp_t *w,
+    wsp_io_vec_t *vecs,
+    int count,
+    wsp_error_t *e
+)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (__wsp_io_read_into__memory(w, vecs[i].offset, vecs[i].size, vecs[i].buf, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    return WSP_OK;
+} // __wsp_io_readv__memory }}}
+
+/*
+ * Vectored writer function for WSP_MEMORY mappings.
+ *
+ * See wsp_writev_f for documentation on arguments.
+ */
+// __wsp_io_writev__memory {{{
+static int __wsp_io_writev__memory(
+    wsp_t *w,
+    wsp_io_vec_t *vecs,
+    int count,
+    wsp_error_t *e
+)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (__wsp_io_write__memory(w, vecs[i].offset, vecs[i].size, vecs[i].buf, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    return WSP_OK;
+} // __wsp_io_writev__memory }}}
+
+/*
+ * Advise function for WSP_MEMORY mappings, everything is in memory already.
+ *
+ * See wsp_advise_f for documentation on arguments.
+ */
+// __wsp_io_advise__memory {{{
+static int __wsp_io_advise__memory(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    wsp_advice_t advice,
+    wsp_error_t *e
+)
+{
+    return WSP_OK;
+} // __wsp_io_advise__memory }}}
+
+/*
+ * Sync function for WSP_MEMORY mappings, there is nothing to sync.
+ *
+ * See wsp_sync_f for documentation on arguments.
+ */
+// __wsp_io_sync__memory {{{
+static int __wsp_io_sync__memory(
+    wsp_t *w,
+    int wait,
+    wsp_error_t *e
+)
+{
+    return WSP_OK;
+} // __wsp_io_sync__memory }}}
+
+/*
+ * Lock function for WSP_MEMORY mappings, memory databases are private to
+ * the process so there is nothing to lock against.
+ *
+ * See wsp_lock_f for documentation on arguments.
+ */
+// __wsp_io_lock__memory {{{
+static int __wsp_io_lock__memory(
+    wsp_t *w,
+    int lock,
+    wsp_error_t *e
+)
+{
+    return WSP_OK;
+} // __wsp_io_lock__memory }}}
+
 wsp_io wsp_io_memory = {
     .open = __wsp_io_open__memory,
     .close = __wsp_io_close__memory,
@@ -177,4 +274,9 @@ wsp_io wsp_io_memory = {
     .read_into = __wsp_io_read_into__memory,
     .write = __wsp_io_write__memory,
     .create = __wsp_io_create__memory,
+    .readv = __wsp_io_readv__memory,
+    .writev = __wsp_io_writev__memory,
+    .advise = __wsp_io_advise__memory,
+    .sync = __wsp_io_sync__memory,
+    .lock = __wsp_io_lock__memory
 };
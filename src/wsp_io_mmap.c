@@ -9,68 +9,157 @@
 #include <sys/mman.h>
 
 #include "wsp_io_mmap.h"
+#include "wsp_block_cache.h"
 #include "wsp_private.h"
 #include "wsp_debug.h"
 
-// __wsp_io_open__mmap {{{
-static int __wsp_io_open__mmap(
+// __wsp_mmap_window {{{
+/*
+ * Find or map a window which covers size bytes at offset.
+ */
+static wsp_mmap_window_t *__wsp_mmap_window(
+    wsp_io_mmap_inst_t *self,
+    size_t offset,
+    size_t size,
+    wsp_error_t *e
+)
+{
+    wsp_mmap_window_t *victim = self->windows;
+    int i;
+
+    for (i = 0; i < WSP_MMAP_WINDOWS; i++) {
+        wsp_mmap_window_t *window = self->windows + i;
+
+        if (window->map == NULL) {
+            if (victim->map != NULL) {
+                victim = window;
+            }
+
+            continue;
+        }
+
+        if (window->offset <= offset && offset + size <= window->offset + window->size) {
+            window->used = ++self->tick;
+            return window;
+        }
+
+        if (victim->map != NULL && window->used < victim->used) {
+            victim = window;
+        }
+    }
+
+    size_t start = offset - offset % WSP_MMAP_WINDOW_SIZE;
+    size_t end = offset + size;
+
+    end += (WSP_MMAP_WINDOW_SIZE - end % WSP_MMAP_WINDOW_SIZE) % WSP_MMAP_WINDOW_SIZE;
+
+    if (end > self->size) {
+        end = self->size;
+    }
+
+    void *map = mmap(NULL, end - start, self->prot, MAP_SHARED, self->fn, start);
+
+    if (map == MAP_FAILED) {
+        e->type = WSP_ERROR_MMAP;
+        e->syserr = errno;
+        return NULL;
+    }
+
+    if (victim->map != NULL) {
+        munmap(victim->map, victim->size);
+    }
+
+    victim->map = (char *)map;
+    victim->offset = start;
+    victim->size = end - start;
+    victim->used = ++self->tick;
+
+    self->maps++;
+
+    return victim;
+} // __wsp_mmap_window }}}
+
+// __wsp_mmap_at {{{
+/*
+ * Address of size bytes at offset in the file.
+ */
+static char *__wsp_mmap_at(
+    wsp_io_mmap_inst_t *self,
+    long offset,
+    size_t size,
+    wsp_error_t *e
+)
+{
+    if (self->map != NULL) {
+        return (char *)self->map + offset;
+    }
+
+    if (offset < 0 || (size_t)offset + size > self->size) {
+        e->type = WSP_ERROR_IO_OFFSET;
+        return NULL;
+    }
+
+    wsp_mmap_window_t *window = __wsp_mmap_window(self, offset, size, e);
+
+    if (window == NULL) {
+        return NULL;
+    }
+
+    return window->map + (offset - window->offset);
+} // __wsp_mmap_at }}}
+
+// __wsp_io_open_fd__mmap {{{
+static int __wsp_io_open_fd__mmap(
     wsp_t *w,
-    const char *path,
+    int fn,
     int flags,
     wsp_error_t *e
 )
 {
     int mmap_prot;
-    int open_flags;
 
     if (flags & WSP_READ && flags & WSP_WRITE) {
         mmap_prot = PROT_READ | PROT_WRITE;
-        open_flags = O_RDWR;
     }
     else if (flags & WSP_READ) {
         mmap_prot = PROT_READ;
-        open_flags = O_RDONLY;
     }
     else if (flags & WSP_WRITE) {
         mmap_prot = PROT_WRITE;
-        open_flags = O_WRONLY;
     }
     else {
         e->type = WSP_ERROR_IO_MODE;
         return WSP_ERROR;
     }
 
-    int fn = open(path, open_flags);
-
-    if (fn == -1) {
-        e->type = WSP_ERROR_IO;
-        e->syserr = errno;
-        return WSP_ERROR;
-    }
-
     struct stat st;
 
     if (fstat(fn, &st) == -1) {
-        close(fn);
         e->type = WSP_ERROR_IO;
         e->syserr = errno;
         return WSP_ERROR;
     }
 
-    void *map = mmap(NULL, st.st_size, mmap_prot, MAP_SHARED, fn, 0);
+    void *map = NULL;
 
-    if (map == MAP_FAILED) {
-        close(fn);
-        e->type = WSP_ERROR_IO;
-        e->syserr = errno;
-        return WSP_ERROR;
+    // windows are mapped as they are accessed.
+    if (!(flags & WSP_WINDOWED)) {
+        map = mmap(NULL, st.st_size, mmap_prot, MAP_SHARED, fn, 0);
+
+        if (map == MAP_FAILED) {
+            e->type = WSP_ERROR_IO;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
     }
 
-    wsp_io_mmap_inst_t *self = malloc(sizeof(wsp_io_mmap_inst_t));
+    wsp_io_mmap_inst_t *self = calloc(1, sizeof(wsp_io_mmap_inst_t));
 
     if (self == NULL) {
-        close(fn);
-        munmap(map, st.st_size);
+        if (map != NULL) {
+            munmap(map, st.st_size);
+        }
+
         e->type = WSP_ERROR_MALLOC;
         e->syserr = errno;
         return WSP_ERROR;
@@ -79,10 +168,52 @@ static int __wsp_io_open__mmap(
     self->map = map;
     self->size = st.st_size;
     self->fn = fn;
+    self->prot = mmap_prot;
 
     w->io_instance = self;
     w->io_mapping = WSP_MMAP;
     w->io_manual_buf = 0;
+    w->io_view = 1;
+
+    return WSP_OK;
+} // __wsp_io_open_fd__mmap }}}
+
+// __wsp_io_open__mmap {{{
+static int __wsp_io_open__mmap(
+    wsp_t *w,
+    const char *path,
+    int flags,
+    wsp_error_t *e
+)
+{
+    int open_flags;
+
+    if (flags & WSP_READ && flags & WSP_WRITE) {
+        open_flags = O_RDWR;
+    }
+    else if (flags & WSP_READ) {
+        open_flags = O_RDONLY;
+    }
+    else if (flags & WSP_WRITE) {
+        open_flags = O_WRONLY;
+    }
+    else {
+        e->type = WSP_ERROR_IO_MODE;
+        return WSP_ERROR;
+    }
+
+    int fn = open(path, open_flags);
+
+    if (fn == -1) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    if (__wsp_io_open_fd__mmap(w, fn, flags, e) == WSP_ERROR) {
+        close(fn);
+        return WSP_ERROR;
+    }
 
     return WSP_OK;
 } // __wsp_io_open__mmap }}}
@@ -97,7 +228,18 @@ static int __wsp_io_close__mmap(
     WSP_IO_CHECK(w, WSP_MMAP, wsp_io_mmap_inst_t, self, e);
 
     close(self->fn);
-    munmap(self->map, self->size);
+
+    if (self->map != NULL) {
+        munmap(self->map, self->size);
+    }
+
+    int i;
+
+    for (i = 0; i < WSP_MMAP_WINDOWS; i++) {
+        if (self->windows[i].map != NULL) {
+            munmap(self->windows[i].map, self->windows[i].size);
+        }
+    }
 
     free(self);
 
@@ -123,7 +265,13 @@ static int __wsp_io_read__mmap(
     WSP_IO_CHECK(w, WSP_MMAP, wsp_io_mmap_inst_t, self, e);
 
     /* the beauty of mmaped files */
-    *buf = (char *)self->map + offset;
+    char *p = __wsp_mmap_at(self, offset, size, e);
+
+    if (p == NULL) {
+        return WSP_ERROR;
+    }
+
+    *buf = p;
     return WSP_OK;
 } // __wsp_io_read__mmap }}}
 
@@ -144,7 +292,13 @@ static int __wsp_io_read_into__mmap(
     wsp_io_mmap_inst_t *self;
     WSP_IO_CHECK(w, WSP_MMAP, wsp_io_mmap_inst_t, self, e);
 
-    memcpy(buf, (char*)self->map + offset, size);
+    char *p = __wsp_mmap_at(self, offset, size, e);
+
+    if (p == NULL) {
+        return WSP_ERROR;
+    }
+
+    memcpy(buf, p, size);
     return WSP_OK;
 } // __wsp_read_into__mmap }}}
 
@@ -165,8 +319,14 @@ static int __wsp_io_write__mmap(
     wsp_io_mmap_inst_t *self;
     WSP_IO_CHECK(w, WSP_MMAP, wsp_io_mmap_inst_t, self, e);
 
-    memcpy((char *)self->map + offset, buf, size);
-    return WSP_OK;
+    char *p = __wsp_mmap_at(self, offset, size, e);
+
+    if (p == NULL) {
+        return WSP_ERROR;
+    }
+
+    memcpy(p, buf, size);
+    return __wsp_dirty_add(w, offset, size, e);
 } // __wsp_io_write__mmap }}}
 
 /*
@@ -198,6 +358,9 @@ wsp_return_t __wsp_io_create__mmap(
         DEBUG_PRINTF("size = %zu", size);
     }
 
+    // blocks of a previous file with the same inode are stale.
+    __wsp_block_cache_invalidate_fd(fn);
+
     if (ftruncate(fn, size) == -1) {
         close(fn);
         e->type = WSP_ERROR_FTRUNCATE;
@@ -231,11 +394,208 @@ wsp_return_t __wsp_io_create__mmap(
     return WSP_OK;
 } // __wsp_io_create__mmap }}}
 
+/*
+ * Vectored reader function for WSP_MMAP mappings.
+ *
+ * See wsp_readv_f for documentation on arguments.
+ */
+// __wsp_io_readv__mmap {{{
+static int __wsp_io_readv__mmap(
+    wsp_t *w,
+    wsp_io_vec_t *vecs,
+    int count,
+    wsp_error_t *e
+)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (__wsp_io_read_into__mmap(w, vecs[i].offset, vecs[i].size, vecs[i].buf, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    return WSP_OK;
+} // __wsp_io_readv__mmap }}}
+
+/*
+ * Vectored writer function for WSP_MMAP mappings.
+ *
+ * See wsp_writev_f for documentation on arguments.
+ */
+// __wsp_io_writev__mmap {{{
+static int __wsp_io_writev__mmap(
+    wsp_t *w,
+    wsp_io_vec_t *vecs,
+    int count,
+    wsp_error_t *e
+)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (__wsp_io_write__mmap(w, vecs[i].offset, vecs[i].size, vecs[i].buf, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    return WSP_OK;
+} // __wsp_io_writev__mmap }}}
+
+/*
+ * Advise function for WSP_MMAP mappings.
+ *
+ * See wsp_advise_f for documentation on arguments.
+ */
+// __wsp_io_advise__mmap {{{
+static int __wsp_io_advise__mmap(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    wsp_advice_t advice,
+    wsp_error_t *e
+)
+{
+    wsp_io_mmap_inst_t *self;
+    WSP_IO_CHECK(w, WSP_MMAP, wsp_io_mmap_inst_t, self, e);
+
+    if (size == 0) {
+        size = self->size - offset;
+    }
+
+    // windows come and go, hint the page cache instead.
+    if (self->map == NULL) {
+        return __wsp_fadvise(self->fn, offset, size, advice, e);
+    }
+
+    int madvice;
+
+    switch (advice) {
+    case WSP_ADVICE_NORMAL:
+        madvice = POSIX_MADV_NORMAL;
+        break;
+    case WSP_ADVICE_SEQUENTIAL:
+        madvice = POSIX_MADV_SEQUENTIAL;
+        break;
+    case WSP_ADVICE_RANDOM:
+        madvice = POSIX_MADV_RANDOM;
+        break;
+    case WSP_ADVICE_WILLNEED:
+    case WSP_ADVICE_POPULATE:
+        madvice = POSIX_MADV_WILLNEED;
+        break;
+    case WSP_ADVICE_DONTNEED:
+        madvice = POSIX_MADV_DONTNEED;
+        break;
+    default:
+        e->type = WSP_ERROR_IO;
+        return WSP_ERROR;
+    }
+
+    long page = sysconf(_SC_PAGESIZE);
+    long start = offset - offset % page;
+
+    size += offset - start;
+
+    int r = posix_madvise((char *)self->map + start, size, madvice);
+
+    if (r != 0) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = r;
+        return WSP_ERROR;
+    }
+
+    // fault every page in now instead of on first access.
+    if (advice == WSP_ADVICE_POPULATE) {
+        volatile char *map = (volatile char *)self->map;
+        char sum = 0;
+        size_t i;
+
+        for (i = start; i < start + size; i += page) {
+            sum ^= map[i];
+        }
+
+        (void)sum;
+    }
+
+    return WSP_OK;
+} // __wsp_io_advise__mmap }}}
+
+/*
+ * Sync function for WSP_MMAP mappings.
+ *
+ * See wsp_sync_f for documentation on arguments.
+ */
+// __wsp_io_sync__mmap {{{
+static int __wsp_io_sync__mmap(
+    wsp_t *w,
+    int wait,
+    wsp_error_t *e
+)
+{
+    wsp_io_mmap_inst_t *self;
+    WSP_IO_CHECK(w, WSP_MMAP, wsp_io_mmap_inst_t, self, e);
+
+    if (wait) {
+        if (fsync(self->fn) == -1) {
+            e->type = WSP_ERROR_FSYNC;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
+
+        return WSP_OK;
+    }
+
+    if (self->map != NULL) {
+        long page = sysconf(_SC_PAGESIZE);
+        size_t i;
+
+        for (i = 0; i < w->dirty.length; i++) {
+            wsp_range_t *range = w->dirty.ranges + i;
+            long start = range->offset - range->offset % page;
+
+            if (msync((char *)self->map + start, range->size + (range->offset - start), MS_ASYNC) == -1) {
+                e->type = WSP_ERROR_FSYNC;
+                e->syserr = errno;
+                return WSP_ERROR;
+            }
+        }
+    }
+
+    // MS_ASYNC does not start writeback everywhere.
+    return __wsp_dirty_writeback(w, self->fn, e);
+} // __wsp_io_sync__mmap }}}
+
+/*
+ * Lock function for WSP_MMAP mappings, writes to a shared mapping are
+ * visible to other processes right away.
+ *
+ * See wsp_lock_f for documentation on arguments.
+ */
+// __wsp_io_lock__mmap {{{
+static int __wsp_io_lock__mmap(
+    wsp_t *w,
+    int lock,
+    wsp_error_t *e
+)
+{
+    wsp_io_mmap_inst_t *self;
+    WSP_IO_CHECK(w, WSP_MMAP, wsp_io_mmap_inst_t, self, e);
+
+    return __wsp_flock(self->fn, lock, e);
+} // __wsp_io_lock__mmap }}}
+
 wsp_io wsp_io_mmap = {
     .open = __wsp_io_open__mmap,
+    .open_fd = __wsp_io_open_fd__mmap,
     .close = __wsp_io_close__mmap,
     .read = __wsp_io_read__mmap,
     .read_into = __wsp_io_read_into__mmap,
     .write = __wsp_io_write__mmap,
     .create = __wsp_io_create__mmap,
+    .readv = __wsp_io_readv__mmap,
+    .writev = __wsp_io_writev__mmap,
+    .advise = __wsp_io_advise__mmap,
+    .sync = __wsp_io_sync__mmap,
+    .lock = __wsp_io_lock__mmap
 };
@@ -1,14 +1,51 @@
 #ifndef _WSP_IO_MMAP_H_
 #define _WSP_IO_MMAP_H_
 
+#include <stdint.h>
+
 #include "wsp.h"
 
+/**
+ * Size of a window when opened with WSP_WINDOWED, must be a multiple of the
+ * page size. Ranges which cross a window boundary get a larger window.
+ */
+#define WSP_MMAP_WINDOW_SIZE (1024 * 1024)
+
+/**
+ * Number of windows kept mapped per handle, the least recently used one is
+ * unmapped when another is needed.
+ */
+#define WSP_MMAP_WINDOWS 8
+
 extern wsp_io wsp_io_mmap;
 
+typedef struct {
+    // NULL if the slot is unused.
+    char *map;
+    size_t offset;
+    size_t size;
+    // tick of the last access, for eviction.
+    uint64_t used;
+} wsp_mmap_window_t;
+
+/**
+ * Without WSP_WINDOWED the whole file is mapped once in map. With it, map is
+ * NULL and regions are mapped in windows as they are accessed, so opening a
+ * huge file only costs the windows that are actually touched.
+ *
+ * Buffers returned by the read function of a windowed handle are valid until
+ * the window they point into is evicted, which takes more than
+ * WSP_MMAP_WINDOWS other windows to be accessed.
+ */
 typedef struct {
     void *map;
     size_t size;
     int fn;
+    int prot;
+    wsp_mmap_window_t windows[WSP_MMAP_WINDOWS];
+    uint64_t tick;
+    // number of windows mapped over the lifetime of the handle.
+    uint64_t maps;
 } wsp_io_mmap_inst_t;
 
 #endif /* _WSP_IO_MMAP_H_ */
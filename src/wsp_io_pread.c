@@ -0,0 +1,615 @@
+// vim: foldmethod=marker
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "wsp_io_pread.h"
+#include "wsp_block_cache.h"
+#include "wsp_private.h"
+#include "wsp_debug.h"
+
+// __wsp_pread_full {{{
+/*
+ * Read exactly size bytes at offset, retrying on short reads.
+ */
+static wsp_return_t __wsp_pread_full(
+    int fn,
+    off_t offset,
+    size_t size,
+    void *buf,
+    wsp_error_t *e
+)
+{
+    char *p = (char *)buf;
+
+    while (size > 0) {
+        ssize_t r = pread(fn, p, size, offset);
+
+        if (r == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            e->type = WSP_ERROR_IO;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
+
+        // end of file.
+        if (r == 0) {
+            e->type = WSP_ERROR_IO;
+            e->syserr = 0;
+            return WSP_ERROR;
+        }
+
+        p += r;
+        offset += r;
+        size -= r;
+    }
+
+    return WSP_OK;
+} // __wsp_pread_full }}}
+
+// __wsp_pwrite_full {{{
+/*
+ * Write exactly size bytes at offset, retrying on short writes.
+ */
+static wsp_return_t __wsp_pwrite_full(
+    int fn,
+    off_t offset,
+    size_t size,
+    const void *buf,
+    wsp_error_t *e
+)
+{
+    const char *p = (const char *)buf;
+
+    while (size > 0) {
+        ssize_t r = pwrite(fn, p, size, offset);
+
+        if (r == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            e->type = WSP_ERROR_IO;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
+
+        p += r;
+        offset += r;
+        size -= r;
+    }
+
+    return WSP_OK;
+} // __wsp_pwrite_full }}}
+
+// __wsp_pvec_full {{{
+/*
+ * Transfer every range, ranges which follow each other in the file go out
+ * in a single preadv or pwritev call. Short transfers are finished one
+ * range at a time.
+ */
+static wsp_return_t __wsp_pvec_full(
+    int fn,
+    wsp_io_vec_t *vecs,
+    int count,
+    int write,
+    wsp_error_t *e
+)
+{
+    if (count <= 0) {
+        return WSP_OK;
+    }
+
+    struct iovec iov[count];
+    int i = 0;
+
+    while (i < count) {
+        off_t offset = vecs[i].offset;
+        off_t end = offset;
+        int n = 0;
+
+        while (i + n < count && vecs[i + n].offset == end) {
+            iov[n].iov_base = vecs[i + n].buf;
+            iov[n].iov_len = vecs[i + n].size;
+            end += vecs[i + n].size;
+            n++;
+        }
+
+        ssize_t r;
+
+        do {
+            r = write ? pwritev(fn, iov, n, offset) : preadv(fn, iov, n, offset);
+        } while (r == -1 && errno == EINTR);
+
+        if (r == -1) {
+            e->type = WSP_ERROR_IO;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
+
+        size_t done = r;
+        int j;
+
+        for (j = 0; j < n; j++) {
+            wsp_io_vec_t *v = vecs + i + j;
+
+            if (done >= v->size) {
+                done -= v->size;
+                continue;
+            }
+
+            char *rest = (char *)v->buf + done;
+            wsp_return_t result;
+
+            if (write) {
+                result = __wsp_pwrite_full(fn, v->offset + done, v->size - done, rest, e);
+            }
+            else {
+                result = __wsp_pread_full(fn, v->offset + done, v->size - done, rest, e);
+            }
+
+            if (result == WSP_ERROR) {
+                return WSP_ERROR;
+            }
+
+            done = 0;
+        }
+
+        i += n;
+    }
+
+    return WSP_OK;
+} // __wsp_pvec_full }}}
+
+// __wsp_pread_fill {{{
+/*
+ * Read a block of the file for the block cache.
+ */
+static wsp_return_t __wsp_pread_fill(
+    void *ctx,
+    long offset,
+    size_t size,
+    void *buf,
+    wsp_error_t *e
+)
+{
+    wsp_io_pread_inst_t *self = (wsp_io_pread_inst_t *)ctx;
+    return __wsp_pread_full(self->fn, offset, size, buf, e);
+} // __wsp_pread_fill }}}
+
+/*
+ * Open function for WSP_PREAD mappings which takes a descriptor that is
+ * already open. The descriptor is left alone if opening fails.
+ *
+ * See wsp_open_fd_f for documentation on arguments.
+ */
+// __wsp_io_open_fd__pread {{{
+static int __wsp_io_open_fd__pread(
+    wsp_t *w,
+    int fn,
+    int flags,
+    wsp_error_t *e
+)
+{
+    struct stat st;
+
+    if (flags & WSP_CACHED && fstat(fn, &st) == -1) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    wsp_io_pread_inst_t *self = malloc(sizeof(wsp_io_pread_inst_t));
+
+    if (self == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    self->fn = fn;
+    self->cached = (flags & WSP_CACHED) != 0;
+
+    if (self->cached) {
+        __wsp_block_cache_validate(&self->file, &st);
+    }
+    self->scratch = NULL;
+    self->scratch_size = 0;
+
+    w->io_instance = self;
+    w->io_mapping = WSP_PREAD;
+    w->io_manual_buf = 0;
+    w->io_view = 0;
+
+    return WSP_OK;
+} // __wsp_io_open_fd__pread }}}
+
+/*
+ * Open function for WSP_PREAD mappings.
+ *
+ * See wsp_open_f for documentation on arguments.
+ */
+// __wsp_io_open__pread {{{
+static int __wsp_io_open__pread(
+    wsp_t *w,
+    const char *path,
+    int flags,
+    wsp_error_t *e
+)
+{
+    int open_flags;
+
+    if (flags & WSP_READ && flags & WSP_WRITE) {
+        open_flags = O_RDWR;
+    }
+    else if (flags & WSP_READ) {
+        open_flags = O_RDONLY;
+    }
+    else if (flags & WSP_WRITE) {
+        open_flags = O_WRONLY;
+    }
+    else {
+        e->type = WSP_ERROR_IO_MODE;
+        return WSP_ERROR;
+    }
+
+    int fn = open(path, open_flags);
+
+    if (fn == -1) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    if (__wsp_io_open_fd__pread(w, fn, flags, e) == WSP_ERROR) {
+        close(fn);
+        return WSP_ERROR;
+    }
+
+    return WSP_OK;
+} // __wsp_io_open__pread }}}
+
+/*
+ * Close function for WSP_PREAD mappings.
+ *
+ * See wsp_close_f for documentation on arguments.
+ */
+// __wsp_io_close__pread {{{
+static int __wsp_io_close__pread(
+    wsp_t *w,
+    wsp_error_t *e
+)
+{
+    wsp_io_pread_inst_t *self;
+    WSP_IO_CHECK(w, WSP_PREAD, wsp_io_pread_inst_t, self, e);
+
+    close(self->fn);
+
+    free(self->scratch);
+    free(self);
+
+    w->io_instance = NULL;
+
+    return WSP_OK;
+} // __wsp_io_close__pread }}}
+
+/*
+ * No memory allocation reader function for WSP_PREAD mappings.
+ *
+ * See wsp_read_into_f for documentation on arguments.
+ */
+// __wsp_io_read_into__pread {{{
+static int __wsp_io_read_into__pread(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    void *buf,
+    wsp_error_t *e
+)
+{
+    wsp_io_pread_inst_t *self;
+    WSP_IO_CHECK(w, WSP_PREAD, wsp_io_pread_inst_t, self, e);
+
+    if (self->cached) {
+        return __wsp_block_cache_read(
+            &self->file, offset, size, buf,
+            __wsp_pread_fill, self, e
+        );
+    }
+
+    return __wsp_pread_full(self->fn, offset, size, buf, e);
+} // __wsp_io_read_into__pread }}}
+
+/*
+ * Reader function for WSP_PREAD mappings, reads into the scratch buffer of
+ * the handle.
+ *
+ * See wsp_read_f for documentation on arguments.
+ */
+// __wsp_io_read__pread {{{
+static int __wsp_io_read__pread(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    void **buf,
+    wsp_error_t *e
+)
+{
+    wsp_io_pread_inst_t *self;
+    WSP_IO_CHECK(w, WSP_PREAD, wsp_io_pread_inst_t, self, e);
+
+    if (size > self->scratch_size) {
+        void *tmp = realloc(self->scratch, size);
+
+        if (tmp == NULL) {
+            e->type = WSP_ERROR_MALLOC;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
+
+        self->scratch = tmp;
+        self->scratch_size = size;
+    }
+
+    if (__wsp_io_read_into__pread(w, offset, size, self->scratch, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    *buf = self->scratch;
+
+    return WSP_OK;
+} // __wsp_io_read__pread }}}
+
+/*
+ * Writer function for WSP_PREAD mappings.
+ *
+ * See wsp_write_f for documentation on arguments.
+ */
+// __wsp_io_write__pread {{{
+static int __wsp_io_write__pread(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    void *buf,
+    wsp_error_t *e
+)
+{
+    wsp_io_pread_inst_t *self;
+    WSP_IO_CHECK(w, WSP_PREAD, wsp_io_pread_inst_t, self, e);
+
+    if (__wsp_pwrite_full(self->fn, offset, size, buf, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    if (self->cached) {
+        __wsp_block_cache_update(&self->file, offset, size, buf);
+        __wsp_block_cache_remember(&self->file, self->fn);
+    }
+
+    return __wsp_dirty_add(w, offset, size, e);
+} // __wsp_io_write__pread }}}
+
+/*
+ * Vectored reader function for WSP_PREAD mappings.
+ *
+ * See wsp_readv_f for documentation on arguments.
+ */
+// __wsp_io_readv__pread {{{
+static int __wsp_io_readv__pread(
+    wsp_t *w,
+    wsp_io_vec_t *vecs,
+    int count,
+    wsp_error_t *e
+)
+{
+    wsp_io_pread_inst_t *self;
+    WSP_IO_CHECK(w, WSP_PREAD, wsp_io_pread_inst_t, self, e);
+
+    if (self->cached) {
+        int i;
+
+        for (i = 0; i < count; i++) {
+            if (__wsp_io_read_into__pread(w, vecs[i].offset, vecs[i].size, vecs[i].buf, e) == WSP_ERROR) {
+                return WSP_ERROR;
+            }
+        }
+
+        return WSP_OK;
+    }
+
+    return __wsp_pvec_full(self->fn, vecs, count, 0, e);
+} // __wsp_io_readv__pread }}}
+
+/*
+ * Vectored writer function for WSP_PREAD mappings.
+ *
+ * See wsp_writev_f for documentation on arguments.
+ */
+// __wsp_io_writev__pread {{{
+static int __wsp_io_writev__pread(
+    wsp_t *w,
+    wsp_io_vec_t *vecs,
+    int count,
+    wsp_error_t *e
+)
+{
+    wsp_io_pread_inst_t *self;
+    WSP_IO_CHECK(w, WSP_PREAD, wsp_io_pread_inst_t, self, e);
+
+    if (__wsp_pvec_full(self->fn, vecs, count, 1, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    int i;
+
+    if (self->cached) {
+        for (i = 0; i < count; i++) {
+            __wsp_block_cache_update(&self->file, vecs[i].offset, vecs[i].size, vecs[i].buf);
+        }
+
+        __wsp_block_cache_remember(&self->file, self->fn);
+    }
+
+    for (i = 0; i < count; i++) {
+        if (__wsp_dirty_add(w, vecs[i].offset, vecs[i].size, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    return WSP_OK;
+} // __wsp_io_writev__pread }}}
+
+/*
+ * Create function for WSP_PREAD mappings.
+ */
+// __wsp_io_create__pread {{{
+wsp_return_t __wsp_io_create__pread(
+    const char *path,
+    size_t size,
+    wsp_archive_t *created_archives,
+    size_t count,
+    wsp_metadata_t *metadata,
+    wsp_error_t *e
+)
+{
+    int mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+
+    int fn = open(path, O_CREAT | O_RDWR, mode);
+
+    if (fn == -1) {
+        e->type = WSP_ERROR_OPEN;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    // blocks of a previous file with the same inode are stale.
+    __wsp_block_cache_invalidate_fd(fn);
+
+    if (ftruncate(fn, size) == -1) {
+        close(fn);
+        e->type = WSP_ERROR_FTRUNCATE;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    size_t header_size = sizeof(wsp_metadata_b) + sizeof(wsp_archive_b) * count;
+    char header[header_size];
+
+    __wsp_dump_metadata(metadata, (void *)header);
+    __wsp_dump_archives(created_archives, count, (void *)(header + sizeof(wsp_metadata_b)));
+
+    if (__wsp_pwrite_full(fn, 0, header_size, header, e) == WSP_ERROR) {
+        close(fn);
+        return WSP_ERROR;
+    }
+
+    if (fsync(fn) == -1) {
+        close(fn);
+        e->type = WSP_ERROR_FSYNC;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    close(fn);
+
+    return WSP_OK;
+} // __wsp_io_create__pread }}}
+
+/*
+ * Advise function for WSP_PREAD mappings.
+ *
+ * See wsp_advise_f for documentation on arguments.
+ */
+// __wsp_io_advise__pread {{{
+static int __wsp_io_advise__pread(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    wsp_advice_t advice,
+    wsp_error_t *e
+)
+{
+    wsp_io_pread_inst_t *self;
+    WSP_IO_CHECK(w, WSP_PREAD, wsp_io_pread_inst_t, self, e);
+
+    return __wsp_fadvise(self->fn, offset, size, advice, e);
+} // __wsp_io_advise__pread }}}
+
+/*
+ * Sync function for WSP_PREAD mappings.
+ *
+ * See wsp_sync_f for documentation on arguments.
+ */
+// __wsp_io_sync__pread {{{
+static int __wsp_io_sync__pread(
+    wsp_t *w,
+    int wait,
+    wsp_error_t *e
+)
+{
+    wsp_io_pread_inst_t *self;
+    WSP_IO_CHECK(w, WSP_PREAD, wsp_io_pread_inst_t, self, e);
+
+    if (wait) {
+        if (fsync(self->fn) == -1) {
+            e->type = WSP_ERROR_FSYNC;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
+
+        return WSP_OK;
+    }
+
+    return __wsp_dirty_writeback(w, self->fn, e);
+} // __wsp_io_sync__pread }}}
+
+/*
+ * Lock function for WSP_PREAD mappings.
+ *
+ * See wsp_lock_f for documentation on arguments.
+ */
+// __wsp_io_lock__pread {{{
+static int __wsp_io_lock__pread(
+    wsp_t *w,
+    int lock,
+    wsp_error_t *e
+)
+{
+    wsp_io_pread_inst_t *self;
+    WSP_IO_CHECK(w, WSP_PREAD, wsp_io_pread_inst_t, self, e);
+
+    if (__wsp_flock(self->fn, lock, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    // blocks cached before the lock are kept unless other writers changed
+    // the file since.
+    if (lock && self->cached) {
+        __wsp_block_cache_revalidate(&self->file, self->fn);
+    }
+
+    return WSP_OK;
+} // __wsp_io_lock__pread }}}
+
+wsp_io wsp_io_pread = {
+    .open = __wsp_io_open__pread,
+    .open_fd = __wsp_io_open_fd__pread,
+    .close = __wsp_io_close__pread,
+    .read = __wsp_io_read__pread,
+    .read_into = __wsp_io_read_into__pread,
+    .write = __wsp_io_write__pread,
+    .create = __wsp_io_create__pread,
+    .readv = __wsp_io_readv__pread,
+    .writev = __wsp_io_writev__pread,
+    .advise = __wsp_io_advise__pread,
+    .sync = __wsp_io_sync__pread,
+    .lock = __wsp_io_lock__pread
+};
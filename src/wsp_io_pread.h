@@ -0,0 +1,33 @@
+#ifndef _WSP_IO_PREAD_H_
+#define _WSP_IO_PREAD_H_
+
+#include <sys/types.h>
+
+#include "wsp.h"
+#include "wsp_block_cache.h"
+
+/**
+ * Positional I/O using pread and pwrite.
+ *
+ * Nothing depends on the file offset, so any number of handles can read the
+ * same file concurrently. Reads through wsp_io_read_f land in a scratch
+ * buffer owned by the handle which is only valid until the next read, no
+ * memory is allocated once it has grown large enough.
+ *
+ * Opened with WSP_CACHED, reads go through the block cache in
+ * wsp_block_cache.h which every cached handle in the process shares, and
+ * writes update it.
+ */
+extern wsp_io wsp_io_pread;
+
+typedef struct {
+    int fn;
+    // set if opened with WSP_CACHED.
+    int cached;
+    // identity of the file in the block cache, only set if cached.
+    wsp_block_id_t file;
+    void *scratch;
+    size_t scratch_size;
+} wsp_io_pread_inst_t;
+
+#endif /* _WSP_IO_PREAD_H_ */
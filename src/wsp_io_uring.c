@@ -0,0 +1,849 @@
+// vim: foldmethod=marker
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "wsp_io_uring.h"
+#include "wsp_io_pread.h"
+#include "wsp_private.h"
+#include "wsp_debug.h"
+
+#ifdef WSP_WITH_URING
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+wsp_uring_t wsp_uring_ctx = { .fd = -1 };
+
+// __wsp_uring_enter {{{
+static int __wsp_uring_enter(
+    wsp_uring_t *ring,
+    unsigned to_submit,
+    unsigned min_complete
+)
+{
+    int r;
+
+    do {
+        r = syscall(
+            __NR_io_uring_enter, ring->fd, to_submit, min_complete,
+            IORING_ENTER_GETEVENTS, NULL, 0
+        );
+    } while (r == -1 && errno == EINTR);
+
+    return r;
+} // __wsp_uring_enter }}}
+
+// wsp_uring_init {{{
+wsp_return_t wsp_uring_init(
+    unsigned entries,
+    wsp_error_t *e
+)
+{
+    wsp_uring_t *ring = &wsp_uring_ctx;
+
+    if (ring->fd != -1) {
+        e->type = WSP_ERROR_ALREADY_OPEN;
+        return WSP_ERROR;
+    }
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    int fd = syscall(__NR_io_uring_setup, entries, &p);
+
+    if (fd == -1) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_size > ring->sq_size) {
+            ring->sq_size = ring->cq_size;
+        }
+
+        ring->cq_size = ring->sq_size;
+    }
+
+    ring->sq_ptr = mmap(
+        NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        fd, IORING_OFF_SQ_RING
+    );
+
+    if (ring->sq_ptr == MAP_FAILED) {
+        goto error;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    }
+    else {
+        ring->cq_ptr = mmap(
+            NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            fd, IORING_OFF_CQ_RING
+        );
+
+        if (ring->cq_ptr == MAP_FAILED) {
+            munmap(ring->sq_ptr, ring->sq_size);
+            goto error;
+        }
+    }
+
+    ring->sqes = mmap(
+        NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        fd, IORING_OFF_SQES
+    );
+
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_ptr != ring->sq_ptr) {
+            munmap(ring->cq_ptr, ring->cq_size);
+        }
+
+        munmap(ring->sq_ptr, ring->sq_size);
+        goto error;
+    }
+
+    ring->ops = calloc(p.sq_entries, sizeof(wsp_uring_op_t));
+
+    if (ring->ops == NULL) {
+        munmap(ring->sqes, p.sq_entries * sizeof(struct io_uring_sqe));
+
+        if (ring->cq_ptr != ring->sq_ptr) {
+            munmap(ring->cq_ptr, ring->cq_size);
+        }
+
+        munmap(ring->sq_ptr, ring->sq_size);
+        close(fd);
+        e->type = WSP_ERROR_MALLOC;
+        return WSP_ERROR;
+    }
+
+    char *sq = (char *)ring->sq_ptr;
+    char *cq = (char *)ring->cq_ptr;
+
+    ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    ring->fd = fd;
+    ring->entries = p.sq_entries;
+    ring->queued = 0;
+
+    return WSP_OK;
+
+error:
+    e->type = WSP_ERROR_MMAP;
+    e->syserr = errno;
+    close(fd);
+    return WSP_ERROR;
+} // wsp_uring_init }}}
+
+// __wsp_uring_complete {{{
+/*
+ * Finish a completed operation, short transfers are completed synchronously.
+ */
+static wsp_return_t __wsp_uring_complete(
+    wsp_uring_op_t *op,
+    int res,
+    wsp_error_t *e
+)
+{
+    if (res < 0) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = -res;
+        return WSP_ERROR;
+    }
+
+    size_t done = res;
+
+    while (done < op->size) {
+        char *p = (char *)op->buf + done;
+        ssize_t r;
+
+        if (op->write) {
+            r = pwrite(op->fn, p, op->size - done, op->offset + done);
+        }
+        else {
+            r = pread(op->fn, p, op->size - done, op->offset + done);
+        }
+
+        if (r == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (r <= 0) {
+            e->type = WSP_ERROR_IO;
+            e->syserr = r == -1 ? errno : 0;
+            return WSP_ERROR;
+        }
+
+        done += r;
+    }
+
+    return WSP_OK;
+} // __wsp_uring_complete }}}
+
+// wsp_uring_submit {{{
+wsp_return_t wsp_uring_submit(
+    wsp_error_t *e
+)
+{
+    wsp_uring_t *ring = &wsp_uring_ctx;
+
+    if (ring->fd == -1 || ring->queued == 0) {
+        return WSP_OK;
+    }
+
+    unsigned queued = ring->queued;
+
+    if (__wsp_uring_enter(ring, queued, queued) == -1) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    ring->submits++;
+    ring->submitted += queued;
+
+    wsp_return_t result = WSP_OK;
+    unsigned completed = 0;
+
+    while (completed < queued) {
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+            if (__wsp_uring_enter(ring, 0, queued - completed) == -1) {
+                e->type = WSP_ERROR_IO;
+                e->syserr = errno;
+                return WSP_ERROR;
+            }
+
+            continue;
+        }
+
+        struct io_uring_cqe *cqe = ring->cqes + (head & *ring->cq_mask);
+        wsp_uring_op_t *op = ring->ops + cqe->user_data;
+
+        wsp_error_t op_e;
+        WSP_ERROR_INIT(&op_e);
+
+        // complete everything, a failed write belongs to its handle.
+        if (__wsp_uring_complete(op, cqe->res, &op_e) == WSP_ERROR) {
+            if (op->write) {
+                if (op->owner->error.type == WSP_ERROR_NONE) {
+                    op->owner->error = op_e;
+                }
+            }
+            else if (result == WSP_OK) {
+                *e = op_e;
+                result = WSP_ERROR;
+            }
+        }
+
+        if (op->write) {
+            free(op->buf);
+        }
+
+        op->buf = NULL;
+
+        __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+        completed++;
+    }
+
+    ring->queued = 0;
+
+    return result;
+} // wsp_uring_submit }}}
+
+// __wsp_uring_error {{{
+/*
+ * Report the error of a failed write queued by a handle, if there is one.
+ */
+static wsp_return_t __wsp_uring_error(
+    wsp_io_uring_inst_t *self,
+    wsp_error_t *e
+)
+{
+    if (self->error.type == WSP_ERROR_NONE) {
+        return WSP_OK;
+    }
+
+    *e = self->error;
+    WSP_ERROR_INIT(&self->error);
+
+    return WSP_ERROR;
+} // __wsp_uring_error }}}
+
+// __wsp_uring_queue {{{
+/*
+ * Queue a single operation, submitting first if the ring is full.
+ */
+static wsp_return_t __wsp_uring_queue(
+    wsp_uring_op_t *op,
+    wsp_error_t *e
+)
+{
+    wsp_uring_t *ring = &wsp_uring_ctx;
+
+    if (ring->queued == ring->entries) {
+        if (wsp_uring_submit(e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    unsigned tail = *ring->sq_tail;
+    unsigned base = tail - ring->queued;
+    unsigned flags = 0;
+    unsigned i;
+
+    // only the newest overlapping operation matters, it is already ordered
+    // after any older one it overlaps.
+    for (i = ring->queued; i > 0; i--) {
+        wsp_uring_op_t *queued = ring->ops + ((base + i - 1) & *ring->sq_mask);
+
+        if (queued->fn != op->fn) {
+            continue;
+        }
+
+        if (queued->offset + (long)queued->size <= op->offset) {
+            continue;
+        }
+
+        if (op->offset + (long)op->size <= queued->offset) {
+            continue;
+        }
+
+        // rewrite of a queued write, replace its data.
+        if (op->write && queued->write && queued->offset == op->offset && queued->size == op->size) {
+            memcpy(queued->buf, op->buf, op->size);
+            free(op->buf);
+            ring->merged++;
+            return WSP_OK;
+        }
+
+        // overlapping operations must not be reordered.
+        flags |= IOSQE_IO_DRAIN;
+        break;
+    }
+
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = ring->sqes + index;
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = op->write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->flags = flags;
+    sqe->fd = op->fn;
+    sqe->off = op->offset;
+    sqe->addr = (uintptr_t)op->buf;
+    sqe->len = op->size;
+    sqe->user_data = index;
+
+    ring->sq_array[index] = index;
+    ring->ops[index] = *op;
+    ring->queued++;
+
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    return WSP_OK;
+} // __wsp_uring_queue }}}
+
+// wsp_uring_free {{{
+wsp_return_t wsp_uring_free(
+    wsp_error_t *e
+)
+{
+    wsp_uring_t *ring = &wsp_uring_ctx;
+
+    if (ring->fd == -1) {
+        return WSP_OK;
+    }
+
+    wsp_return_t result = wsp_uring_submit(e);
+
+    munmap(ring->sqes, ring->entries * sizeof(struct io_uring_sqe));
+
+    if (ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_size);
+    }
+
+    munmap(ring->sq_ptr, ring->sq_size);
+    close(ring->fd);
+    free(ring->ops);
+
+    memset(ring, 0, sizeof(wsp_uring_t));
+    ring->fd = -1;
+
+    return result;
+} // wsp_uring_free }}}
+
+/*
+ * Open function for WSP_URING mappings which takes a descriptor that is
+ * already open. The descriptor is left alone if opening fails.
+ *
+ * See wsp_open_fd_f for documentation on arguments.
+ */
+// __wsp_io_open_fd__uring {{{
+static int __wsp_io_open_fd__uring(
+    wsp_t *w,
+    int fn,
+    int flags,
+    wsp_error_t *e
+)
+{
+    if (wsp_uring_ctx.fd == -1) {
+        if (wsp_uring_init(WSP_URING_ENTRIES, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    wsp_io_uring_inst_t *self = malloc(sizeof(wsp_io_uring_inst_t));
+
+    if (self == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    self->fn = fn;
+    self->scratch = NULL;
+    self->scratch_size = 0;
+    WSP_ERROR_INIT(&self->error);
+
+    w->io_instance = self;
+    w->io_mapping = WSP_URING;
+    w->io_manual_buf = 0;
+    w->io_view = 0;
+
+    return WSP_OK;
+} // __wsp_io_open_fd__uring }}}
+
+/*
+ * Open function for WSP_URING mappings.
+ *
+ * See wsp_open_f for documentation on arguments.
+ */
+// __wsp_io_open__uring {{{
+static int __wsp_io_open__uring(
+    wsp_t *w,
+    const char *path,
+    int flags,
+    wsp_error_t *e
+)
+{
+    int open_flags;
+
+    if (flags & WSP_READ && flags & WSP_WRITE) {
+        open_flags = O_RDWR;
+    }
+    else if (flags & WSP_READ) {
+        open_flags = O_RDONLY;
+    }
+    else if (flags & WSP_WRITE) {
+        open_flags = O_WRONLY;
+    }
+    else {
+        e->type = WSP_ERROR_IO_MODE;
+        return WSP_ERROR;
+    }
+
+    int fn = open(path, open_flags);
+
+    if (fn == -1) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    if (__wsp_io_open_fd__uring(w, fn, flags, e) == WSP_ERROR) {
+        close(fn);
+        return WSP_ERROR;
+    }
+
+    return WSP_OK;
+} // __wsp_io_open__uring }}}
+
+/*
+ * Close function for WSP_URING mappings, submits everything that is queued
+ * before the descriptor goes away.
+ *
+ * See wsp_close_f for documentation on arguments.
+ */
+// __wsp_io_close__uring {{{
+static int __wsp_io_close__uring(
+    wsp_t *w,
+    wsp_error_t *e
+)
+{
+    wsp_io_uring_inst_t *self;
+    WSP_IO_CHECK(w, WSP_URING, wsp_io_uring_inst_t, self, e);
+
+    wsp_return_t result = wsp_uring_submit(e);
+
+    if (result == WSP_OK) {
+        result = __wsp_uring_error(self, e);
+    }
+
+    close(self->fn);
+
+    free(self->scratch);
+    free(self);
+
+    w->io_instance = NULL;
+
+    return result;
+} // __wsp_io_close__uring }}}
+
+/*
+ * No memory allocation reader function for WSP_URING mappings.
+ *
+ * See wsp_read_into_f for documentation on arguments.
+ */
+// __wsp_io_read_into__uring {{{
+static int __wsp_io_read_into__uring(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    void *buf,
+    wsp_error_t *e
+)
+{
+    wsp_io_uring_inst_t *self;
+    WSP_IO_CHECK(w, WSP_URING, wsp_io_uring_inst_t, self, e);
+
+    wsp_uring_op_t op = {
+        .fn = self->fn,
+        .write = 0,
+        .owner = self,
+        .offset = offset,
+        .size = size,
+        .buf = buf
+    };
+
+    if (__wsp_uring_queue(&op, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    // the result is needed now, take every queued write along.
+    if (wsp_uring_submit(e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    return __wsp_uring_error(self, e);
+} // __wsp_io_read_into__uring }}}
+
+/*
+ * Reader function for WSP_URING mappings, reads into the scratch buffer of
+ * the handle.
+ *
+ * See wsp_read_f for documentation on arguments.
+ */
+// __wsp_io_read__uring {{{
+static int __wsp_io_read__uring(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    void **buf,
+    wsp_error_t *e
+)
+{
+    wsp_io_uring_inst_t *self;
+    WSP_IO_CHECK(w, WSP_URING, wsp_io_uring_inst_t, self, e);
+
+    if (size > self->scratch_size) {
+        void *tmp = realloc(self->scratch, size);
+
+        if (tmp == NULL) {
+            e->type = WSP_ERROR_MALLOC;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
+
+        self->scratch = tmp;
+        self->scratch_size = size;
+    }
+
+    if (__wsp_io_read_into__uring(w, offset, size, self->scratch, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    *buf = self->scratch;
+
+    return WSP_OK;
+} // __wsp_io_read__uring }}}
+
+/*
+ * Writer function for WSP_URING mappings, the data is copied and the write
+ * is queued.
+ *
+ * See wsp_write_f for documentation on arguments.
+ */
+// __wsp_io_write__uring {{{
+static int __wsp_io_write__uring(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    void *buf,
+    wsp_error_t *e
+)
+{
+    wsp_io_uring_inst_t *self;
+    WSP_IO_CHECK(w, WSP_URING, wsp_io_uring_inst_t, self, e);
+
+    if (__wsp_uring_error(self, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    void *copy = malloc(size);
+
+    if (copy == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    memcpy(copy, buf, size);
+
+    wsp_uring_op_t op = {
+        .fn = self->fn,
+        .write = 1,
+        .owner = self,
+        .offset = offset,
+        .size = size,
+        .buf = copy
+    };
+
+    if (__wsp_uring_queue(&op, e) == WSP_ERROR) {
+        free(copy);
+        return WSP_ERROR;
+    }
+
+    return WSP_OK;
+} // __wsp_io_write__uring }}}
+
+/*
+ * Vectored reader function for WSP_URING mappings, every range is queued
+ * before the ring is submitted once.
+ *
+ * See wsp_readv_f for documentation on arguments.
+ */
+// __wsp_io_readv__uring {{{
+static int __wsp_io_readv__uring(
+    wsp_t *w,
+    wsp_io_vec_t *vecs,
+    int count,
+    wsp_error_t *e
+)
+{
+    wsp_io_uring_inst_t *self;
+    WSP_IO_CHECK(w, WSP_URING, wsp_io_uring_inst_t, self, e);
+
+    int i;
+
+    for (i = 0; i < count; i++) {
+        wsp_uring_op_t op = {
+            .fn = self->fn,
+            .write = 0,
+            .owner = self,
+            .offset = vecs[i].offset,
+            .size = vecs[i].size,
+            .buf = vecs[i].buf
+        };
+
+        if (__wsp_uring_queue(&op, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    if (wsp_uring_submit(e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    return __wsp_uring_error(self, e);
+} // __wsp_io_readv__uring }}}
+
+/*
+ * Vectored writer function for WSP_URING mappings.
+ *
+ * See wsp_writev_f for documentation on arguments.
+ */
+// __wsp_io_writev__uring {{{
+static int __wsp_io_writev__uring(
+    wsp_t *w,
+    wsp_io_vec_t *vecs,
+    int count,
+    wsp_error_t *e
+)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (__wsp_io_write__uring(w, vecs[i].offset, vecs[i].size, vecs[i].buf, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+
+    return WSP_OK;
+} // __wsp_io_writev__uring }}}
+
+/*
+ * Create function for WSP_URING mappings, creating is rare enough to not
+ * bother the ring.
+ */
+// __wsp_io_create__uring {{{
+static wsp_return_t __wsp_io_create__uring(
+    const char *path,
+    size_t size,
+    wsp_archive_t *created_archives,
+    size_t count,
+    wsp_metadata_t *metadata,
+    wsp_error_t *e
+)
+{
+    return wsp_io_pread.create(path, size, created_archives, count, metadata, e);
+} // __wsp_io_create__uring }}}
+
+/*
+ * Advise function for WSP_URING mappings.
+ *
+ * See wsp_advise_f for documentation on arguments.
+ */
+// __wsp_io_advise__uring {{{
+static int __wsp_io_advise__uring(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    wsp_advice_t advice,
+    wsp_error_t *e
+)
+{
+    wsp_io_uring_inst_t *self;
+    WSP_IO_CHECK(w, WSP_URING, wsp_io_uring_inst_t, self, e);
+
+    return __wsp_fadvise(self->fn, offset, size, advice, e);
+} // __wsp_io_advise__uring }}}
+
+/*
+ * Sync function for WSP_URING mappings, queued writes are submitted first.
+ *
+ * See wsp_sync_f for documentation on arguments.
+ */
+// __wsp_io_sync__uring {{{
+static int __wsp_io_sync__uring(
+    wsp_t *w,
+    int wait,
+    wsp_error_t *e
+)
+{
+    wsp_io_uring_inst_t *self;
+    WSP_IO_CHECK(w, WSP_URING, wsp_io_uring_inst_t, self, e);
+
+    // queued writes have not reached the kernel yet.
+    if (wsp_uring_submit(e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    if (__wsp_uring_error(self, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    if (wait && fsync(self->fn) == -1) {
+        e->type = WSP_ERROR_FSYNC;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    return WSP_OK;
+} // __wsp_io_sync__uring }}}
+
+/*
+ * Lock function for WSP_URING mappings, queued writes are submitted
+ * before unlocking.
+ *
+ * See wsp_lock_f for documentation on arguments.
+ */
+// __wsp_io_lock__uring {{{
+static int __wsp_io_lock__uring(
+    wsp_t *w,
+    int lock,
+    wsp_error_t *e
+)
+{
+    wsp_io_uring_inst_t *self;
+    WSP_IO_CHECK(w, WSP_URING, wsp_io_uring_inst_t, self, e);
+
+    // queued writes have to complete while the file is still locked.
+    if (!lock && wsp_uring_submit(e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    if (__wsp_flock(self->fn, lock, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    return __wsp_uring_error(self, e);
+} // __wsp_io_lock__uring }}}
+
+wsp_io wsp_io_uring = {
+    .open = __wsp_io_open__uring,
+    .open_fd = __wsp_io_open_fd__uring,
+    .close = __wsp_io_close__uring,
+    .read = __wsp_io_read__uring,
+    .read_into = __wsp_io_read_into__uring,
+    .write = __wsp_io_write__uring,
+    .create = __wsp_io_create__uring,
+    .readv = __wsp_io_readv__uring,
+    .writev = __wsp_io_writev__uring,
+    .advise = __wsp_io_advise__uring,
+    .sync = __wsp_io_sync__uring,
+    .lock = __wsp_io_lock__uring
+};
+
+#else /* WSP_WITH_URING */
+
+wsp_uring_t wsp_uring_ctx = { .fd = -1 };
+
+// wsp_uring_init {{{
+wsp_return_t wsp_uring_init(
+    unsigned entries,
+    wsp_error_t *e
+)
+{
+    e->type = WSP_ERROR_IO;
+    return WSP_ERROR;
+} // wsp_uring_init }}}
+
+// wsp_uring_submit {{{
+wsp_return_t wsp_uring_submit(
+    wsp_error_t *e
+)
+{
+    return WSP_OK;
+} // wsp_uring_submit }}}
+
+// wsp_uring_free {{{
+wsp_return_t wsp_uring_free(
+    wsp_error_t *e
+)
+{
+    return WSP_OK;
+} // wsp_uring_free }}}
+
+#endif /* WSP_WITH_URING */
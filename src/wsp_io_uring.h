@@ -0,0 +1,135 @@
+// vim: foldmethod=marker
+#ifndef _WSP_IO_URING_H_
+#define _WSP_IO_URING_H_
+
+#include "wsp.h"
+
+/**
+ * io_uring based I/O, only available when built with WITH_URING.
+ *
+ * Every WSP_URING handle in the process shares a single ring. Writes are
+ * queued on the ring and return immediately, reads drain the queue and wait
+ * for their result. This means that the writes of many databases are
+ * submitted together with a single io_uring_enter, either when a read or
+ * close needs the queue to be empty, when the ring is full, or when
+ * wsp_uring_submit is called.
+ *
+ * Reads are not batched, their result is needed right away. An update of a
+ * database with more than one archive reads back every archive it rolls up
+ * into, which costs one io_uring_enter per lower archive. Open such
+ * databases with WSP_LAZY to batch their updates as well, the rollups are
+ * then read when wsp_flush_rollups or wsp_close runs.
+ *
+ * A queued write which fails is reported by the next operation on the handle
+ * which queued it, or by wsp_close, no matter which call submitted it.
+ *
+ * The ring is not thread safe, all WSP_URING handles must be used from the
+ * same thread.
+ *
+ * Example:
+ *
+ *   wsp_uring_init(1024, &e);
+ *
+ *   for (...) {
+ *       wsp_open(&w[i], path[i], WSP_URING, WSP_READ | WSP_WRITE, &e);
+ *       wsp_update(&w[i], &point, &e);
+ *   }
+ *
+ *   wsp_uring_submit(&e);
+ */
+extern wsp_io wsp_io_uring;
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/**
+ * Number of submission entries used when the ring is set up implicitly.
+ */
+#define WSP_URING_ENTRIES 256
+
+typedef struct {
+    int fn;
+    void *scratch;
+    size_t scratch_size;
+    // first error of a queued write, not reported yet.
+    wsp_error_t error;
+} wsp_io_uring_inst_t;
+
+typedef struct wsp_uring_op_t wsp_uring_op_t;
+
+struct wsp_uring_op_t {
+    int fn;
+    int write;
+    // handle which queued a write, errors of the write are kept on it.
+    wsp_io_uring_inst_t *owner;
+    long offset;
+    size_t size;
+    // data of a queued write, or the destination of a read.
+    void *buf;
+};
+
+typedef struct {
+    int fd;
+    unsigned entries;
+    /* submission queue */
+    void *sq_ptr;
+    size_t sq_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    /* completion queue */
+    void *cq_ptr;
+    size_t cq_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    // operations queued since the last submit, indexed like sqes.
+    wsp_uring_op_t *ops;
+    unsigned queued;
+    /* statistics */
+    // number of io_uring_enter calls.
+    uint64_t submits;
+    // number of operations submitted.
+    uint64_t submitted;
+    // writes that replaced an identical queued write.
+    uint64_t merged;
+} wsp_uring_t;
+
+/**
+ * The ring shared by all WSP_URING handles.
+ */
+extern wsp_uring_t wsp_uring_ctx;
+
+/**
+ * Set up the shared ring with the given number of entries.
+ *
+ * This is optional, the first WSP_URING open sets the ring up with
+ * WSP_URING_ENTRIES entries.
+ */
+wsp_return_t wsp_uring_init(
+    unsigned entries,
+    wsp_error_t *e
+);
+
+/**
+ * Submit every queued operation with a single io_uring_enter and wait for
+ * all of them to complete.
+ *
+ * Errors of queued writes are kept on the handle which queued them, this
+ * only fails if submitting does or if a read fails.
+ */
+wsp_return_t wsp_uring_submit(
+    wsp_error_t *e
+);
+
+/**
+ * Submit everything queued and tear down the shared ring.
+ */
+wsp_return_t wsp_uring_free(
+    wsp_error_t *e
+);
+
+#endif /* _WSP_IO_URING_H_ */
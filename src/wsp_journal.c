@@ -0,0 +1,862 @@
+// vim: foldmethod=marker
+#define _GNU_SOURCE
+
+#include "wsp_journal.h"
+#include "wsp_private.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "wsp_debug.h"
+#include "wsp_buffer.h"
+
+/**
+ * A record located in a buffer of encoded records.
+ */
+typedef struct {
+    wsp_journal_record_t header;
+    const char *path;
+    wsp_point_b *points;
+    // position in the buffer, keeps sorting stable.
+    size_t seq;
+    // the record could not be applied yet and stays in the journal.
+    int keep;
+} wsp_journal_view_t;
+
+/**
+ * Header of a single record in a journal, followed by path_length bytes of
+ * path and count wsp_point_b. Every field is stored big-endian.
+ */
+typedef struct {
+    char magic[sizeof(uint32_t)];
+    char checksum[sizeof(uint32_t)];
+    char now[sizeof(uint32_t)];
+    char path_length[sizeof(uint32_t)];
+    char count[sizeof(uint32_t)];
+} wsp_journal_record_b;
+
+// __wsp_journal_get32 {{{
+static uint32_t __wsp_journal_get32(
+    const char *b
+)
+{
+    const unsigned char *u = (const unsigned char *)b;
+
+    return (uint32_t)u[0] << 24 | (uint32_t)u[1] << 16 |
+        (uint32_t)u[2] << 8 | (uint32_t)u[3];
+} // __wsp_journal_get32 }}}
+
+// __wsp_journal_put32 {{{
+static void __wsp_journal_put32(
+    char *b,
+    uint32_t v
+)
+{
+    b[0] = (char)(v >> 24);
+    b[1] = (char)(v >> 16);
+    b[2] = (char)(v >> 8);
+    b[3] = (char)v;
+} // __wsp_journal_put32 }}}
+
+// __wsp_parse_journal_record {{{
+static void __wsp_parse_journal_record(
+    const wsp_journal_record_b *buf,
+    wsp_journal_record_t *r
+)
+{
+    r->magic = __wsp_journal_get32(buf->magic);
+    r->checksum = __wsp_journal_get32(buf->checksum);
+    r->now = __wsp_journal_get32(buf->now);
+    r->path_length = __wsp_journal_get32(buf->path_length);
+    r->count = __wsp_journal_get32(buf->count);
+} // __wsp_parse_journal_record }}}
+
+// __wsp_dump_journal_record {{{
+static void __wsp_dump_journal_record(
+    const wsp_journal_record_t *r,
+    wsp_journal_record_b *buf
+)
+{
+    __wsp_journal_put32(buf->magic, r->magic);
+    __wsp_journal_put32(buf->checksum, r->checksum);
+    __wsp_journal_put32(buf->now, r->now);
+    __wsp_journal_put32(buf->path_length, r->path_length);
+    __wsp_journal_put32(buf->count, r->count);
+} // __wsp_dump_journal_record }}}
+
+// __wsp_journal_clock {{{
+static uint64_t __wsp_journal_clock(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
+        return 0;
+    }
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+} // __wsp_journal_clock }}}
+
+// __wsp_journal_path {{{
+/*
+ * Build the path of the journal in dir, with suffix appended to its name.
+ */
+static wsp_return_t __wsp_journal_path(
+    const char *dir,
+    const char *suffix,
+    char *path,
+    wsp_error_t *e
+)
+{
+    int r = snprintf(path, WSP_JOURNAL_PATH_MAX, "%s/%s%s", dir, WSP_JOURNAL_NAME, suffix);
+
+    if (r < 0 || r >= WSP_JOURNAL_PATH_MAX) {
+        e->type = WSP_ERROR_JOURNAL;
+        return WSP_ERROR;
+    }
+
+    return WSP_OK;
+} // __wsp_journal_path }}}
+
+// __wsp_journal_reserve {{{
+static wsp_return_t __wsp_journal_reserve(
+    wsp_journal_t *j,
+    size_t size,
+    wsp_error_t *e
+)
+{
+    if (j->length + size <= j->capacity) {
+        return WSP_OK;
+    }
+
+    size_t capacity = j->capacity == 0 ? 4096 : j->capacity;
+
+    while (capacity < j->length + size) {
+        capacity *= 2;
+    }
+
+    char *tmp = realloc(j->buf, capacity);
+
+    if (tmp == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        return WSP_ERROR;
+    }
+
+    j->buf = tmp;
+    j->capacity = capacity;
+
+    return WSP_OK;
+} // __wsp_journal_reserve }}}
+
+// __wsp_journal_scan {{{
+/*
+ * Locate all valid records in a buffer, stops at the first torn or corrupt
+ * record.
+ *
+ * views: Where to store located records, can be NULL to only count them.
+ * count: Where to store the number of located records.
+ *
+ * Returns the number of bytes occupied by valid records.
+ */
+static size_t __wsp_journal_scan(
+    const char *buf,
+    size_t length,
+    wsp_journal_view_t *views,
+    size_t *count
+)
+{
+    size_t offset = 0;
+    size_t n = 0;
+
+    while (offset + sizeof(wsp_journal_record_b) <= length) {
+        wsp_journal_record_t header;
+        __wsp_parse_journal_record((const wsp_journal_record_b *)(buf + offset), &header);
+
+        if (header.magic != WSP_JOURNAL_MAGIC) {
+            break;
+        }
+
+        if (header.path_length == 0 || header.path_length >= WSP_JOURNAL_PATH_MAX) {
+            break;
+        }
+
+        size_t size = sizeof(wsp_journal_record_b) + header.path_length +
+            sizeof(wsp_point_b) * (size_t)header.count;
+
+        if (offset + size > length) {
+            break;
+        }
+
+        size_t skip = sizeof(header.magic) + sizeof(header.checksum);
+        uint32_t checksum = __wsp_fnv1a(buf + offset + skip, size - skip);
+
+        if (checksum != header.checksum) {
+            break;
+        }
+
+        if (views != NULL) {
+            wsp_journal_view_t *view = views + n;
+            view->header = header;
+            view->path = buf + offset + sizeof(wsp_journal_record_b);
+            view->points = (wsp_point_b *)(view->path + header.path_length);
+            view->seq = n;
+            view->keep = 0;
+        }
+
+        n++;
+        offset += size;
+    }
+
+    *count = n;
+    return offset;
+} // __wsp_journal_scan }}}
+
+// __wsp_journal_view_cmp {{{
+static int __wsp_journal_view_cmp(const void *a, const void *b)
+{
+    const wsp_journal_view_t *l = (const wsp_journal_view_t *)a;
+    const wsp_journal_view_t *r = (const wsp_journal_view_t *)b;
+
+    uint32_t length = l->header.path_length < r->header.path_length ?
+        l->header.path_length : r->header.path_length;
+
+    int c = memcmp(l->path, r->path, length);
+
+    if (c != 0) {
+        return c;
+    }
+
+    if (l->header.path_length != r->header.path_length) {
+        return l->header.path_length < r->header.path_length ? -1 : 1;
+    }
+
+    if (l->seq != r->seq) {
+        return l->seq < r->seq ? -1 : 1;
+    }
+
+    return 0;
+} // __wsp_journal_view_cmp }}}
+
+// __wsp_journal_seq_cmp {{{
+static int __wsp_journal_seq_cmp(const void *a, const void *b)
+{
+    const wsp_journal_view_t *l = (const wsp_journal_view_t *)a;
+    const wsp_journal_view_t *r = (const wsp_journal_view_t *)b;
+
+    if (l->seq != r->seq) {
+        return l->seq < r->seq ? -1 : 1;
+    }
+
+    return 0;
+} // __wsp_journal_seq_cmp }}}
+
+// __wsp_journal_permanent {{{
+/*
+ * Check if an error means that a record can never be applied, as opposed to
+ * one which might go away when the record is retried.
+ */
+static int __wsp_journal_permanent(wsp_error_t *e)
+{
+    switch (e->type) {
+    // the record itself is invalid for the database.
+    case WSP_ERROR_FUTURE_TIMESTAMP:
+    case WSP_ERROR_RETENTION:
+    case WSP_ERROR_TIME_INTERVAL:
+    case WSP_ERROR_POINT_OOB:
+    // the database is not a valid whisper database.
+    case WSP_ERROR_ARCHIVE:
+    case WSP_ERROR_ARCHIVE_MISALIGNED:
+    case WSP_ERROR_UNKNOWN_AGGREGATION:
+        return 1;
+    // the database has been removed.
+    case WSP_ERROR_OPEN:
+    case WSP_ERROR_FOPEN:
+        return e->syserr == ENOENT || e->syserr == ENOTDIR;
+    default:
+        return 0;
+    }
+} // __wsp_journal_permanent }}}
+
+// __wsp_journal_apply_group {{{
+/*
+ * Apply all records for a single database, they must all have the same path.
+ *
+ * Records which fail for a reason that might go away are marked to be kept,
+ * the others are counted in j->failed and dropped.
+ */
+static void __wsp_journal_apply_group(
+    wsp_journal_t *j,
+    wsp_journal_view_t *views,
+    size_t count,
+    wsp_point_input_t *inputs
+)
+{
+    char path[WSP_JOURNAL_PATH_MAX * 2];
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    snprintf(
+        path, sizeof(path), "%s/%.*s",
+        j->dir, (int)views[0].header.path_length, views[0].path
+    );
+
+    wsp_t w;
+    WSP_INIT(&w);
+
+    size_t i;
+    uint32_t k;
+
+    if (wsp_open(&w, path, j->mapping, WSP_READ | WSP_WRITE, &e) == WSP_ERROR) {
+        if (DEBUG) {
+            DEBUG_PRINTF("%s: %s", path, wsp_strerror(&e));
+        }
+
+        j->last_error = e;
+
+        if (__wsp_journal_permanent(&e)) {
+            j->failed += count;
+            return;
+        }
+
+        for (i = 0; i < count; i++) {
+            views[i].keep = 1;
+        }
+
+        j->retried += count;
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        wsp_journal_view_t *view = views + i;
+
+        for (k = 0; k < view->header.count; k++) {
+            wsp_point_t p;
+            __wsp_parse_point(view->points + k, &p);
+            inputs[k].timestamp = p.timestamp;
+            inputs[k].value = p.value;
+        }
+
+        if (wsp_update_many_now(&w, inputs, view->header.count, view->header.now, &e) == WSP_ERROR) {
+            j->last_error = e;
+
+            if (__wsp_journal_permanent(&e)) {
+                j->failed++;
+            }
+            else {
+                view->keep = 1;
+                j->retried++;
+            }
+
+            WSP_ERROR_INIT(&e);
+            continue;
+        }
+
+        j->applied++;
+    }
+
+    if (wsp_close(&w, &e) == WSP_ERROR) {
+        j->last_error = e;
+    }
+} // __wsp_journal_apply_group }}}
+
+// __wsp_journal_apply_buffer {{{
+/*
+ * Apply all valid records in a buffer to their databases, then sync them.
+ *
+ * Records which should be retried are moved to the start of the buffer in
+ * their original order.
+ *
+ * kept: Where to store the number of bytes occupied by the kept records.
+ */
+static wsp_return_t __wsp_journal_apply_buffer(
+    wsp_journal_t *j,
+    char *buf,
+    size_t length,
+    size_t *kept,
+    wsp_error_t *e
+)
+{
+    size_t count = 0;
+
+    *kept = 0;
+
+    __wsp_journal_scan(buf, length, NULL, &count);
+
+    if (count == 0) {
+        return WSP_OK;
+    }
+
+    wsp_journal_view_t *views = malloc(sizeof(wsp_journal_view_t) * count);
+
+    if (views == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        return WSP_ERROR;
+    }
+
+    __wsp_journal_scan(buf, length, views, &count);
+
+    size_t max_points = 1;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        if (views[i].header.count > max_points) {
+            max_points = views[i].header.count;
+        }
+    }
+
+    wsp_point_input_t *inputs = malloc(sizeof(wsp_point_input_t) * max_points);
+
+    if (inputs == NULL) {
+        free(views);
+        e->type = WSP_ERROR_MALLOC;
+        return WSP_ERROR;
+    }
+
+    qsort(views, count, sizeof(wsp_journal_view_t), __wsp_journal_view_cmp);
+
+    i = 0;
+
+    while (i < count) {
+        size_t n = i + 1;
+
+        while (
+            n < count &&
+            views[n].header.path_length == views[i].header.path_length &&
+            memcmp(views[n].path, views[i].path, views[i].header.path_length) == 0
+        ) {
+            n++;
+        }
+
+        __wsp_journal_apply_group(j, views + i, n - i, inputs);
+        i = n;
+    }
+
+    free(inputs);
+
+    // a single sync makes every applied database durable.
+    if (syncfs(j->fd) == -1) {
+        free(views);
+        e->type = WSP_ERROR_FSYNC;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    qsort(views, count, sizeof(wsp_journal_view_t), __wsp_journal_seq_cmp);
+
+    for (i = 0; i < count; i++) {
+        if (!views[i].keep) {
+            continue;
+        }
+
+        const char *start = views[i].path - sizeof(wsp_journal_record_b);
+        size_t size = sizeof(wsp_journal_record_b) + views[i].header.path_length +
+            sizeof(wsp_point_b) * (size_t)views[i].header.count;
+
+        // records are in buffer order, so this never overwrites a kept one.
+        memmove(buf + *kept, start, size);
+        *kept += size;
+    }
+
+    free(views);
+    return WSP_OK;
+} // __wsp_journal_apply_buffer }}}
+
+// __wsp_journal_rewrite {{{
+/*
+ * Replace the journal with one that only holds the first kept bytes of the
+ * buffer, a crash before the rename leaves the old journal to be replayed.
+ */
+static wsp_return_t __wsp_journal_rewrite(
+    wsp_journal_t *j,
+    size_t kept,
+    wsp_error_t *e
+)
+{
+    char path[WSP_JOURNAL_PATH_MAX];
+    char tmp[WSP_JOURNAL_PATH_MAX];
+
+    if (__wsp_journal_path(j->dir, "", path, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    if (__wsp_journal_path(j->dir, ".tmp", tmp, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    int mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, mode);
+
+    if (fd == -1) {
+        e->type = WSP_ERROR_OPEN;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    size_t offset = 0;
+
+    while (offset < kept) {
+        ssize_t r = write(fd, j->buf + offset, kept - offset);
+
+        if (r == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (r <= 0) {
+            e->type = WSP_ERROR_IO;
+            e->syserr = errno;
+            goto error;
+        }
+
+        offset += r;
+    }
+
+    if (fdatasync(fd) == -1) {
+        e->type = WSP_ERROR_FSYNC;
+        e->syserr = errno;
+        goto error;
+    }
+
+    if (rename(tmp, path) == -1) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        goto error;
+    }
+
+    close(j->fd);
+    j->fd = fd;
+
+    return WSP_OK;
+
+error:
+    close(fd);
+    unlink(tmp);
+    return WSP_ERROR;
+} // __wsp_journal_rewrite }}}
+
+// __wsp_journal_truncate {{{
+/*
+ * Drop all committed records except the first kept bytes, both from the
+ * journal and from memory.
+ */
+static wsp_return_t __wsp_journal_truncate(
+    wsp_journal_t *j,
+    size_t kept,
+    wsp_error_t *e
+)
+{
+    if (kept > 0) {
+        if (__wsp_journal_rewrite(j, kept, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+    else if (ftruncate(j->fd, 0) == -1) {
+        e->type = WSP_ERROR_FTRUNCATE;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    memmove(j->buf + kept, j->buf + j->committed, j->length - j->committed);
+    j->length = kept + j->length - j->committed;
+    j->committed = kept;
+
+    return WSP_OK;
+} // __wsp_journal_truncate }}}
+
+// wsp_journal_open {{{
+wsp_return_t wsp_journal_open(
+    wsp_journal_t *j,
+    const char *dir,
+    wsp_mapping_t mapping,
+    uint32_t window,
+    wsp_error_t *e
+)
+{
+    if (j->fd != -1) {
+        e->type = WSP_ERROR_ALREADY_OPEN;
+        return WSP_ERROR;
+    }
+
+    char path[WSP_JOURNAL_PATH_MAX];
+
+    // the replacement journal has the longest path, dir fits if it does.
+    if (__wsp_journal_path(dir, ".tmp", path, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    if (__wsp_journal_path(dir, "", path, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    int mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, mode);
+
+    if (fd == -1) {
+        e->type = WSP_ERROR_OPEN;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        e->type = WSP_ERROR_IO;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    strcpy(j->dir, dir);
+    j->fd = fd;
+    j->mapping = mapping;
+    j->window = window;
+    j->last_commit = __wsp_journal_clock();
+
+    if (st.st_size == 0) {
+        return WSP_OK;
+    }
+
+    // replay whatever a previous writer left behind.
+    if (__wsp_journal_reserve(j, st.st_size, e) == WSP_ERROR) {
+        goto error;
+    }
+
+    size_t length = 0;
+
+    while (length < (size_t)st.st_size) {
+        ssize_t r = pread(fd, j->buf + length, st.st_size - length, length);
+
+        if (r == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (r <= 0) {
+            e->type = WSP_ERROR_IO;
+            e->syserr = errno;
+            goto error;
+        }
+
+        length += r;
+    }
+
+    size_t count;
+    size_t valid = __wsp_journal_scan(j->buf, length, NULL, &count);
+
+    if (DEBUG) {
+        DEBUG_PRINTF("replaying %zu records (%zu/%zu bytes)", count, valid, length);
+    }
+
+    j->length = valid;
+    j->committed = valid;
+
+    size_t kept;
+
+    if (__wsp_journal_apply_buffer(j, j->buf, j->committed, &kept, e) == WSP_ERROR) {
+        goto error;
+    }
+
+    if (__wsp_journal_truncate(j, kept, e) == WSP_ERROR) {
+        goto error;
+    }
+
+    return WSP_OK;
+
+error:
+    close(fd);
+    free(j->buf);
+    WSP_JOURNAL_INIT(j);
+    return WSP_ERROR;
+} // wsp_journal_open }}}
+
+// wsp_journal_append {{{
+wsp_return_t wsp_journal_append(
+    wsp_journal_t *j,
+    const char *path,
+    wsp_point_input_t *points,
+    size_t length,
+    wsp_error_t *e
+)
+{
+    wsp_time_t now = wsp_time_now();
+    return wsp_journal_append_now(j, path, points, length, now, e);
+} // wsp_journal_append }}}
+
+// wsp_journal_append_now {{{
+wsp_return_t wsp_journal_append_now(
+    wsp_journal_t *j,
+    const char *path,
+    wsp_point_input_t *points,
+    size_t length,
+    wsp_time_t now,
+    wsp_error_t *e
+)
+{
+    if (j->fd == -1) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    size_t path_length = strlen(path);
+
+    if (path_length == 0 || path_length >= WSP_JOURNAL_PATH_MAX || length > UINT32_MAX) {
+        e->type = WSP_ERROR_JOURNAL;
+        return WSP_ERROR;
+    }
+
+    size_t size = sizeof(wsp_journal_record_b) + path_length +
+        sizeof(wsp_point_b) * length;
+
+    if (__wsp_journal_reserve(j, size, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    char *buf = j->buf + j->length;
+
+    memcpy(buf + sizeof(wsp_journal_record_b), path, path_length);
+
+    wsp_point_b *points_b = (wsp_point_b *)(buf + sizeof(wsp_journal_record_b) + path_length);
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        wsp_point_t p = {
+            .timestamp = points[i].timestamp,
+            .value = points[i].value
+        };
+
+        __wsp_dump_point(&p, points_b + i);
+    }
+
+    wsp_journal_record_t header = {
+        .magic = WSP_JOURNAL_MAGIC,
+        .checksum = 0,
+        .now = now,
+        .path_length = path_length,
+        .count = length
+    };
+
+    size_t skip = sizeof(header.magic) + sizeof(header.checksum);
+
+    __wsp_dump_journal_record(&header, (wsp_journal_record_b *)buf);
+    header.checksum = __wsp_fnv1a(buf + skip, size - skip);
+    __wsp_dump_journal_record(&header, (wsp_journal_record_b *)buf);
+
+    j->length += size;
+
+    if (
+        j->window == 0 ||
+        j->length - j->committed >= WSP_JOURNAL_COMMIT_SIZE ||
+        __wsp_journal_clock() - j->last_commit >= j->window
+    ) {
+        return wsp_journal_commit(j, e);
+    }
+
+    return WSP_OK;
+} // wsp_journal_append_now }}}
+
+// wsp_journal_commit {{{
+wsp_return_t wsp_journal_commit(
+    wsp_journal_t *j,
+    wsp_error_t *e
+)
+{
+    if (j->fd == -1) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    if (j->torn) {
+        e->type = WSP_ERROR_JOURNAL;
+        return WSP_ERROR;
+    }
+
+    j->last_commit = __wsp_journal_clock();
+
+    if (j->committed == j->length) {
+        return WSP_OK;
+    }
+
+    size_t offset = j->committed;
+
+    while (offset < j->length) {
+        ssize_t r = write(j->fd, j->buf + offset, j->length - offset);
+
+        if (r == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (r <= 0) {
+            e->type = WSP_ERROR_IO;
+            e->syserr = errno;
+            goto error;
+        }
+
+        offset += r;
+    }
+
+    if (fdatasync(j->fd) == -1) {
+        e->type = WSP_ERROR_FSYNC;
+        e->syserr = errno;
+        goto error;
+    }
+
+    j->committed = j->length;
+    j->commits++;
+
+    return WSP_OK;
+
+error:
+    // the journal ends with the committed records, anything after them would
+    // stop the replay of records committed later on.
+    if (ftruncate(j->fd, j->committed) == -1) {
+        j->torn = 1;
+    }
+
+    return WSP_ERROR;
+} // wsp_journal_commit }}}
+
+// wsp_journal_apply {{{
+wsp_return_t wsp_journal_apply(
+    wsp_journal_t *j,
+    wsp_error_t *e
+)
+{
+    if (wsp_journal_commit(j, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    if (j->committed == 0) {
+        return WSP_OK;
+    }
+
+    size_t kept;
+
+    if (__wsp_journal_apply_buffer(j, j->buf, j->committed, &kept, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    return __wsp_journal_truncate(j, kept, e);
+} // wsp_journal_apply }}}
+
+// wsp_journal_close {{{
+wsp_return_t wsp_journal_close(
+    wsp_journal_t *j,
+    wsp_error_t *e
+)
+{
+    if (j->fd == -1) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    // close regardless, whatever is committed is replayed on the next open.
+    wsp_return_t result = wsp_journal_apply(j, e);
+
+    close(j->fd);
+    free(j->buf);
+    WSP_JOURNAL_INIT(j);
+
+    return result;
+} // wsp_journal_close }}}
@@ -0,0 +1,210 @@
+// vim: foldmethod=marker
+/**
+ * Write-ahead journal for whisper databases.
+ *
+ * A journal lives in a directory and records batches of point updates for the
+ * whisper databases below it. Appended records are buffered in memory and
+ * written to the journal with a single fsync once per group commit window,
+ * which makes them durable without syncing every database they touch. The
+ * window is only checked when appending, callers which might stop appending
+ * for a while have to call wsp_journal_commit on a timer.
+ *
+ * Committed records are applied to the databases by wsp_journal_apply, after
+ * which the file system is synced once and the journal is truncated. Records
+ * which could not be applied because of an error that might go away, like a
+ * failing write or a database which cannot be opened right now, stay in the
+ * journal and are retried by the next apply. Records left behind by a crash
+ * are replayed when the journal is opened again.
+ *
+ * Example:
+ *
+ *   wsp_journal_t j;
+ *   WSP_JOURNAL_INIT(&j);
+ *
+ *   if (wsp_journal_open(&j, "/data/whisper", WSP_MMAP, 100, &e) == WSP_ERROR) {
+ *       ...
+ *   }
+ *
+ *   wsp_journal_append(&j, "a/b/metric.wsp", points, length, &e);
+ *   ...
+ *   wsp_journal_apply(&j, &e);
+ *   wsp_journal_close(&j, &e);
+ */
+#ifndef _WSP_JOURNAL_H_
+#define _WSP_JOURNAL_H_
+
+#include "wsp.h"
+
+/**
+ * Name of the journal file inside of the journaled directory.
+ */
+#define WSP_JOURNAL_NAME "whisper.journal"
+
+/**
+ * Magic number at the start of every record.
+ */
+#define WSP_JOURNAL_MAGIC 0x57535031
+
+/**
+ * Longest supported path of a journaled database, including the directory.
+ */
+#define WSP_JOURNAL_PATH_MAX 4096
+
+/**
+ * Commit when this many bytes are pending, regardless of the window.
+ */
+#define WSP_JOURNAL_COMMIT_SIZE (1024 * 1024)
+
+struct wsp_journal_record_t {
+    uint32_t magic;
+    uint32_t checksum;
+    wsp_time_t now;
+    uint32_t path_length;
+    uint32_t count;
+};
+
+typedef struct wsp_journal_record_t wsp_journal_record_t;
+
+typedef struct {
+    // directory being journaled.
+    char dir[WSP_JOURNAL_PATH_MAX];
+    // descriptor of the journal file.
+    int fd;
+    // mapping used when applying records to databases.
+    wsp_mapping_t mapping;
+    // group commit window in milliseconds.
+    uint32_t window;
+    // monotonic time of the last commit in milliseconds.
+    uint64_t last_commit;
+    // encoded records that have not been applied yet.
+    char *buf;
+    size_t length;
+    size_t capacity;
+    // bytes at the start of buf which are durable in the journal.
+    size_t committed;
+    // set if a failed commit could not be cut off the end of the journal.
+    int torn;
+    /* statistics */
+    // number of fsyncs of the journal.
+    uint64_t commits;
+    // number of records applied to databases.
+    uint64_t applied;
+    // number of records that can never be applied and were dropped.
+    uint64_t failed;
+    // number of times a record could not be applied and was kept for retry.
+    uint64_t retried;
+    // the error of the last record that could not be applied.
+    wsp_error_t last_error;
+} wsp_journal_t;
+
+#define WSP_JOURNAL_INIT(j) do {\
+    (j)->dir[0] = '\0';\
+    (j)->fd = -1;\
+    (j)->mapping = WSP_MAPPING_NONE;\
+    (j)->window = 0;\
+    (j)->last_commit = 0;\
+    (j)->buf = NULL;\
+    (j)->length = 0;\
+    (j)->capacity = 0;\
+    (j)->committed = 0;\
+    (j)->torn = 0;\
+    (j)->commits = 0;\
+    (j)->applied = 0;\
+    (j)->failed = 0;\
+    (j)->retried = 0;\
+    WSP_ERROR_INIT(&(j)->last_error);\
+} while(0)
+
+/**
+ * Open the journal of a directory, creating it if necessary.
+ *
+ * Any records left in an existing journal are replayed before this returns.
+ *
+ * j: Journal, should have been initialized using WSP_JOURNAL_INIT.
+ * dir: Directory to journal, record paths are relative to it.
+ * mapping: The mapping to use when applying records.
+ * window: Group commit window in milliseconds, 0 commits on every append.
+ * e: Error object.
+ */
+wsp_return_t wsp_journal_open(
+    wsp_journal_t *j,
+    const char *dir,
+    wsp_mapping_t mapping,
+    uint32_t window,
+    wsp_error_t *e
+);
+
+/**
+ * Same as wsp_journal_append_now, but fetches the current timestamp from
+ * system.
+ */
+wsp_return_t wsp_journal_append(
+    wsp_journal_t *j,
+    const char *path,
+    wsp_point_input_t *points,
+    size_t length,
+    wsp_error_t *e
+);
+
+/**
+ * Append a batch of updates for a single database to the journal.
+ *
+ * The record is committed together with everything else that is pending by
+ * the first append after the group commit window has passed, or once
+ * WSP_JOURNAL_COMMIT_SIZE bytes are pending. Nothing is committed in between
+ * appends, if no further append comes the record stays pending until
+ * wsp_journal_commit, wsp_journal_apply or wsp_journal_close is called.
+ *
+ * j: Journal.
+ * path: Path of the database relative to the journaled directory.
+ * points: Points to insert.
+ * length: Number of points.
+ * now: When 'now' is, used to select archives when the record is applied.
+ * e: Error object.
+ */
+wsp_return_t wsp_journal_append_now(
+    wsp_journal_t *j,
+    const char *path,
+    wsp_point_input_t *points,
+    size_t length,
+    wsp_time_t now,
+    wsp_error_t *e
+);
+
+/**
+ * Write all pending records to the journal and fsync it.
+ *
+ * If the write or the fsync fails, whatever made it to the journal is cut off
+ * again so that the records stay pending and a later commit can append them.
+ * If that is not possible either, the journal is left torn and every further
+ * commit fails with WSP_ERROR_JOURNAL until it has been reopened.
+ */
+wsp_return_t wsp_journal_commit(
+    wsp_journal_t *j,
+    wsp_error_t *e
+);
+
+/**
+ * Commit, then apply all committed records to their databases.
+ *
+ * Records for the same database are applied with a single open. Records that
+ * can never be applied, because they are invalid for their database or the
+ * database has been removed, are counted in j->failed and dropped. Records
+ * that failed for any other reason are counted in j->retried and stay in the
+ * journal. Once everything has been applied the file system is synced once
+ * and the journal is truncated down to the kept records.
+ */
+wsp_return_t wsp_journal_apply(
+    wsp_journal_t *j,
+    wsp_error_t *e
+);
+
+/**
+ * Apply all records and close the journal.
+ */
+wsp_return_t wsp_journal_close(
+    wsp_journal_t *j,
+    wsp_error_t *e
+);
+
+#endif /* _WSP_JOURNAL_H_ */
@@ -0,0 +1,575 @@
+// vim: foldmethod=marker
+#include "wsp_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "wsp_debug.h"
+
+#define WSP_POOL_DEQUE_SIZE 64
+
+// __wsp_pool_fail {{{
+static void __wsp_pool_fail(
+    wsp_pool_t *pool,
+    wsp_error_t *e
+)
+{
+    __atomic_fetch_add(&pool->failed, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->last_error = *e;
+    pthread_mutex_unlock(&pool->lock);
+} // __wsp_pool_fail }}}
+
+// __wsp_pool_push {{{
+/*
+ * Queue a task at the bottom of the deque of a worker and wake up sleeping
+ * workers.
+ */
+static wsp_return_t __wsp_pool_push(
+    wsp_pool_worker_t *worker,
+    wsp_pool_task_t *task,
+    wsp_error_t *e
+)
+{
+    wsp_pool_t *pool = worker->pool;
+
+    // counted before it can be taken, so pending never drops to 0 early.
+    __atomic_fetch_add(&pool->pending, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&pool->available, 1, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock(&worker->lock);
+
+    if (worker->bottom == worker->capacity) {
+        if (worker->top > 0) {
+            memmove(
+                worker->tasks, worker->tasks + worker->top,
+                sizeof(wsp_pool_task_t *) * (worker->bottom - worker->top)
+            );
+
+            worker->bottom -= worker->top;
+            worker->top = 0;
+        }
+        else {
+            size_t capacity = worker->capacity * 2;
+            wsp_pool_task_t **tasks = realloc(worker->tasks, sizeof(wsp_pool_task_t *) * capacity);
+
+            if (tasks == NULL) {
+                pthread_mutex_unlock(&worker->lock);
+                __atomic_fetch_sub(&pool->available, 1, __ATOMIC_SEQ_CST);
+                __atomic_fetch_sub(&pool->pending, 1, __ATOMIC_SEQ_CST);
+                e->type = WSP_ERROR_MALLOC;
+                return WSP_ERROR;
+            }
+
+            worker->tasks = tasks;
+            worker->capacity = capacity;
+        }
+    }
+
+    worker->tasks[worker->bottom++] = task;
+
+    pthread_mutex_unlock(&worker->lock);
+
+    /*
+     * A worker going to sleep counts itself as sleeping before it checks for
+     * available tasks, so either it sees this task or it is seen here.
+     */
+    if (__atomic_load_n(&pool->sleeping, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->work);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return WSP_OK;
+} // __wsp_pool_push }}}
+
+// __wsp_pool_take {{{
+/*
+ * Take the newest task of the worker itself, or steal the oldest task of
+ * another worker.
+ */
+static wsp_pool_task_t *__wsp_pool_take(
+    wsp_pool_worker_t *worker
+)
+{
+    wsp_pool_t *pool = worker->pool;
+    wsp_pool_task_t *task = NULL;
+
+    pthread_mutex_lock(&worker->lock);
+
+    if (worker->bottom > worker->top) {
+        task = worker->tasks[--worker->bottom];
+    }
+
+    pthread_mutex_unlock(&worker->lock);
+
+    size_t self = worker - pool->workers;
+    size_t i;
+
+    for (i = 1; task == NULL && i < pool->threads; i++) {
+        wsp_pool_worker_t *victim = pool->workers + (self + i) % pool->threads;
+
+        pthread_mutex_lock(&victim->lock);
+
+        if (victim->bottom > victim->top) {
+            task = victim->tasks[victim->top++];
+            __atomic_fetch_add(&pool->steals, 1, __ATOMIC_RELAXED);
+        }
+
+        pthread_mutex_unlock(&victim->lock);
+    }
+
+    if (task != NULL) {
+        __atomic_fetch_sub(&pool->available, 1, __ATOMIC_SEQ_CST);
+    }
+
+    return task;
+} // __wsp_pool_take }}}
+
+// __wsp_pool_task {{{
+static wsp_pool_task_t *__wsp_pool_task(
+    const char *dir,
+    const char *name,
+    wsp_error_t *e
+)
+{
+    size_t dir_length = strlen(dir);
+    size_t name_length = name != NULL ? strlen(name) : 0;
+
+    wsp_pool_task_t *task = malloc(sizeof(wsp_pool_task_t) + dir_length + name_length + 2);
+
+    if (task == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        return NULL;
+    }
+
+    memcpy(task->path, dir, dir_length);
+
+    if (name != NULL) {
+        task->path[dir_length] = '/';
+        memcpy(task->path + dir_length + 1, name, name_length + 1);
+    }
+    else {
+        task->path[dir_length] = '\0';
+    }
+
+    task->dir = 0;
+    task->size = 0;
+
+    return task;
+} // __wsp_pool_task }}}
+
+// __wsp_pool_match {{{
+static int __wsp_pool_match(
+    const char *name,
+    const char *suffix
+)
+{
+    if (suffix == NULL) {
+        return 1;
+    }
+
+    size_t name_length = strlen(name);
+    size_t suffix_length = strlen(suffix);
+
+    if (name_length < suffix_length) {
+        return 0;
+    }
+
+    return strcmp(name + name_length - suffix_length, suffix) == 0;
+} // __wsp_pool_match }}}
+
+// __wsp_pool_read_dir {{{
+/*
+ * Queue the matching files and the subdirectories of a directory.
+ */
+static wsp_return_t __wsp_pool_read_dir(
+    wsp_pool_worker_t *worker,
+    const char *path,
+    wsp_error_t *e
+)
+{
+    wsp_pool_t *pool = worker->pool;
+
+    DIR *dir = opendir(path);
+
+    if (dir == NULL) {
+        e->type = WSP_ERROR_OPEN;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    struct dirent *entry;
+    wsp_return_t result = WSP_OK;
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        wsp_pool_task_t *task = __wsp_pool_task(path, entry->d_name, e);
+
+        if (task == NULL) {
+            result = WSP_ERROR;
+            break;
+        }
+
+        struct stat st;
+
+        // entries removed since they were listed are left out.
+        if (lstat(task->path, &st) == -1) {
+            free(task);
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            task->dir = 1;
+        }
+        else if (S_ISREG(st.st_mode) && __wsp_pool_match(entry->d_name, pool->suffix)) {
+            task->size = st.st_size;
+            __atomic_fetch_add(&pool->files, 1, __ATOMIC_RELAXED);
+        }
+        else {
+            free(task);
+            continue;
+        }
+
+        if (__wsp_pool_push(worker, task, e) == WSP_ERROR) {
+            free(task);
+            result = WSP_ERROR;
+            break;
+        }
+    }
+
+    closedir(dir);
+
+    return result;
+} // __wsp_pool_read_dir }}}
+
+// __wsp_pool_run {{{
+static void __wsp_pool_run(
+    wsp_pool_worker_t *worker,
+    wsp_pool_task_t *task
+)
+{
+    wsp_pool_t *pool = worker->pool;
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    if (task->dir) {
+        if (__wsp_pool_read_dir(worker, task->path, &e) == WSP_ERROR) {
+            __wsp_pool_fail(pool, &e);
+        }
+    }
+    else {
+        if (DEBUG) {
+            DEBUG_PRINTF("run: %s", task->path);
+        }
+
+        if (pool->job(pool->ctx, task->path, &e) == WSP_ERROR) {
+            __wsp_pool_fail(pool, &e);
+        }
+
+        __atomic_fetch_add(&pool->bytes, task->size, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&pool->completed, 1, __ATOMIC_RELAXED);
+    }
+
+    free(task);
+
+    // the last task of a walk wakes up wsp_pool_walk.
+    if (__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST) == 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+} // __wsp_pool_run }}}
+
+// __wsp_pool_main {{{
+static void *__wsp_pool_main(
+    void *arg
+)
+{
+    wsp_pool_worker_t *worker = (wsp_pool_worker_t *)arg;
+    wsp_pool_t *pool = worker->pool;
+
+    while (1) {
+        wsp_pool_task_t *task = __wsp_pool_take(worker);
+
+        if (task != NULL) {
+            __wsp_pool_run(worker, task);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+
+        __atomic_fetch_add(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+
+        while (!pool->stop && __atomic_load_n(&pool->available, __ATOMIC_SEQ_CST) == 0) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+
+        __atomic_fetch_sub(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+
+        int stop = pool->stop;
+
+        pthread_mutex_unlock(&pool->lock);
+
+        if (stop) {
+            break;
+        }
+    }
+
+    return NULL;
+} // __wsp_pool_main }}}
+
+// __wsp_pool_stop {{{
+/*
+ * Stop and join the first count workers, then release the pool.
+ *
+ * Started workers steal from every deque of the pool, so no deque is
+ * released before all of them have been joined.
+ */
+static void __wsp_pool_stop(
+    wsp_pool_t *pool,
+    size_t count
+)
+{
+    size_t i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < count; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    for (i = 0; i < pool->threads; i++) {
+        wsp_pool_worker_t *worker = pool->workers + i;
+
+        free(worker->tasks);
+        pthread_mutex_destroy(&worker->lock);
+    }
+
+    pthread_mutex_destroy(&pool->walk);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+
+    free(pool->workers);
+    pool->workers = NULL;
+    pool->threads = 0;
+} // __wsp_pool_stop }}}
+
+// wsp_pool_open {{{
+wsp_return_t wsp_pool_open(
+    wsp_pool_t *pool,
+    size_t threads,
+    wsp_error_t *e
+)
+{
+    if (pool->workers != NULL) {
+        e->type = WSP_ERROR_ALREADY_OPEN;
+        return WSP_ERROR;
+    }
+
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    pool->workers = calloc(threads, sizeof(wsp_pool_worker_t));
+
+    if (pool->workers == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        return WSP_ERROR;
+    }
+
+    size_t i;
+
+    for (i = 0; i < threads; i++) {
+        wsp_pool_worker_t *worker = pool->workers + i;
+
+        worker->pool = pool;
+        worker->tasks = malloc(sizeof(wsp_pool_task_t *) * WSP_POOL_DEQUE_SIZE);
+
+        if (worker->tasks == NULL) {
+            while (i-- > 0) {
+                free(pool->workers[i].tasks);
+                pthread_mutex_destroy(&pool->workers[i].lock);
+            }
+
+            free(pool->workers);
+            pool->workers = NULL;
+            e->type = WSP_ERROR_MALLOC;
+            return WSP_ERROR;
+        }
+
+        worker->capacity = WSP_POOL_DEQUE_SIZE;
+        pthread_mutex_init(&worker->lock, NULL);
+    }
+
+    pthread_mutex_init(&pool->walk, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    pool->threads = threads;
+    pool->stop = 0;
+    pool->available = 0;
+    pool->pending = 0;
+    pool->sleeping = 0;
+    pool->files = 0;
+    pool->completed = 0;
+    pool->failed = 0;
+    pool->bytes = 0;
+    pool->steals = 0;
+    WSP_ERROR_INIT(&pool->last_error);
+    pool->running = 0;
+    clock_gettime(CLOCK_MONOTONIC, &pool->started);
+    pool->finished = pool->started;
+
+    for (i = 0; i < threads; i++) {
+        wsp_pool_worker_t *worker = pool->workers + i;
+
+        int r = pthread_create(&worker->thread, NULL, __wsp_pool_main, worker);
+
+        if (r != 0) {
+            e->type = WSP_ERROR_THREAD;
+            e->syserr = r;
+            // joins the started workers before any deque is released.
+            __wsp_pool_stop(pool, i);
+            return WSP_ERROR;
+        }
+    }
+
+    return WSP_OK;
+} // wsp_pool_open }}}
+
+// wsp_pool_walk {{{
+wsp_return_t wsp_pool_walk(
+    wsp_pool_t *pool,
+    const char *root,
+    const char *suffix,
+    wsp_pool_job_f job,
+    void *ctx,
+    wsp_error_t *e
+)
+{
+    if (pool->workers == NULL) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    struct stat st;
+
+    if (stat(root, &st) == -1) {
+        e->type = WSP_ERROR_OPEN;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    if (!S_ISDIR(st.st_mode)) {
+        e->type = WSP_ERROR_OPEN;
+        e->syserr = ENOTDIR;
+        return WSP_ERROR;
+    }
+
+    wsp_pool_task_t *task = __wsp_pool_task(root, NULL, e);
+
+    if (task == NULL) {
+        return WSP_ERROR;
+    }
+
+    task->dir = 1;
+
+    pthread_mutex_lock(&pool->walk);
+
+    pthread_mutex_lock(&pool->lock);
+
+    pool->suffix = suffix;
+    pool->job = job;
+    pool->ctx = ctx;
+    __atomic_store_n(&pool->files, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&pool->completed, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&pool->failed, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&pool->bytes, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&pool->steals, 0, __ATOMIC_RELAXED);
+    WSP_ERROR_INIT(&pool->last_error);
+    pool->running = 1;
+    clock_gettime(CLOCK_MONOTONIC, &pool->started);
+
+    pthread_mutex_unlock(&pool->lock);
+
+    wsp_return_t result = WSP_OK;
+
+    if (__wsp_pool_push(pool->workers, task, e) == WSP_ERROR) {
+        free(task);
+        result = WSP_ERROR;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (__atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) != 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+
+    // elapsed stops here.
+    pool->running = 0;
+    clock_gettime(CLOCK_MONOTONIC, &pool->finished);
+
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_mutex_unlock(&pool->walk);
+
+    return result;
+} // wsp_pool_walk }}}
+
+// wsp_pool_stats {{{
+void wsp_pool_stats(
+    wsp_pool_t *pool,
+    wsp_pool_stats_t *stats
+)
+{
+    stats->files = __atomic_load_n(&pool->files, __ATOMIC_RELAXED);
+    stats->completed = __atomic_load_n(&pool->completed, __ATOMIC_RELAXED);
+    stats->failed = __atomic_load_n(&pool->failed, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&pool->bytes, __ATOMIC_RELAXED);
+    stats->steals = __atomic_load_n(&pool->steals, __ATOMIC_RELAXED);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (!pool->running) {
+        now = pool->finished;
+    }
+
+    stats->elapsed = (now.tv_sec - pool->started.tv_sec)
+        + (now.tv_nsec - pool->started.tv_nsec) / 1e9;
+    stats->last_error = pool->last_error;
+
+    pthread_mutex_unlock(&pool->lock);
+} // wsp_pool_stats }}}
+
+// wsp_pool_close {{{
+wsp_return_t wsp_pool_close(
+    wsp_pool_t *pool,
+    wsp_error_t *e
+)
+{
+    if (pool->workers == NULL) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    __wsp_pool_stop(pool, pool->threads);
+
+    return WSP_OK;
+} // wsp_pool_close }}}
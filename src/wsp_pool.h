@@ -0,0 +1,185 @@
+// vim: foldmethod=marker
+/**
+ * Work-stealing thread pool for maintenance over a directory tree.
+ *
+ * wsp_pool_walk runs a callback for every matching file below a directory,
+ * spread over the worker threads of the pool. The walk itself is part of the
+ * work: reading a directory queues its files and subdirectories on the deque
+ * of the worker which read it. Workers take their own work newest first and
+ * steal the oldest work of others when they run dry, so a few very large
+ * files do not hold up the rest of the tree.
+ *
+ * Callbacks are usually built on wsp_open and wsp_close, every file is only
+ * handed to a single worker. Callbacks which fail and directories which
+ * cannot be read are counted in failed and the error is kept in last_error.
+ *
+ * Progress can be read with wsp_pool_stats from any thread while a walk is
+ * running, completed and bytes divided by elapsed give the throughput.
+ *
+ * Example:
+ *
+ *   wsp_pool_t pool;
+ *   WSP_POOL_INIT(&pool);
+ *
+ *   if (wsp_pool_open(&pool, 16, &e) == WSP_ERROR) {
+ *       ...
+ *   }
+ *
+ *   wsp_pool_walk(&pool, "/data", ".wsp", verify, NULL, &e);
+ *   ...
+ *   wsp_pool_close(&pool, &e);
+ */
+#ifndef _WSP_POOL_H_
+#define _WSP_POOL_H_
+
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "wsp.h"
+
+typedef struct wsp_pool_t wsp_pool_t;
+typedef struct wsp_pool_task_t wsp_pool_task_t;
+
+/**
+ * Callback run for every file of a walk.
+ *
+ * ctx: Context passed to wsp_pool_walk.
+ * path: Path of the file.
+ * e: Error object.
+ */
+typedef wsp_return_t (*wsp_pool_job_f)(
+    void *ctx,
+    const char *path,
+    wsp_error_t *e
+);
+
+struct wsp_pool_task_t {
+    // directory to read, or file to run the callback for.
+    int dir;
+    off_t size;
+    char path[];
+};
+
+typedef struct {
+    wsp_pool_t *pool;
+    pthread_t thread;
+    // protects the deque, owner works at the bottom and thieves at the top.
+    pthread_mutex_t lock;
+    wsp_pool_task_t **tasks;
+    size_t top;
+    size_t bottom;
+    size_t capacity;
+} wsp_pool_worker_t;
+
+struct wsp_pool_t {
+    wsp_pool_worker_t *workers;
+    size_t threads;
+    // only one walk runs at a time.
+    pthread_mutex_t walk;
+    // protects sleeping workers and waiting for the walk to finish.
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    int stop;
+    // tasks sitting in a deque.
+    size_t available;
+    // tasks which are queued or running.
+    size_t pending;
+    size_t sleeping;
+    /* current walk */
+    const char *suffix;
+    wsp_pool_job_f job;
+    void *ctx;
+    // set while a walk runs, protected by lock.
+    int running;
+    struct timespec started;
+    struct timespec finished;
+    /* statistics, updated atomically */
+    uint64_t files;
+    uint64_t completed;
+    uint64_t failed;
+    uint64_t bytes;
+    uint64_t steals;
+    // protected by lock.
+    wsp_error_t last_error;
+};
+
+#define WSP_POOL_INIT(p) do {\
+    (p)->workers = NULL;\
+    (p)->threads = 0;\
+} while(0)
+
+/**
+ * Progress of the current or last walk.
+ */
+typedef struct {
+    // files found so far.
+    uint64_t files;
+    // files the callback has run for, including failed ones.
+    uint64_t completed;
+    // files the callback failed for and directories which could not be
+    // read.
+    uint64_t failed;
+    // total size of the completed files.
+    uint64_t bytes;
+    // tasks taken from the deque of another worker.
+    uint64_t steals;
+    // seconds since the walk started, or how long it took once it is done.
+    double elapsed;
+    // the most recent error of a callback.
+    wsp_error_t last_error;
+} wsp_pool_stats_t;
+
+/**
+ * Start the worker threads of a pool.
+ *
+ * pool: Pool, should have been initialized using WSP_POOL_INIT.
+ * threads: Number of worker threads, at least one.
+ * e: Error object.
+ */
+wsp_return_t wsp_pool_open(
+    wsp_pool_t *pool,
+    size_t threads,
+    wsp_error_t *e
+);
+
+/**
+ * Run job for every regular file below root and wait until all of them are
+ * done. Symbolic links are not followed.
+ *
+ * pool: Pool.
+ * root: Directory to walk.
+ * suffix: Only files whose name ends with this are passed to job, NULL
+ *         passes every file.
+ * job: Callback, run from the worker threads.
+ * ctx: Passed to job.
+ * e: Error object.
+ */
+wsp_return_t wsp_pool_walk(
+    wsp_pool_t *pool,
+    const char *root,
+    const char *suffix,
+    wsp_pool_job_f job,
+    void *ctx,
+    wsp_error_t *e
+);
+
+/**
+ * Read the progress of the current or last walk, safe to call from any
+ * thread.
+ */
+void wsp_pool_stats(
+    wsp_pool_t *pool,
+    wsp_pool_stats_t *stats
+);
+
+/**
+ * Stop the worker threads of a pool.
+ */
+wsp_return_t wsp_pool_close(
+    wsp_pool_t *pool,
+    wsp_error_t *e
+);
+
+#endif /* _WSP_POOL_H_ */
@@ -1,19 +1,30 @@
 // vim: foldmethod=marker
+#define _GNU_SOURCE
+
 #include "wsp.h"
+#include "wsp_private.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <math.h>
+#include <sched.h>
 #include <sys/stat.h>
+#include <sys/file.h>
 #include <sys/types.h>
 #include <sys/mman.h>
 
 #include "wsp_io_file.h"
 #include "wsp_io_mmap.h"
 #include "wsp_io_memory.h"
+#include "wsp_io_pread.h"
+#include "wsp_io_uring.h"
+#include "wsp_io_direct.h"
 
 #include "wsp_debug.h"
 #include "wsp_buffer.h"
+#include "wsp_time.h"
 
 // aggregate functions {{{
 static wsp_return_t __wsp_aggregate_average(
@@ -257,19 +268,15 @@ wsp_return_t __wsp_read_metadata(
     wsp_error_t *e
 )
 {
-    wsp_metadata_b *buf;
+    wsp_metadata_b buf;
 
-    if (w->io->read(w, 0, sizeof(wsp_metadata_b), (void **)&buf, e) == WSP_ERROR) {
+    if (w->io->read_into(w, 0, sizeof(wsp_metadata_b), &buf, e) == WSP_ERROR) {
         return WSP_ERROR;
     }
 
     wsp_metadata_t tmp;
 
-    __wsp_parse_metadata(buf, &tmp);
-
-    if (w->io_manual_buf) {
-        free(buf);
-    }
+    __wsp_parse_metadata(&buf, &tmp);
 
     wsp_aggregate_f f = NULL;
 
@@ -303,34 +310,6 @@ wsp_return_t __wsp_read_metadata(
     return WSP_OK;
 } // __wsp_read_metadata }}}
 
-// __wsp_read_archive {{{
-wsp_return_t __wsp_read_archive(
-    wsp_t *w,
-    int index,
-    wsp_archive_t *archive,
-    wsp_error_t *e
-)
-{
-    wsp_archive_b *buf;
-
-    size_t offset = WSP_ARCHIVE_OFFSET(index);
-
-    if (w->io->read(w, offset, sizeof(wsp_archive_b), (void **)&buf, e) == WSP_ERROR) {
-        return WSP_ERROR;
-    }
-
-    __wsp_parse_archive(buf, archive);
-
-    if (w->io_manual_buf) {
-        free(buf);
-    }
-
-    archive->points_size = sizeof(wsp_point_t) * archive->count;
-    archive->retention = archive->spp * archive->count;
-
-    return WSP_OK;
-} // __wsp_read_archive }}}
-
 // __wsp_valid_archive {{{
 wsp_return_t __wsp_valid_archive(
     wsp_archive_t *prev,
@@ -358,32 +337,74 @@ wsp_return_t __wsp_load_archives(
     wsp_error_t *e
 )
 {
-    wsp_archive_t *archives = malloc(w->archives_size);
+    uint32_t count = w->meta.archives_count;
+
+    if (count == 0) {
+        e->type = WSP_ERROR_ARCHIVE;
+        return WSP_ERROR;
+    }
+
+    size_t table_size = sizeof(wsp_archive_b) * count;
+    size_t bases_size = sizeof(wsp_point_b) * count;
+
+    // the archive table followed by the base point of every archive.
+    char stack_buf[count <= WSP_HEADER_STACK_MAX ? table_size + bases_size : 1];
+    char *buf = stack_buf;
+
+    if (count > WSP_HEADER_STACK_MAX) {
+        buf = malloc(table_size + bases_size);
+
+        if (buf == NULL) {
+            e->type = WSP_ERROR_MALLOC;
+            return WSP_ERROR;
+        }
+    }
+
+    wsp_archive_b *table = (wsp_archive_b *)buf;
+    wsp_point_b *bases = (wsp_point_b *)(buf + table_size);
+
+    wsp_archive_t *archives = NULL;
+    wsp_io_vec_t *vecs = NULL;
+
+    // the whole archive table in one read.
+    if (w->io->read_into(w, WSP_ARCHIVE_OFFSET(0), table_size, table, e) == WSP_ERROR) {
+        goto error;
+    }
+
+    archives = malloc(w->archives_size);
 
     if (!archives) {
         e->type = WSP_ERROR_MALLOC;
-        return WSP_ERROR;
+        goto error;
     }
 
     uint32_t i;
+    size_t end = WSP_ARCHIVE_OFFSET(count);
 
 #ifdef VALIDATE_ARCHIVE
     wsp_archive_t *prev = NULL;
 #endif /* VALIDATE_ARCHIVE */
 
-    for (i = 0; i < w->meta.archives_count; i++) {
+    for (i = 0; i < count; i++) {
         wsp_archive_t *cur = archives + i;
 
-        if (__wsp_read_archive(w, i, cur, e) == WSP_ERROR) {
-            free(archives);
-            return WSP_ERROR;
+        __wsp_parse_archive(table + i, cur);
+
+        cur->points_size = sizeof(wsp_point_t) * cur->count;
+        cur->retention = cur->spp * cur->count;
+
+        // archives follow the table and each other without overlapping.
+        if (cur->spp == 0 || cur->count == 0 || cur->offset < end) {
+            e->type = WSP_ERROR_ARCHIVE;
+            goto error;
         }
 
+        end = cur->offset + sizeof(wsp_point_b) * cur->count;
+
 #ifdef VALIDATE_ARCHIVE
         if (prev != NULL) {
             if (__wsp_valid_archive(prev, cur, e) == WSP_ERROR) {
-                free(archives);
-                return WSP_ERROR;
+                goto error;
             }
         }
 
@@ -391,6 +412,34 @@ wsp_return_t __wsp_load_archives(
 #endif /* VALIDATE_ARCHIVE */
     }
 
+    vecs = malloc(sizeof(wsp_io_vec_t) * count);
+
+    if (vecs == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        goto error;
+    }
+
+    for (i = 0; i < count; i++) {
+        vecs[i].offset = WSP_POINT_OFFSET(archives + i, 0);
+        vecs[i].size = sizeof(wsp_point_b);
+        vecs[i].buf = bases + i;
+    }
+
+    // the base points of all archives in one operation.
+    if (w->io->readv(w, vecs, count, e) == WSP_ERROR) {
+        goto error;
+    }
+
+    for (i = 0; i < count; i++) {
+        __wsp_parse_point(bases + i, &archives[i].base);
+    }
+
+    free(vecs);
+
+    if (buf != stack_buf) {
+        free(buf);
+    }
+
     // free any old archive.
     if (w->archives != NULL) {
         free(w->archives);
@@ -399,9 +448,19 @@ wsp_return_t __wsp_load_archives(
     }
 
     w->archives = archives;
-    w->archives_count = w->meta.archives_count;
+    w->archives_count = count;
 
     return WSP_OK;
+
+error:
+    free(vecs);
+    free(archives);
+
+    if (buf != stack_buf) {
+        free(buf);
+    }
+
+    return WSP_ERROR;
 } // __wsp_load_archives }}}
 
 // __wsp_archive_free {{{
@@ -414,6 +473,7 @@ wsp_return_t __wsp_archive_free(
     archive->spp = 0;
     archive->count = 0;
     archive->points_size = 0;
+    WSP_POINT_INIT(&archive->base);
 
     return WSP_OK;
 } // __wsp_archive_free }}}
@@ -459,30 +519,60 @@ wsp_return_t __wsp_find_highest_precision(
     return WSP_OK;
 } // __wsp_find_highest_precision }}}
 
-// __wsp_write_segment {{{
-inline static wsp_return_t __wsp_write_segment(
+// __wsp_prepare_segment {{{
+/*
+ * Encode a segment of points into buf and describe the part of it which
+ * needs to be written in vec, vec->size is zero if nothing does.
+ */
+inline static wsp_return_t __wsp_prepare_segment(
     wsp_t *w,
     wsp_archive_t *archive,
     wsp_point_t *points,
     size_t length,
     size_t position,
+    wsp_point_b *buf,
+    wsp_io_vec_t *vec,
     wsp_error_t *e
 )
 {
-    wsp_point_b buf[length];
-
     size_t write_offset = WSP_POINT_OFFSET(archive, position);
     size_t write_size = sizeof(wsp_point_b) * length;
 
     __wsp_dump_points(points, length, buf);
 
-    if (w->io->write(w, write_offset, write_size, (void *)buf, e) == WSP_ERROR) {
-        return WSP_ERROR;
+    size_t first = 0;
+    size_t last = length;
+
+    // only worth it if the stored points can be compared without reading them.
+    if (w->flags & WSP_SKIP_UNCHANGED && w->io_view) {
+        wsp_point_b *stored = NULL;
+
+        if (w->io->read(w, write_offset, write_size, (void **)&stored, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+
+        while (first < last && memcmp(buf + first, stored + first, sizeof(wsp_point_b)) == 0) {
+            first++;
+        }
+
+        while (last > first && memcmp(buf + last - 1, stored + last - 1, sizeof(wsp_point_b)) == 0) {
+            last--;
+        }
+
+        w->stats.skipped_points += length - (last - first);
+
+        if (first == last) {
+            w->stats.skipped_writes++;
+        }
     }
 
+    vec->offset = write_offset + sizeof(wsp_point_b) * first;
+    vec->size = sizeof(wsp_point_b) * (last - first);
+    vec->buf = (void *)(buf + first);
+
     return WSP_OK;
 }
-// __wsp_write_segment }}}
+// __wsp_prepare_segment }}}
 
 // __wsp_save_points {{{
 wsp_return_t __wsp_save_points(
@@ -499,27 +589,84 @@ wsp_return_t __wsp_save_points(
         return WSP_ERROR;
     }
 
-    // One write.
-    if (offset + length <= archive->count) {
-        if (__wsp_write_segment(w, archive, points, length, offset, e) == WSP_ERROR) {
+    wsp_point_b stack_buf[length <= WSP_SEGMENT_STACK_MAX ? length : 1];
+    wsp_point_b *buf = stack_buf;
+
+    // large segments are written by wsp_backfill, keep them off the stack.
+    if (length > WSP_SEGMENT_STACK_MAX) {
+        buf = malloc(sizeof(wsp_point_b) * length);
+
+        if (buf == NULL) {
+            e->type = WSP_ERROR_MALLOC;
             return WSP_ERROR;
         }
     }
-    // Two writes.
-    else {
-        size_t write_length_a = archive->count - offset;
-        size_t write_length_b = archive->count - write_length_a;
 
-        if (__wsp_write_segment(w, archive, points, write_length_a, offset, e) == WSP_ERROR) {
-            return WSP_ERROR;
+    wsp_return_t result = WSP_ERROR;
+    wsp_io_vec_t vecs[2];
+    int count = 0;
+
+    size_t write_length_a = length;
+
+    // wraps around the end of the archive, the second segment starts at 0.
+    if (offset + length > archive->count) {
+        write_length_a = archive->count - offset;
+    }
+
+    size_t write_length_b = length - write_length_a;
+
+    if (__wsp_prepare_segment(w, archive, points, write_length_a, offset, buf, vecs, e) == WSP_ERROR) {
+        goto exit;
+    }
+
+    if (vecs[0].size > 0) {
+        count++;
+    }
+
+    if (write_length_b > 0) {
+        wsp_io_vec_t *vec = vecs + count;
+
+        if (__wsp_prepare_segment(w, archive, points + write_length_a, write_length_b, 0, buf + write_length_a, vec, e) == WSP_ERROR) {
+            goto exit;
         }
 
-        if (__wsp_write_segment(w, archive, points + write_length_a, write_length_b, 0, e) == WSP_ERROR) {
-            return WSP_ERROR;
+        if (vec->size > 0) {
+            count++;
         }
     }
 
-    return WSP_OK;
+    __wsp_write_begin(w);
+
+    wsp_return_t written = WSP_OK;
+
+    // both segments go out in one operation.
+    if (count > 0) {
+        written = w->io->writev(w, vecs, count, e);
+    }
+
+    if (written == WSP_OK) {
+        if (offset == 0) {
+            archive->base = points[0];
+        }
+        else if (write_length_b > 0) {
+            archive->base = points[write_length_a];
+        }
+    }
+
+    __wsp_write_end(w);
+
+    if (written == WSP_ERROR) {
+        goto exit;
+    }
+
+    result = __wsp_sync_tick(w, e);
+
+exit:
+    if (buf != stack_buf) {
+        free(buf);
+    }
+
+    return result;
 } // __wsp_save_points }}}
 
 // __wsp_load_point {{{
@@ -545,6 +692,24 @@ wsp_return_t __wsp_load_point(
     return WSP_OK;
 } // __wsp_load_point }}}
 
+// __wsp_load_base {{{
+wsp_return_t __wsp_load_base(
+    wsp_t *w,
+    wsp_archive_t *archive,
+    wsp_error_t *e
+)
+{
+    wsp_point_t base;
+
+    if (__wsp_load_point(w, archive, 0, &base, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    archive->base = base;
+
+    return WSP_OK;
+} // __wsp_load_base }}}
+
 // __wsp_point_mod {{{
 uint32_t __wsp_point_mod(int value, uint32_t div)
 {
@@ -612,28 +777,54 @@ wsp_return_t __wsp_fetch_read_points(
     }
 
     if (from != 0 && until <= from) {
-        // wrap around
-        uint32_t a_from = from;
+        if (archive != w->archives && wsp_flush_rollups(w, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+
+        wsp_point_b stack_buf[count <= WSP_SEGMENT_STACK_MAX ? count : 1];
+        wsp_point_b *buf = stack_buf;
+
+        if (count > WSP_SEGMENT_STACK_MAX) {
+            buf = malloc(sizeof(wsp_point_b) * count);
+
+            if (buf == NULL) {
+                e->type = WSP_ERROR_MALLOC;
+                return WSP_ERROR;
+            }
+        }
+
         uint32_t a_size = archive->count - from;
-        wsp_point_t *a_points = points;
 
-        uint32_t b_from = 0;
-        uint32_t b_size = until;
-        wsp_point_t *b_points = points + a_size;
+        // wrap around, both ranges are read in one operation.
+        wsp_io_vec_t vecs[2] = {
+            {
+                .offset = WSP_POINT_OFFSET(archive, from),
+                .size = sizeof(wsp_point_b) * a_size,
+                .buf = buf
+            },
+            {
+                .offset = WSP_POINT_OFFSET(archive, 0),
+                .size = sizeof(wsp_point_b) * until,
+                .buf = buf + a_size
+            }
+        };
+
+        wsp_return_t result = w->io->readv(w, vecs, until > 0 ? 2 : 1, e);
 
-        if (wsp_load_points(w, archive, a_from, a_size, a_points, e) == WSP_ERROR) {
-            return WSP_ERROR;
+        if (result == WSP_OK) {
+            __wsp_parse_points(buf, a_size + until, points);
         }
 
-        if (wsp_load_points(w, archive, b_from, b_size, b_points, e) == WSP_ERROR) {
-            return WSP_ERROR;
+        if (buf != stack_buf) {
+            free(buf);
         }
+
+        return result;
     }
-    else {
-        // single linear load.
-        if (wsp_load_points(w, archive, from, count, points, e) == WSP_ERROR) {
-            return WSP_ERROR;
-        }
+
+    // single linear load.
+    if (wsp_load_points(w, archive, from, count, points, e) == WSP_ERROR) {
+        return WSP_ERROR;
     }
 
     return WSP_OK;
@@ -654,9 +845,311 @@ wsp_io *__wsp_get_io(wsp_mapping_t mapping)
         return &wsp_io_memory;
     }
 
+    if (mapping == WSP_PREAD) {
+        return &wsp_io_pread;
+    }
+
+    if (mapping == WSP_DIRECT) {
+        return &wsp_io_direct;
+    }
+
+#ifdef WSP_WITH_URING
+    if (mapping == WSP_URING) {
+        return &wsp_io_uring;
+    }
+#endif
+
     return NULL;
 } // __wsp_get_io }}}
 
+// __wsp_dirty_add {{{
+wsp_return_t __wsp_dirty_add(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    wsp_error_t *e
+)
+{
+    // nothing would ever write the ranges back.
+    if (w->sync == WSP_SYNC_NONE) {
+        return WSP_OK;
+    }
+
+    wsp_dirty_t *d = &w->dirty;
+
+    if (d->ranges == NULL) {
+        // one extra to insert into before merging.
+        d->ranges = malloc(sizeof(wsp_range_t) * (WSP_DIRTY_MAX_RANGES + 1));
+
+        if (d->ranges == NULL) {
+            e->type = WSP_ERROR_MALLOC;
+            return WSP_ERROR;
+        }
+    }
+
+    long end = offset + size;
+    size_t i = 0;
+
+    // first range which ends at or after the new one starts.
+    while (i < d->length && d->ranges[i].offset + (long)d->ranges[i].size < offset) {
+        i++;
+    }
+
+    size_t j = i;
+
+    // absorb every range which touches the new one.
+    while (j < d->length && d->ranges[j].offset <= end) {
+        long range_end = d->ranges[j].offset + d->ranges[j].size;
+
+        if (d->ranges[j].offset < offset) {
+            offset = d->ranges[j].offset;
+        }
+
+        if (range_end > end) {
+            end = range_end;
+        }
+
+        j++;
+    }
+
+    if (j > i) {
+        d->ranges[i].offset = offset;
+        d->ranges[i].size = end - offset;
+        memmove(d->ranges + i + 1, d->ranges + j, sizeof(wsp_range_t) * (d->length - j));
+        d->length -= j - i - 1;
+        return WSP_OK;
+    }
+
+    memmove(d->ranges + i + 1, d->ranges + i, sizeof(wsp_range_t) * (d->length - i));
+    d->ranges[i].offset = offset;
+    d->ranges[i].size = size;
+    d->length++;
+
+    if (d->length <= WSP_DIRTY_MAX_RANGES) {
+        return WSP_OK;
+    }
+
+    // too many ranges, merge the two closest ones.
+    size_t k = 0;
+    long gap = -1;
+
+    for (j = 0; j + 1 < d->length; j++) {
+        long g = d->ranges[j + 1].offset - (d->ranges[j].offset + (long)d->ranges[j].size);
+
+        if (gap == -1 || g < gap) {
+            gap = g;
+            k = j;
+        }
+    }
+
+    d->ranges[k].size = d->ranges[k + 1].offset + d->ranges[k + 1].size - d->ranges[k].offset;
+    memmove(d->ranges + k + 1, d->ranges + k + 2, sizeof(wsp_range_t) * (d->length - k - 2));
+    d->length--;
+
+    return WSP_OK;
+} // __wsp_dirty_add }}}
+
+// __wsp_dirty_free {{{
+void __wsp_dirty_free(
+    wsp_dirty_t *d
+)
+{
+    free(d->ranges);
+    d->ranges = NULL;
+    d->length = 0;
+} // __wsp_dirty_free }}}
+
+// __wsp_dirty_writeback {{{
+wsp_return_t __wsp_dirty_writeback(
+    wsp_t *w,
+    int fn,
+    wsp_error_t *e
+)
+{
+#ifdef SYNC_FILE_RANGE_WRITE
+    size_t i;
+
+    for (i = 0; i < w->dirty.length; i++) {
+        wsp_range_t *range = w->dirty.ranges + i;
+
+        if (sync_file_range(fn, range->offset, range->size, SYNC_FILE_RANGE_WRITE) == -1) {
+            e->type = WSP_ERROR_FSYNC;
+            e->syserr = errno;
+            return WSP_ERROR;
+        }
+    }
+#endif
+
+    return WSP_OK;
+} // __wsp_dirty_writeback }}}
+
+// __wsp_sync {{{
+wsp_return_t __wsp_sync(
+    wsp_t *w,
+    int wait,
+    wsp_error_t *e
+)
+{
+    if (w->io->sync(w, wait, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    w->dirty.length = 0;
+    w->sync_last = wsp_time_now();
+
+    return WSP_OK;
+} // __wsp_sync }}}
+
+// __wsp_sync_tick {{{
+wsp_return_t __wsp_sync_tick(
+    wsp_t *w,
+    wsp_error_t *e
+)
+{
+    if (w->sync != WSP_SYNC_PERIODIC && w->sync != WSP_SYNC_FULL) {
+        return WSP_OK;
+    }
+
+    if (w->sync_interval == 0) {
+        return WSP_OK;
+    }
+
+    if (wsp_time_now() - w->sync_last < w->sync_interval) {
+        return WSP_OK;
+    }
+
+    return __wsp_sync(w, w->sync == WSP_SYNC_FULL, e);
+} // __wsp_sync_tick }}}
+
+// __wsp_write_begin {{{
+void __wsp_write_begin(
+    wsp_t *w
+)
+{
+    if (!(w->flags & WSP_CONCURRENT)) {
+        return;
+    }
+
+    // only the writer changes the counter, the increment needs no atomic
+    // read-modify-write.
+    unsigned int seq = __atomic_load_n(&w->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&w->seq, seq + 1, __ATOMIC_RELAXED);
+    // the odd counter has to be visible before any of the update is.
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+} // __wsp_write_begin }}}
+
+// __wsp_write_end {{{
+void __wsp_write_end(
+    wsp_t *w
+)
+{
+    if (!(w->flags & WSP_CONCURRENT)) {
+        return;
+    }
+
+    unsigned int seq = __atomic_load_n(&w->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&w->seq, seq + 1, __ATOMIC_RELEASE);
+} // __wsp_write_end }}}
+
+// __wsp_read_begin {{{
+unsigned int __wsp_read_begin(
+    wsp_t *w
+)
+{
+    if (!(w->flags & WSP_CONCURRENT)) {
+        return 0;
+    }
+
+    unsigned int seq;
+
+    while ((seq = __atomic_load_n(&w->seq, __ATOMIC_ACQUIRE)) & 1) {
+        sched_yield();
+    }
+
+    return seq;
+} // __wsp_read_begin }}}
+
+// __wsp_read_retry {{{
+int __wsp_read_retry(
+    wsp_t *w,
+    unsigned int seq
+)
+{
+    if (!(w->flags & WSP_CONCURRENT)) {
+        return 0;
+    }
+
+    // everything read has to be done before the counter is checked again.
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&w->seq, __ATOMIC_RELAXED) != seq;
+} // __wsp_read_retry }}}
+
+// __wsp_fadvise {{{
+wsp_return_t __wsp_fadvise(
+    int fn,
+    long offset,
+    size_t size,
+    wsp_advice_t advice,
+    wsp_error_t *e
+)
+{
+    int fadvice;
+
+    switch (advice) {
+    case WSP_ADVICE_NORMAL:
+        fadvice = POSIX_FADV_NORMAL;
+        break;
+    case WSP_ADVICE_SEQUENTIAL:
+        fadvice = POSIX_FADV_SEQUENTIAL;
+        break;
+    case WSP_ADVICE_RANDOM:
+        fadvice = POSIX_FADV_RANDOM;
+        break;
+    // the page cache has no way to wait for the read.
+    case WSP_ADVICE_WILLNEED:
+    case WSP_ADVICE_POPULATE:
+        fadvice = POSIX_FADV_WILLNEED;
+        break;
+    case WSP_ADVICE_DONTNEED:
+        fadvice = POSIX_FADV_DONTNEED;
+        break;
+    default:
+        e->type = WSP_ERROR_IO;
+        return WSP_ERROR;
+    }
+
+    int r = posix_fadvise(fn, offset, size, fadvice);
+
+    // posix_fadvise returns the error instead of setting errno.
+    if (r != 0) {
+        e->type = WSP_ERROR_IO;
+        e->syserr = r;
+        return WSP_ERROR;
+    }
+
+    return WSP_OK;
+} // __wsp_fadvise }}}
+
+// __wsp_flock {{{
+wsp_return_t __wsp_flock(
+    int fn,
+    int lock,
+    wsp_error_t *e
+)
+{
+    while (flock(fn, lock ? LOCK_EX : LOCK_UN) == -1) {
+        if (errno == EINTR) {
+            continue;
+        }
+
+        e->type = WSP_ERROR_LOCK;
+        e->syserr = errno;
+        return WSP_ERROR;
+    }
+
+    return WSP_OK;
+} // __wsp_flock }}}
+
 // __wsp_build_point {{{
 void __wsp_build_point(
     wsp_t *w,
@@ -669,3 +1162,20 @@ void __wsp_build_point(
     result->timestamp = wsp_time_floor(time, archive->spp);
     result->value = value;
 } // __wsp_build_point }}}
+
+// __wsp_fnv1a {{{
+uint32_t __wsp_fnv1a(
+    const char *buf,
+    size_t size
+)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        hash ^= (unsigned char)buf[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+} // __wsp_fnv1a }}}
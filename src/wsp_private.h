@@ -7,6 +7,53 @@
 
 #include "wsp_buffer.h"
 
+/**
+ * Maximum number of pending entries of a WSP_LAZY database, when exceeded
+ * they are propagated before more are added.
+ */
+#define WSP_LAZY_MAX_PENDING 4096
+
+/**
+ * Largest segment, in points, which is encoded on the stack when written or
+ * read with a vectored operation.
+ */
+#define WSP_SEGMENT_STACK_MAX 1024
+
+/**
+ * Largest number of archives whose header is read into a buffer on the
+ * stack when opening a database.
+ */
+#define WSP_HEADER_STACK_MAX 64
+
+/**
+ * Modes for batch application.
+ */
+#define WSP_BATCH_WRITE 0x01
+#define WSP_BATCH_PROPAGATE 0x02
+
+/**
+ * A single point tagged with the archive it belongs to and its position in
+ * the input, the latter keeps sorting stable so that the last write to a
+ * slot wins.
+ */
+typedef struct {
+    uint32_t archive;
+    size_t order;
+    wsp_point_t point;
+} wsp_batch_entry_t;
+
+/**
+ * Points written by a WSP_LAZY database that still have to be propagated to
+ * the lower precision archives.
+ */
+struct wsp_lazy_t {
+    wsp_batch_entry_t *entries;
+    size_t length;
+    size_t capacity;
+    // order given to the next appended entry.
+    size_t order;
+};
+
 /**
  * Read metadata from file.
  *
@@ -20,19 +67,22 @@ wsp_return_t __wsp_read_metadata(
     wsp_error_t *e
 );
 
-wsp_return_t __wsp_read_archive(
-    wsp_t *w,
-    int index,
-    wsp_archive_t *archive,
-    wsp_error_t *e
-);
-
 wsp_return_t __wsp_valid_archive(
     wsp_archive_t *prev,
     wsp_archive_t *cur,
     wsp_error_t *e
 );
 
+/**
+ * Load the archive table and the base point of every archive, validating
+ * the layout of the archives.
+ *
+ * The table is read in one operation, and the base points with one
+ * vectored read.
+ *
+ * w: Whisper database, with metadata already read.
+ * e: Error object.
+ */
 wsp_return_t __wsp_load_archives(
     wsp_t *w,
     wsp_error_t *e
@@ -77,6 +127,19 @@ wsp_return_t __wsp_load_point(
     wsp_error_t *e
 );
 
+/**
+ * Refresh the cached base point of an archive from slot 0.
+ *
+ * w: Whisper database.
+ * archive: The archive to refresh.
+ * e: Error object.
+ */
+wsp_return_t __wsp_load_base(
+    wsp_t *w,
+    wsp_archive_t *archive,
+    wsp_error_t *e
+);
+
 /**
  * Filter out points depending on a base values timestamp.
  *
@@ -102,8 +165,134 @@ wsp_return_t __wsp_fetch_read_points(
     wsp_error_t *e
 );
 
+/**
+ * Calculate the value of the bucket in cur that contains timestamp by
+ * aggregating the points of the previous archive.
+ *
+ * w: Whisper database.
+ * timestamp: Timestamp within the bucket.
+ * cur: Archive to calculate the value for.
+ * prev: The archive preceding cur.
+ * prev_base: Base point of prev.
+ * result: Where to store the aggregated value.
+ * skip: Will be set to 1 if x_files_factor is not satisfied.
+ * e: Error object.
+ */
+wsp_return_t wsp_aggregate_value(
+    wsp_t *w,
+    time_t timestamp,
+    wsp_archive_t *cur,
+    wsp_archive_t *prev,
+    wsp_point_t *prev_base,
+    wsp_value_t *result,
+    int *skip,
+    wsp_error_t *e
+);
+
 wsp_io *__wsp_get_io(wsp_mapping_t mapping);
 
+/**
+ * Mark a range of the file as written, nothing is tracked without a sync
+ * policy.
+ */
+wsp_return_t __wsp_dirty_add(
+    wsp_t *w,
+    long offset,
+    size_t size,
+    wsp_error_t *e
+);
+
+/**
+ * Release the ranges of a dirty range set.
+ */
+void __wsp_dirty_free(
+    wsp_dirty_t *d
+);
+
+/**
+ * Start writeback of the dirty ranges of a database through a file
+ * descriptor, without waiting for it to finish. Does nothing where the
+ * platform has no way to do that.
+ */
+wsp_return_t __wsp_dirty_writeback(
+    wsp_t *w,
+    int fn,
+    wsp_error_t *e
+);
+
+/**
+ * Sync the database with the I/O mapping and restart the sync interval.
+ */
+wsp_return_t __wsp_sync(
+    wsp_t *w,
+    int wait,
+    wsp_error_t *e
+);
+
+/**
+ * Sync the database if the policy asks for it and the sync interval has
+ * passed.
+ */
+wsp_return_t __wsp_sync_tick(
+    wsp_t *w,
+    wsp_error_t *e
+);
+
+/**
+ * Pass an access pattern hint for a range of a file descriptor on to the
+ * page cache with posix_fadvise.
+ */
+wsp_return_t __wsp_fadvise(
+    int fn,
+    long offset,
+    size_t size,
+    wsp_advice_t advice,
+    wsp_error_t *e
+);
+
+/**
+ * Mark the start of an update of a WSP_CONCURRENT handle, readers which
+ * overlap with it retry. Does nothing for other handles.
+ */
+void __wsp_write_begin(
+    wsp_t *w
+);
+
+/**
+ * Mark the end of an update started with __wsp_write_begin.
+ */
+void __wsp_write_end(
+    wsp_t *w
+);
+
+/**
+ * Start reading from a WSP_CONCURRENT handle, waiting for an update in
+ * progress to finish. Returns the sequence to pass to __wsp_read_retry.
+ */
+unsigned int __wsp_read_begin(
+    wsp_t *w
+);
+
+/**
+ * Check if an update raced with a read started with __wsp_read_begin, in
+ * which case what was read might be torn and has to be read again. Always
+ * false for handles without WSP_CONCURRENT.
+ */
+int __wsp_read_retry(
+    wsp_t *w,
+    unsigned int seq
+);
+
+/**
+ * Take or release an exclusive flock on a file descriptor, retrying if
+ * interrupted.
+ */
+wsp_return_t __wsp_flock(
+    int fn,
+    int lock,
+    wsp_error_t *e
+);
+
 uint32_t __wsp_point_mod(int value, uint32_t div);
 
 void __wsp_parse_points(
@@ -126,4 +315,12 @@ void __wsp_build_point(
     wsp_point_t *result
 );
 
+/**
+ * 32 bit FNV-1a hash, used for checksums and to hash paths.
+ */
+uint32_t __wsp_fnv1a(
+    const char *buf,
+    size_t size
+);
+
 #endif /* _WSP_PRIVATE_H_ */
@@ -0,0 +1,226 @@
+// vim: foldmethod=marker
+#include "wsp_ring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wsp_debug.h"
+
+#define WSP_RING_SLOT(ring, pos) \
+    ((wsp_ring_slot_t *)((ring)->slots + ((pos) & ((ring)->capacity - 1)) * (ring)->stride))
+
+// wsp_ring_open {{{
+wsp_return_t wsp_ring_open(
+    wsp_ring_t *ring,
+    size_t capacity,
+    wsp_error_t *e
+)
+{
+    if (ring->slots != NULL) {
+        e->type = WSP_ERROR_ALREADY_OPEN;
+        return WSP_ERROR;
+    }
+
+    size_t size = 1;
+
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    size_t stride = (sizeof(wsp_ring_slot_t) + WSP_CACHE_LINE - 1) & ~((size_t)WSP_CACHE_LINE - 1);
+
+    void *slots;
+
+    if (posix_memalign(&slots, WSP_CACHE_LINE, size * stride) != 0) {
+        e->type = WSP_ERROR_MALLOC;
+        return WSP_ERROR;
+    }
+
+    ring->scratch = malloc(sizeof(wsp_point_input_t) * WSP_RING_BATCH * WSP_RING_DRAIN_SLOTS);
+
+    if (ring->scratch == NULL) {
+        free(slots);
+        e->type = WSP_ERROR_MALLOC;
+        return WSP_ERROR;
+    }
+
+    ring->slots = slots;
+    ring->capacity = size;
+    ring->stride = stride;
+    ring->head = 0;
+    ring->tail = 0;
+
+    uint64_t pos;
+
+    // every slot starts out free for its position in the first lap.
+    for (pos = 0; pos < size; pos++) {
+        __atomic_store_n(&WSP_RING_SLOT(ring, pos)->seq, pos, __ATOMIC_RELAXED);
+    }
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    return WSP_OK;
+} // wsp_ring_open }}}
+
+// wsp_ring_push {{{
+wsp_return_t wsp_ring_push(
+    wsp_ring_t *ring,
+    wsp_t *w,
+    wsp_point_input_t *points,
+    size_t length,
+    wsp_error_t *e
+)
+{
+    if (ring->slots == NULL) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    if (length == 0) {
+        return WSP_OK;
+    }
+
+    uint64_t n = (length + WSP_RING_BATCH - 1) / WSP_RING_BATCH;
+
+    if (n > ring->capacity) {
+        e->type = WSP_ERROR_FULL;
+        return WSP_ERROR;
+    }
+
+    uint64_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+    while (1) {
+        /*
+         * The consumer frees slots in order, so if the last slot is free for
+         * this lap every slot before it is too.
+         */
+        wsp_ring_slot_t *last = WSP_RING_SLOT(ring, pos + n - 1);
+        uint64_t seq = __atomic_load_n(&last->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - (pos + n - 1));
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(
+                &ring->head, &pos, pos + n, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED
+            )) {
+                break;
+            }
+
+            // pos now holds the current head.
+            continue;
+        }
+
+        if (diff < 0) {
+            __atomic_fetch_add(&ring->full, 1, __ATOMIC_RELAXED);
+            e->type = WSP_ERROR_FULL;
+            return WSP_ERROR;
+        }
+
+        // another producer claimed the slots.
+        pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    }
+
+    uint64_t i;
+
+    for (i = 0; i < n; i++) {
+        wsp_ring_slot_t *slot = WSP_RING_SLOT(ring, pos + i);
+        size_t count = length < WSP_RING_BATCH ? length : WSP_RING_BATCH;
+
+        slot->w = w;
+        slot->length = count;
+        memcpy(slot->points, points, sizeof(wsp_point_input_t) * count);
+
+        __atomic_store_n(&slot->seq, pos + i + 1, __ATOMIC_RELEASE);
+
+        points += count;
+        length -= count;
+    }
+
+    return WSP_OK;
+} // wsp_ring_push }}}
+
+// wsp_ring_drain {{{
+wsp_return_t wsp_ring_drain(
+    wsp_ring_t *ring,
+    size_t *count,
+    wsp_error_t *e
+)
+{
+    if (ring->slots == NULL) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    size_t total = 0;
+    size_t max = WSP_RING_BATCH * WSP_RING_DRAIN_SLOTS;
+
+    while (1) {
+        wsp_ring_slot_t *slot = WSP_RING_SLOT(ring, ring->tail);
+
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != ring->tail + 1) {
+            break;
+        }
+
+        wsp_t *w = slot->w;
+        size_t length = 0;
+
+        // merge consecutive batches for the same database.
+        do {
+            memcpy(ring->scratch + length, slot->points, sizeof(wsp_point_input_t) * slot->length);
+            length += slot->length;
+
+            // the slot is free for the next lap as soon as it is copied.
+            __atomic_store_n(&slot->seq, ring->tail + ring->capacity, __ATOMIC_RELEASE);
+            ring->tail++;
+
+            slot = WSP_RING_SLOT(ring, ring->tail);
+        } while (
+            length + WSP_RING_BATCH <= max &&
+            __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == ring->tail + 1 &&
+            slot->w == w
+        );
+
+        if (DEBUG) {
+            DEBUG_PRINTF("drain: %zu points", length);
+        }
+
+        wsp_error_t update_e;
+        WSP_ERROR_INIT(&update_e);
+
+        if (wsp_update_many(w, ring->scratch, length, &update_e) == WSP_ERROR) {
+            ring->failed += length;
+            ring->last_error = update_e;
+        }
+        else {
+            ring->drained += length;
+        }
+
+        total += length;
+    }
+
+    if (count != NULL) {
+        *count = total;
+    }
+
+    return WSP_OK;
+} // wsp_ring_drain }}}
+
+// wsp_ring_close {{{
+wsp_return_t wsp_ring_close(
+    wsp_ring_t *ring,
+    wsp_error_t *e
+)
+{
+    if (ring->slots == NULL) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    free(ring->slots);
+    free(ring->scratch);
+
+    ring->slots = NULL;
+    ring->scratch = NULL;
+    ring->capacity = 0;
+
+    return WSP_OK;
+} // wsp_ring_close }}}
@@ -0,0 +1,161 @@
+// vim: foldmethod=marker
+/**
+ * Bounded lock-free queue of point batches, many producers and one consumer.
+ *
+ * Producers hand over points for an open database with wsp_ring_push, which
+ * never blocks and never takes a lock: it claims slots with a single compare
+ * and swap and fails with WSP_ERROR_FULL when the ring has no room, leaving
+ * it to the caller to retry or drop the points. The thread owning the
+ * databases calls wsp_ring_drain, which writes everything queued through
+ * wsp_update_many, merging consecutive batches for the same database into a
+ * single call.
+ *
+ * Points are copied into the ring, a batch longer than WSP_RING_BATCH points
+ * occupies several consecutive slots. The producer position, the consumer
+ * position and every slot are kept on separate cache lines.
+ *
+ * Points which cannot be written are dropped, they are counted in failed and
+ * the error is kept in last_error.
+ *
+ * Example:
+ *
+ *   wsp_ring_t ring;
+ *   WSP_RING_INIT(&ring);
+ *
+ *   if (wsp_ring_open(&ring, 4096, &e) == WSP_ERROR) {
+ *       ...
+ *   }
+ *
+ *   // any number of threads.
+ *   wsp_ring_push(&ring, &w, points, length, &e);
+ *
+ *   // the thread using w.
+ *   wsp_ring_drain(&ring, &count, &e);
+ *   ...
+ *   wsp_ring_close(&ring, &e);
+ */
+#ifndef _WSP_RING_H_
+#define _WSP_RING_H_
+
+#include "wsp.h"
+
+/**
+ * Size of a cache line, fields written by different threads are kept at least
+ * this far apart.
+ */
+#define WSP_CACHE_LINE 64
+
+/**
+ * Number of points held by a single slot.
+ */
+#define WSP_RING_BATCH 32
+
+/**
+ * Number of slots merged into a single call to wsp_update_many.
+ */
+#define WSP_RING_DRAIN_SLOTS 64
+
+typedef struct {
+    // position the slot is free for, or one past the position it holds
+    // points for.
+    uint64_t seq;
+    // database the points belong to.
+    wsp_t *w;
+    size_t length;
+    wsp_point_input_t points[WSP_RING_BATCH];
+} wsp_ring_slot_t;
+
+typedef struct {
+    // slots, every slot starts on its own cache line.
+    char *slots;
+    size_t capacity;
+    size_t stride;
+    // buffer batches are merged into while draining.
+    wsp_point_input_t *scratch;
+    char pad0[WSP_CACHE_LINE];
+    // next position claimed by producers.
+    uint64_t head;
+    char pad1[WSP_CACHE_LINE - sizeof(uint64_t)];
+    // next position read by the consumer.
+    uint64_t tail;
+    char pad2[WSP_CACHE_LINE - sizeof(uint64_t)];
+    /* statistics */
+    // pushes rejected because the ring was full, updated by producers.
+    uint64_t full;
+    // points written to their database.
+    uint64_t drained;
+    // points dropped because they could not be written.
+    uint64_t failed;
+    wsp_error_t last_error;
+} wsp_ring_t;
+
+#define WSP_RING_INIT(r) do {\
+    (r)->slots = NULL;\
+    (r)->capacity = 0;\
+    (r)->stride = 0;\
+    (r)->scratch = NULL;\
+    (r)->head = 0;\
+    (r)->tail = 0;\
+    (r)->full = 0;\
+    (r)->drained = 0;\
+    (r)->failed = 0;\
+    WSP_ERROR_INIT(&(r)->last_error);\
+} while(0)
+
+/**
+ * Allocate the slots of a ring.
+ *
+ * ring: Ring, should have been initialized using WSP_RING_INIT.
+ * capacity: Number of slots, rounded up to a power of two.
+ * e: Error object.
+ */
+wsp_return_t wsp_ring_open(
+    wsp_ring_t *ring,
+    size_t capacity,
+    wsp_error_t *e
+);
+
+/**
+ * Queue points for a database without blocking.
+ *
+ * Safe to call from any number of threads. Either all points are queued or,
+ * with WSP_ERROR_FULL, none of them.
+ *
+ * ring: Ring.
+ * w: Database the points belong to, only used by the consumer.
+ * points: Points to queue, copied before returning.
+ * length: Number of points.
+ * e: Error object.
+ */
+wsp_return_t wsp_ring_push(
+    wsp_ring_t *ring,
+    wsp_t *w,
+    wsp_point_input_t *points,
+    size_t length,
+    wsp_error_t *e
+);
+
+/**
+ * Write every batch which is queued to its database.
+ *
+ * Must only be called by one thread at a time.
+ *
+ * ring: Ring.
+ * count: If not NULL, set to the number of points taken from the ring.
+ * e: Error object.
+ */
+wsp_return_t wsp_ring_drain(
+    wsp_ring_t *ring,
+    size_t *count,
+    wsp_error_t *e
+);
+
+/**
+ * Release the slots of a ring, points still queued are discarded.
+ */
+wsp_return_t wsp_ring_close(
+    wsp_ring_t *ring,
+    wsp_error_t *e
+);
+
+#endif /* _WSP_RING_H_ */
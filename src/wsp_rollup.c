@@ -0,0 +1,283 @@
+// vim: foldmethod=marker
+#include "wsp_rollup.h"
+#include "wsp_private.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "wsp_debug.h"
+
+// __wsp_rollup_init {{{
+wsp_return_t __wsp_rollup_init(
+    wsp_t *w,
+    wsp_error_t *e
+)
+{
+    wsp_rollup_t *rollups = calloc(w->archives_count, sizeof(wsp_rollup_t));
+
+    if (rollups == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        return WSP_ERROR;
+    }
+
+    w->rollups = rollups;
+
+    uint32_t i;
+
+    // the highest precision archive is never rolled up into.
+    for (i = 1; i < w->archives_count; i++) {
+        wsp_rollup_t *state = rollups + i;
+
+        state->bucket = 0;
+        state->ratio = w->archives[i].spp / w->archives[i - 1].spp;
+        state->values = malloc(sizeof(wsp_value_t) * state->ratio);
+
+        if (state->values == NULL) {
+            __wsp_rollup_free(w);
+            e->type = WSP_ERROR_MALLOC;
+            return WSP_ERROR;
+        }
+    }
+
+    return WSP_OK;
+} // __wsp_rollup_init }}}
+
+// __wsp_rollup_free {{{
+void __wsp_rollup_free(
+    wsp_t *w
+)
+{
+    if (w->rollups == NULL) {
+        return;
+    }
+
+    uint32_t i;
+
+    for (i = 0; i < w->archives_count; i++) {
+        free(w->rollups[i].values);
+    }
+
+    free(w->rollups);
+    w->rollups = NULL;
+} // __wsp_rollup_free }}}
+
+// __wsp_rollup_reset {{{
+void __wsp_rollup_reset(
+    wsp_t *w
+)
+{
+    if (w->rollups == NULL) {
+        return;
+    }
+
+    uint32_t i;
+
+    for (i = 0; i < w->archives_count; i++) {
+        w->rollups[i].bucket = 0;
+    }
+} // __wsp_rollup_reset }}}
+
+// __wsp_rollup_scan {{{
+/*
+ * Recalculate all running values from the slots of the open bucket.
+ */
+static void __wsp_rollup_scan(
+    wsp_rollup_t *state
+)
+{
+    uint32_t i;
+
+    state->known = 0;
+    state->sum = 0;
+    state->min = NAN;
+    state->max = NAN;
+
+    for (i = 0; i < state->ratio; i++) {
+        wsp_value_t v = state->values[i];
+
+        if (isnan(v)) {
+            continue;
+        }
+
+        state->known++;
+        state->sum += v;
+
+        if (isnan(state->min) || v < state->min) {
+            state->min = v;
+        }
+
+        if (isnan(state->max) || v > state->max) {
+            state->max = v;
+        }
+    }
+} // __wsp_rollup_scan }}}
+
+// __wsp_rollup_open {{{
+/*
+ * Open a new bucket by reading its slots from the previous archive.
+ */
+static wsp_return_t __wsp_rollup_open(
+    wsp_t *w,
+    wsp_archive_t *cur,
+    wsp_rollup_t *state,
+    wsp_time_t bucket,
+    wsp_error_t *e
+)
+{
+    wsp_archive_t *prev = cur - 1;
+    int offset = ((int64_t)bucket - (int64_t)prev->base.timestamp) / (int64_t)prev->spp;
+
+    wsp_point_t points[state->ratio];
+
+    if (wsp_fetch_points(w, prev, offset, state->ratio, points, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    uint32_t i;
+
+    for (i = 0; i < state->ratio; i++) {
+        state->values[i] = points[i].value;
+    }
+
+    state->bucket = bucket;
+    __wsp_rollup_scan(state);
+
+    return WSP_OK;
+} // __wsp_rollup_open }}}
+
+// __wsp_rollup_set {{{
+/*
+ * Update the value of a single slot in the open bucket.
+ */
+static void __wsp_rollup_set(
+    wsp_rollup_t *state,
+    uint32_t slot,
+    wsp_value_t value
+)
+{
+    wsp_value_t old = state->values[slot];
+
+    if (old == value || (isnan(old) && isnan(value))) {
+        return;
+    }
+
+    state->values[slot] = value;
+
+    // the old value was an extreme and is going away, rescan.
+    if (!isnan(old) && (old == state->min || old == state->max)) {
+        __wsp_rollup_scan(state);
+        return;
+    }
+
+    if (isnan(value)) {
+        state->known--;
+        state->sum -= old;
+        return;
+    }
+
+    if (isnan(old)) {
+        state->known++;
+        state->sum += value;
+    }
+    else {
+        state->sum += value - old;
+    }
+
+    if (isnan(state->min) || value < state->min) {
+        state->min = value;
+    }
+
+    if (isnan(state->max) || value > state->max) {
+        state->max = value;
+    }
+} // __wsp_rollup_set }}}
+
+// __wsp_rollup_result {{{
+/*
+ * Calculate the aggregated value of the open bucket, this mirrors the
+ * aggregate functions in wsp_private.c.
+ */
+static void __wsp_rollup_result(
+    wsp_t *w,
+    wsp_rollup_t *state,
+    wsp_value_t *value,
+    int *skip
+)
+{
+    if (w->meta.aggregation == WSP_LAST) {
+        *value = state->values[state->ratio - 1];
+        return;
+    }
+
+    float known = (float)state->known / (float)state->ratio;
+
+    if (known < w->meta.x_files_factor) {
+        *value = NAN;
+        *skip = 1;
+        return;
+    }
+
+    switch (w->meta.aggregation) {
+    case WSP_AVERAGE:
+        *value = state->sum / state->known;
+        break;
+    case WSP_SUM:
+        *value = state->sum;
+        break;
+    case WSP_MAX:
+        *value = state->max;
+        break;
+    case WSP_MIN:
+        *value = state->min;
+        break;
+    default:
+        *value = NAN;
+        break;
+    }
+} // __wsp_rollup_result }}}
+
+// __wsp_rollup_update {{{
+wsp_return_t __wsp_rollup_update(
+    wsp_t *w,
+    wsp_archive_t *cur,
+    wsp_point_t *points,
+    size_t count,
+    wsp_value_t *value,
+    int *skip,
+    wsp_error_t *e
+)
+{
+    wsp_archive_t *prev = cur - 1;
+    wsp_rollup_t *state = w->rollups + (cur - w->archives);
+    wsp_time_t bucket = wsp_time_floor(points[0].timestamp, cur->spp);
+
+    // late write to a bucket that has already been closed.
+    if (state->bucket != 0 && bucket < state->bucket) {
+        if (DEBUG) {
+            DEBUG_PRINTF("late bucket=%u, open=%u", bucket, state->bucket);
+        }
+
+        return wsp_aggregate_value(
+            w, bucket, cur, prev, &prev->base, value, skip, e
+        );
+    }
+
+    // the previous archive already contains the written points.
+    if (bucket != state->bucket) {
+        if (__wsp_rollup_open(w, cur, state, bucket, e) == WSP_ERROR) {
+            return WSP_ERROR;
+        }
+    }
+    else {
+        size_t i;
+
+        for (i = 0; i < count; i++) {
+            uint32_t slot = (points[i].timestamp - bucket) / prev->spp;
+            __wsp_rollup_set(state, slot, points[i].value);
+        }
+    }
+
+    __wsp_rollup_result(w, state, value, skip);
+
+    return WSP_OK;
+} // __wsp_rollup_update }}}
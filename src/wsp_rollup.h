@@ -0,0 +1,80 @@
+// vim: foldmethod=marker
+/**
+ * Incremental rollup state for lower precision archives.
+ *
+ * When a database is opened with WSP_INCREMENTAL, every lower precision
+ * archive keeps the values of the higher precision slots that make up its
+ * most recent (open) bucket together with a running count, sum, min and max.
+ * Rolling up a write into an open bucket then costs O(1) and no I/O, the
+ * higher precision archive is only read when a new bucket is opened or when
+ * a write lands in a bucket older than the open one.
+ */
+#ifndef _WSP_ROLLUP_H_
+#define _WSP_ROLLUP_H_
+
+#include "wsp.h"
+
+struct wsp_rollup_t {
+    // start of the open bucket, 0 if no bucket has been opened yet.
+    wsp_time_t bucket;
+    // number of higher precision slots in every bucket.
+    uint32_t ratio;
+    // number of known (not NaN) values in the open bucket.
+    uint32_t known;
+    wsp_value_t sum;
+    wsp_value_t min;
+    wsp_value_t max;
+    // value of every higher precision slot in the open bucket, NaN if unknown.
+    wsp_value_t *values;
+};
+
+/**
+ * Allocate rollup state for every lower precision archive of an open
+ * database.
+ *
+ * w: Whisper database.
+ * e: Error object.
+ */
+wsp_return_t __wsp_rollup_init(
+    wsp_t *w,
+    wsp_error_t *e
+);
+
+/**
+ * Free any rollup state associated with the database.
+ */
+void __wsp_rollup_free(
+    wsp_t *w
+);
+
+/**
+ * Forget all open buckets, the next rollup in every archive will reload its
+ * bucket from the database.
+ */
+void __wsp_rollup_reset(
+    wsp_t *w
+);
+
+/**
+ * Roll up points that have been written to the archive preceding cur.
+ *
+ * w: Whisper database.
+ * cur: Archive to calculate the rollup value for.
+ * points: Points written to the previous archive, all of them must belong to
+ * the same bucket in cur.
+ * count: Number of points.
+ * value: Where to store the rolled up value.
+ * skip: Will be set to 1 if x_files_factor is not satisfied.
+ * e: Error object.
+ */
+wsp_return_t __wsp_rollup_update(
+    wsp_t *w,
+    wsp_archive_t *cur,
+    wsp_point_t *points,
+    size_t count,
+    wsp_value_t *value,
+    int *skip,
+    wsp_error_t *e
+);
+
+#endif /* _WSP_ROLLUP_H_ */
@@ -0,0 +1,586 @@
+// vim: foldmethod=marker
+#include "wsp_writer.h"
+#include "wsp_private.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wsp_debug.h"
+
+#define WSP_WRITER_TABLE_SIZE 256
+
+// __wsp_writer_find {{{
+/*
+ * Find the link pointing to the handle for path, the link points to NULL if
+ * the worker has no such handle.
+ */
+static wsp_writer_handle_t **__wsp_writer_find(
+    wsp_writer_worker_t *worker,
+    const char *path,
+    uint32_t hash
+)
+{
+    wsp_writer_handle_t **link = worker->table + (hash & (worker->table_size - 1));
+
+    while (*link != NULL) {
+        if ((*link)->hash == hash && strcmp((*link)->path, path) == 0) {
+            break;
+        }
+
+        link = &(*link)->chain;
+    }
+
+    return link;
+} // __wsp_writer_find }}}
+
+// __wsp_writer_lru_unlink {{{
+static void __wsp_writer_lru_unlink(
+    wsp_writer_worker_t *worker,
+    wsp_writer_handle_t *handle
+)
+{
+    if (handle->prev != NULL) {
+        handle->prev->next = handle->next;
+    }
+    else {
+        worker->lru_head = handle->next;
+    }
+
+    if (handle->next != NULL) {
+        handle->next->prev = handle->prev;
+    }
+    else {
+        worker->lru_tail = handle->prev;
+    }
+
+    handle->prev = NULL;
+    handle->next = NULL;
+} // __wsp_writer_lru_unlink }}}
+
+// __wsp_writer_lru_push {{{
+static void __wsp_writer_lru_push(
+    wsp_writer_worker_t *worker,
+    wsp_writer_handle_t *handle
+)
+{
+    handle->prev = NULL;
+    handle->next = worker->lru_head;
+
+    if (worker->lru_head != NULL) {
+        worker->lru_head->prev = handle;
+    }
+    else {
+        worker->lru_tail = handle;
+    }
+
+    worker->lru_head = handle;
+} // __wsp_writer_lru_push }}}
+
+// __wsp_writer_close_handle {{{
+/*
+ * Close a handle and remove it from the cache of the worker.
+ */
+static wsp_return_t __wsp_writer_close_handle(
+    wsp_writer_worker_t *worker,
+    wsp_writer_handle_t *handle,
+    wsp_error_t *e
+)
+{
+    wsp_writer_handle_t **link = __wsp_writer_find(worker, handle->path, handle->hash);
+    *link = handle->chain;
+
+    __wsp_writer_lru_unlink(worker, handle);
+    worker->handles--;
+
+    wsp_return_t result = wsp_close(&handle->w, e);
+
+    free(handle);
+
+    return result;
+} // __wsp_writer_close_handle }}}
+
+// __wsp_writer_handle {{{
+/*
+ * Get an open handle for path, opening the database if the worker does not
+ * hold it already.
+ */
+static wsp_writer_handle_t *__wsp_writer_handle(
+    wsp_writer_worker_t *worker,
+    const char *path,
+    uint32_t hash,
+    wsp_error_t *e
+)
+{
+    wsp_writer_t *wr = worker->writer;
+    wsp_writer_handle_t **link = __wsp_writer_find(worker, path, hash);
+    wsp_writer_handle_t *handle = *link;
+
+    if (handle != NULL) {
+        if (worker->lru_head != handle) {
+            __wsp_writer_lru_unlink(worker, handle);
+            __wsp_writer_lru_push(worker, handle);
+        }
+
+        return handle;
+    }
+
+    size_t path_length = strlen(path);
+
+    handle = malloc(sizeof(wsp_writer_handle_t) + path_length + 1);
+
+    if (handle == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        return NULL;
+    }
+
+    WSP_INIT(&handle->w);
+
+    if (wsp_open(&handle->w, path, wr->mapping, wr->flags | WSP_READ | WSP_WRITE, e) == WSP_ERROR) {
+        free(handle);
+        return NULL;
+    }
+
+    handle->hash = hash;
+    memcpy(handle->path, path, path_length + 1);
+
+    int evicted = 0;
+    wsp_error_t close_e;
+    WSP_ERROR_INIT(&close_e);
+    wsp_return_t closed = WSP_OK;
+
+    if (wr->max_handles != 0 && worker->handles >= wr->max_handles) {
+        // pending rollups or a sync of the evicted database can fail here.
+        closed = __wsp_writer_close_handle(worker, worker->lru_tail, &close_e);
+        evicted = 1;
+    }
+
+    // the link might have moved with the evicted handle.
+    link = __wsp_writer_find(worker, path, hash);
+    handle->chain = NULL;
+    *link = handle;
+
+    __wsp_writer_lru_push(worker, handle);
+    worker->handles++;
+
+    // counters are read by wsp_writer_stats while the worker runs.
+    pthread_mutex_lock(&worker->lock);
+
+    worker->opens++;
+    worker->evictions += evicted;
+
+    if (closed == WSP_ERROR) {
+        worker->close_failed++;
+        worker->last_error = close_e;
+    }
+
+    pthread_mutex_unlock(&worker->lock);
+
+    return handle;
+} // __wsp_writer_handle }}}
+
+// __wsp_writer_run {{{
+/*
+ * Apply a single job, returns the number of points that failed.
+ */
+static size_t __wsp_writer_run(
+    wsp_writer_worker_t *worker,
+    wsp_writer_job_t *job,
+    wsp_error_t *e
+)
+{
+    // flush request, pending rollups are written.
+    if (job->path == NULL) {
+        wsp_writer_handle_t *handle;
+
+        for (handle = worker->lru_head; handle != NULL; handle = handle->next) {
+            wsp_flush_rollups(&handle->w, e);
+        }
+
+        return 0;
+    }
+
+    wsp_writer_handle_t *handle = __wsp_writer_handle(worker, job->path, job->hash, e);
+
+    if (handle == NULL) {
+        return job->length;
+    }
+
+    if (wsp_update_many(&handle->w, job->points, job->length, e) == WSP_ERROR) {
+        return job->length;
+    }
+
+    return 0;
+} // __wsp_writer_run }}}
+
+// __wsp_writer_main {{{
+static void *__wsp_writer_main(
+    void *arg
+)
+{
+    wsp_writer_worker_t *worker = (wsp_writer_worker_t *)arg;
+
+    pthread_mutex_lock(&worker->lock);
+
+    while (1) {
+        while (worker->head == NULL && !worker->stop) {
+            pthread_cond_wait(&worker->work, &worker->lock);
+        }
+
+        if (worker->head == NULL) {
+            break;
+        }
+
+        // take the whole queue, submitters can keep going meanwhile.
+        wsp_writer_job_t *job = worker->head;
+        worker->head = NULL;
+        worker->tail = NULL;
+        worker->queued = 0;
+
+        pthread_cond_broadcast(&worker->done);
+        pthread_mutex_unlock(&worker->lock);
+
+        uint64_t completed = 0;
+        uint64_t written = 0;
+        uint64_t failed = 0;
+        wsp_error_t last_error;
+        WSP_ERROR_INIT(&last_error);
+
+        while (job != NULL) {
+            wsp_writer_job_t *next = job->next;
+
+            wsp_error_t job_e;
+            WSP_ERROR_INIT(&job_e);
+
+            size_t f = __wsp_writer_run(worker, job, &job_e);
+
+            if (f > 0) {
+                last_error = job_e;
+            }
+
+            failed += f;
+            written += job->length - f;
+            completed++;
+
+            // flush requests belong to wsp_writer_flush.
+            if (job->path != NULL) {
+                free(job);
+            }
+
+            job = next;
+        }
+
+        pthread_mutex_lock(&worker->lock);
+
+        worker->completed += completed;
+        worker->written += written;
+        worker->failed += failed;
+
+        if (failed > 0) {
+            worker->last_error = last_error;
+        }
+
+        pthread_cond_broadcast(&worker->done);
+    }
+
+    pthread_mutex_unlock(&worker->lock);
+
+    return NULL;
+} // __wsp_writer_main }}}
+
+// __wsp_writer_enqueue {{{
+/*
+ * Queue a job for a worker, returns the sequence number it completes at.
+ */
+static uint64_t __wsp_writer_enqueue(
+    wsp_writer_worker_t *worker,
+    wsp_writer_job_t *job
+)
+{
+    wsp_writer_t *wr = worker->writer;
+
+    pthread_mutex_lock(&worker->lock);
+
+    while (wr->max_queued != 0 && worker->queued >= wr->max_queued) {
+        pthread_cond_wait(&worker->done, &worker->lock);
+    }
+
+    if (worker->tail != NULL) {
+        worker->tail->next = job;
+    }
+    else {
+        worker->head = job;
+    }
+
+    worker->tail = job;
+    worker->queued += job->length;
+
+    uint64_t seq = ++worker->submitted;
+
+    pthread_cond_signal(&worker->work);
+    pthread_mutex_unlock(&worker->lock);
+
+    return seq;
+} // __wsp_writer_enqueue }}}
+
+// __wsp_writer_stop {{{
+/*
+ * Stop and join the first count workers, then release them. Every database
+ * is closed even if some fail to, the first failure is reported.
+ */
+static wsp_return_t __wsp_writer_stop(
+    wsp_writer_t *wr,
+    size_t count,
+    wsp_error_t *e
+)
+{
+    wsp_return_t result = WSP_OK;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        wsp_writer_worker_t *worker = wr->workers + i;
+
+        pthread_mutex_lock(&worker->lock);
+        worker->stop = 1;
+        pthread_cond_signal(&worker->work);
+        pthread_mutex_unlock(&worker->lock);
+
+        pthread_join(worker->thread, NULL);
+
+        while (worker->lru_head != NULL) {
+            wsp_error_t close_e;
+            WSP_ERROR_INIT(&close_e);
+
+            if (__wsp_writer_close_handle(worker, worker->lru_head, &close_e) == WSP_ERROR) {
+                if (result == WSP_OK) {
+                    *e = close_e;
+                }
+
+                result = WSP_ERROR;
+            }
+        }
+
+        free(worker->table);
+
+        pthread_mutex_destroy(&worker->lock);
+        pthread_cond_destroy(&worker->work);
+        pthread_cond_destroy(&worker->done);
+    }
+
+    free(wr->workers);
+    wr->workers = NULL;
+    wr->threads = 0;
+
+    return result;
+} // __wsp_writer_stop }}}
+
+// wsp_writer_open {{{
+wsp_return_t wsp_writer_open(
+    wsp_writer_t *wr,
+    size_t threads,
+    wsp_mapping_t mapping,
+    int flags,
+    wsp_error_t *e
+)
+{
+    if (wr->workers != NULL) {
+        e->type = WSP_ERROR_ALREADY_OPEN;
+        return WSP_ERROR;
+    }
+
+    // neither can be used from more than one thread.
+    if (mapping == WSP_URING || mapping == WSP_MEMORY) {
+        e->type = WSP_ERROR_IO_MODE;
+        return WSP_ERROR;
+    }
+
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    wr->workers = calloc(threads, sizeof(wsp_writer_worker_t));
+
+    if (wr->workers == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        return WSP_ERROR;
+    }
+
+    wr->mapping = mapping;
+    wr->flags = flags;
+
+    size_t i;
+
+    for (i = 0; i < threads; i++) {
+        wsp_writer_worker_t *worker = wr->workers + i;
+
+        worker->writer = wr;
+        WSP_ERROR_INIT(&worker->last_error);
+
+        worker->table = calloc(WSP_WRITER_TABLE_SIZE, sizeof(wsp_writer_handle_t *));
+
+        if (worker->table == NULL) {
+            e->type = WSP_ERROR_MALLOC;
+            __wsp_writer_stop(wr, i, e);
+            return WSP_ERROR;
+        }
+
+        worker->table_size = WSP_WRITER_TABLE_SIZE;
+
+        pthread_mutex_init(&worker->lock, NULL);
+        pthread_cond_init(&worker->work, NULL);
+        pthread_cond_init(&worker->done, NULL);
+
+        int r = pthread_create(&worker->thread, NULL, __wsp_writer_main, worker);
+
+        if (r != 0) {
+            free(worker->table);
+            pthread_mutex_destroy(&worker->lock);
+            pthread_cond_destroy(&worker->work);
+            pthread_cond_destroy(&worker->done);
+            e->type = WSP_ERROR_THREAD;
+            e->syserr = r;
+            __wsp_writer_stop(wr, i, e);
+            return WSP_ERROR;
+        }
+    }
+
+    wr->threads = threads;
+
+    return WSP_OK;
+} // wsp_writer_open }}}
+
+// wsp_writer_submit {{{
+wsp_return_t wsp_writer_submit(
+    wsp_writer_t *wr,
+    const char *path,
+    wsp_point_input_t *points,
+    size_t length,
+    wsp_error_t *e
+)
+{
+    if (wr->workers == NULL) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    if (length == 0) {
+        return WSP_OK;
+    }
+
+    size_t path_length = strlen(path);
+    size_t points_size = sizeof(wsp_point_input_t) * length;
+
+    // the job, its points and its path in a single allocation.
+    wsp_writer_job_t *job = malloc(sizeof(wsp_writer_job_t) + points_size + path_length + 1);
+
+    if (job == NULL) {
+        e->type = WSP_ERROR_MALLOC;
+        return WSP_ERROR;
+    }
+
+    job->points = (wsp_point_input_t *)(job + 1);
+    memcpy(job->points, points, points_size);
+
+    char *job_path = (char *)(job->points + length);
+    memcpy(job_path, path, path_length + 1);
+
+    job->path = job_path;
+    job->hash = __wsp_fnv1a(path, path_length);
+    job->length = length;
+    job->next = NULL;
+
+    __wsp_writer_enqueue(wr->workers + (job->hash % wr->threads), job);
+
+    return WSP_OK;
+} // wsp_writer_submit }}}
+
+// wsp_writer_flush {{{
+wsp_return_t wsp_writer_flush(
+    wsp_writer_t *wr,
+    wsp_error_t *e
+)
+{
+    if (wr->workers == NULL) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    wsp_writer_job_t *jobs = calloc(wr->threads, sizeof(wsp_writer_job_t));
+    uint64_t *seqs = malloc(sizeof(uint64_t) * wr->threads);
+
+    if (jobs == NULL || seqs == NULL) {
+        free(jobs);
+        free(seqs);
+        e->type = WSP_ERROR_MALLOC;
+        return WSP_ERROR;
+    }
+
+    size_t i;
+
+    // every worker works towards its barrier in parallel.
+    for (i = 0; i < wr->threads; i++) {
+        seqs[i] = __wsp_writer_enqueue(wr->workers + i, jobs + i);
+    }
+
+    for (i = 0; i < wr->threads; i++) {
+        wsp_writer_worker_t *worker = wr->workers + i;
+
+        pthread_mutex_lock(&worker->lock);
+
+        while (worker->completed < seqs[i]) {
+            pthread_cond_wait(&worker->done, &worker->lock);
+        }
+
+        pthread_mutex_unlock(&worker->lock);
+    }
+
+    free(seqs);
+    free(jobs);
+
+    return WSP_OK;
+} // wsp_writer_flush }}}
+
+// wsp_writer_stats {{{
+void wsp_writer_stats(
+    wsp_writer_t *wr,
+    wsp_writer_stats_t *stats
+)
+{
+    memset(stats, 0, sizeof(wsp_writer_stats_t));
+    WSP_ERROR_INIT(&stats->last_error);
+
+    size_t i;
+
+    for (i = 0; i < wr->threads; i++) {
+        wsp_writer_worker_t *worker = wr->workers + i;
+
+        pthread_mutex_lock(&worker->lock);
+
+        stats->queued += worker->queued;
+        stats->written += worker->written;
+        stats->failed += worker->failed;
+        stats->opens += worker->opens;
+        stats->evictions += worker->evictions;
+        stats->close_failed += worker->close_failed;
+
+        if (worker->last_error.type != WSP_ERROR_NONE) {
+            stats->last_error = worker->last_error;
+        }
+
+        pthread_mutex_unlock(&worker->lock);
+    }
+} // wsp_writer_stats }}}
+
+// wsp_writer_close {{{
+wsp_return_t wsp_writer_close(
+    wsp_writer_t *wr,
+    wsp_error_t *e
+)
+{
+    if (wr->workers == NULL) {
+        e->type = WSP_ERROR_NOT_OPEN;
+        return WSP_ERROR;
+    }
+
+    // workers drain their queues before they stop.
+    return __wsp_writer_stop(wr, wr->threads, e);
+} // wsp_writer_close }}}
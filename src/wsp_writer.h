@@ -0,0 +1,209 @@
+// vim: foldmethod=marker
+/**
+ * Multi-threaded writer with per-file affinity.
+ *
+ * The writer runs a number of worker threads, every database path is owned
+ * by exactly one of them, picked by hashing the path. Each worker has its own
+ * queue and its own cache of open handles, so updates to a database are
+ * applied in the order they were submitted without any locking around the
+ * database itself.
+ *
+ * Points are copied when they are submitted, the caller can reuse its buffer
+ * right away. Points which cannot be written are dropped, they are counted in
+ * failed and the error is kept in last_error of the stats.
+ *
+ * Example:
+ *
+ *   wsp_writer_t wr;
+ *   WSP_WRITER_INIT(&wr);
+ *
+ *   wr.max_handles = 4096;
+ *
+ *   if (wsp_writer_open(&wr, 8, WSP_MMAP, 0, &e) == WSP_ERROR) {
+ *       ...
+ *   }
+ *
+ *   wsp_writer_submit(&wr, "/data/a/b.wsp", points, length, &e);
+ *   ...
+ *   wsp_writer_close(&wr, &e);
+ */
+#ifndef _WSP_WRITER_H_
+#define _WSP_WRITER_H_
+
+#include <pthread.h>
+
+#include "wsp.h"
+
+/**
+ * Number of handles every worker keeps open unless configured otherwise.
+ */
+#define WSP_WRITER_DEFAULT_HANDLES 1024
+
+typedef struct wsp_writer_t wsp_writer_t;
+typedef struct wsp_writer_job_t wsp_writer_job_t;
+typedef struct wsp_writer_handle_t wsp_writer_handle_t;
+
+struct wsp_writer_job_t {
+    // NULL for a flush request.
+    const char *path;
+    uint32_t hash;
+    wsp_point_input_t *points;
+    size_t length;
+    wsp_writer_job_t *next;
+};
+
+struct wsp_writer_handle_t {
+    uint32_t hash;
+    wsp_t w;
+    /* lru list, most recently used first */
+    wsp_writer_handle_t *prev;
+    wsp_writer_handle_t *next;
+    /* hash chain */
+    wsp_writer_handle_t *chain;
+    char path[];
+};
+
+typedef struct {
+    wsp_writer_t *writer;
+    pthread_t thread;
+    // protects everything up to the handle cache.
+    pthread_mutex_t lock;
+    // signalled when jobs are queued or the worker should stop.
+    pthread_cond_t work;
+    // signalled when the worker has taken or completed jobs.
+    pthread_cond_t done;
+    wsp_writer_job_t *head;
+    wsp_writer_job_t *tail;
+    // number of points in the queue.
+    size_t queued;
+    // jobs submitted to and completed by the worker.
+    uint64_t submitted;
+    uint64_t completed;
+    int stop;
+    /* statistics */
+    uint64_t written;
+    uint64_t failed;
+    uint64_t opens;
+    uint64_t evictions;
+    uint64_t close_failed;
+    wsp_error_t last_error;
+    /* handle cache, only touched by the worker */
+    wsp_writer_handle_t **table;
+    size_t table_size;
+    size_t handles;
+    wsp_writer_handle_t *lru_head;
+    wsp_writer_handle_t *lru_tail;
+} wsp_writer_worker_t;
+
+struct wsp_writer_t {
+    wsp_writer_worker_t *workers;
+    size_t threads;
+    // mapping and extra flags used when opening databases.
+    wsp_mapping_t mapping;
+    int flags;
+    /* policies */
+    // open handles kept by every worker, the least recently used one is
+    // closed when a worker needs another.
+    size_t max_handles;
+    // points queued for a single worker before wsp_writer_submit blocks,
+    // 0 never blocks.
+    size_t max_queued;
+};
+
+#define WSP_WRITER_INIT(wr) do {\
+    (wr)->workers = NULL;\
+    (wr)->threads = 0;\
+    (wr)->mapping = WSP_MAPPING_NONE;\
+    (wr)->flags = 0;\
+    (wr)->max_handles = WSP_WRITER_DEFAULT_HANDLES;\
+    (wr)->max_queued = 0;\
+} while(0)
+
+/**
+ * Counters of a writer, summed over all workers.
+ */
+typedef struct {
+    // points waiting to be written.
+    size_t queued;
+    // points written to their database.
+    uint64_t written;
+    // points dropped because they could not be written.
+    uint64_t failed;
+    // databases opened, and closed to make room for others.
+    uint64_t opens;
+    uint64_t evictions;
+    // evicted databases which failed to close, pending rollups or a sync of
+    // them might be lost.
+    uint64_t close_failed;
+    // the most recent error of any worker.
+    wsp_error_t last_error;
+} wsp_writer_stats_t;
+
+/**
+ * Start the worker threads of a writer.
+ *
+ * wr: Writer, should have been initialized using WSP_WRITER_INIT.
+ * threads: Number of worker threads, at least one.
+ * mapping: The mapping to use when writing to databases, any but WSP_URING
+ *          and WSP_MEMORY which are not thread safe.
+ * flags: Extra open flags, WSP_READ and WSP_WRITE are always set.
+ * e: Error object.
+ */
+wsp_return_t wsp_writer_open(
+    wsp_writer_t *wr,
+    size_t threads,
+    wsp_mapping_t mapping,
+    int flags,
+    wsp_error_t *e
+);
+
+/**
+ * Queue points for a single database, they are written through
+ * wsp_update_many by the worker which owns path.
+ *
+ * Safe to call from any number of threads.
+ *
+ * wr: Writer.
+ * path: Path of the database the points belong to.
+ * points: Points to write, copied before returning.
+ * length: Number of points.
+ * e: Error object.
+ */
+wsp_return_t wsp_writer_submit(
+    wsp_writer_t *wr,
+    const char *path,
+    wsp_point_input_t *points,
+    size_t length,
+    wsp_error_t *e
+);
+
+/**
+ * Wait until everything submitted before the call has been written, pending
+ * rollups of WSP_LAZY databases included.
+ */
+wsp_return_t wsp_writer_flush(
+    wsp_writer_t *wr,
+    wsp_error_t *e
+);
+
+/**
+ * Sum up the counters of every worker.
+ */
+void wsp_writer_stats(
+    wsp_writer_t *wr,
+    wsp_writer_stats_t *stats
+);
+
+/**
+ * Write everything that is queued, stop the workers and close every
+ * database they hold open.
+ *
+ * Every database is closed even if some fail to, the error of the first one
+ * which failed is reported. Pending rollups or a sync of it might be lost.
+ */
+wsp_return_t wsp_writer_close(
+    wsp_writer_t *wr,
+    wsp_error_t *e
+);
+
+#endif /* _WSP_WRITER_H_ */
@@ -0,0 +1,303 @@
+#include <check.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "../src/wsp.h"
+#include "../src/wsp_cache.h"
+#include "../src/wsp_memfs.h"
+
+#include "check_utils.h"
+
+wsp_mapping_t m = WSP_MEMORY;
+wsp_aggregation_t a = WSP_AVERAGE;
+float xff = 0.5;
+
+wsp_time_t t;
+
+void setup()
+{
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 100 },
+        { .spp = 20, .count = 100 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    ck_assert_int_eq(
+        WSP_OK, wsp_create("c1", archives, 2, a, xff, m, &e)
+    );
+
+    ck_assert_int_eq(
+        WSP_OK, wsp_create("c2", archives, 2, a, xff, m, &e)
+    );
+
+    t = wsp_time_floor(wsp_time_now(), 20) - 100;
+}
+
+void teardown()
+{
+}
+
+static void fetch_first(const char *path, wsp_point_t *p)
+{
+    wsp_t w;
+    WSP_INIT(&w);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+    uint32_t s;
+
+    r = wsp_open(&w, path, m, WSP_READ, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_fetch_time_points(&w, w.archives, t, t + 10, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 2);
+
+    wsp_close(&w, &e);
+}
+
+START_TEST(test_cache_flush)
+{
+    wsp_cache_t c;
+    WSP_CACHE_INIT(&c);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    c.max_points_per_metric = 2;
+
+    r = wsp_cache_open(&c, m, 0, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input1[] = { { .timestamp = t, .value = 1.0 } };
+    wsp_point_input_t input2[] = { { .timestamp = t + 10, .value = 2.0 } };
+
+    r = wsp_cache_add(&c, "c1", input1, 1, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_cache_add(&c, "c2", input1, 1, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    ck_assert_int_eq(c.metrics, 2);
+    ck_assert_int_eq(c.points, 2);
+
+    wsp_point_t p[2];
+
+    fetch_first("c1", p);
+    ck_assert(isnan(p[0].value) && isnan(p[1].value));
+
+    // reaches max_points_per_metric.
+    r = wsp_cache_add(&c, "c1", input2, 1, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    ck_assert_int_eq(c.metrics, 1);
+    ck_assert_int_eq(c.points, 1);
+    ck_assert_int_eq(c.flushes, 1);
+    ck_assert_int_eq(c.flushed_points, 2);
+
+    fetch_first("c1", p);
+    ck_assert(p[0].timestamp == t && p[0].value == 1.0);
+    ck_assert(p[1].timestamp == t + 10 && p[1].value == 2.0);
+
+    fetch_first("c2", p);
+    ck_assert(isnan(p[0].value));
+
+    r = wsp_cache_close(&c, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(c.flushes, 2);
+    ck_assert_int_eq(c.failed, 0);
+
+    fetch_first("c2", p);
+    ck_assert(p[0].timestamp == t && p[0].value == 1.0);
+}
+END_TEST
+
+START_TEST(test_cache_fetch)
+{
+    wsp_cache_t c;
+    WSP_CACHE_INIT(&c);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_cache_open(&c, m, 0, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input[] = {
+        { .timestamp = t + 10, .value = 2.0 },
+        { .timestamp = t + 12, .value = 3.0 },
+        { .timestamp = t + 40, .value = 4.0 }
+    };
+
+    r = wsp_cache_add(&c, "c1", input, 3, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_t w;
+    WSP_INIT(&w);
+
+    r = wsp_open(&w, "c1", m, WSP_READ, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_t p[2];
+    uint32_t s;
+
+    r = wsp_cache_fetch_time_points(&c, "c1", &w, w.archives, t, t + 10, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 2);
+
+    ck_assert(isnan(p[0].value));
+    // the last cached point for the slot wins.
+    ck_assert(p[1].timestamp == t + 10 && p[1].value == 3.0);
+
+    wsp_close(&w, &e);
+
+    // nothing flushed, the cache is still holding everything.
+    ck_assert_int_eq(c.flushes, 0);
+
+    r = wsp_cache_flush_metric(&c, "c1", &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(c.metrics, 0);
+    ck_assert_int_eq(c.points, 0);
+
+    fetch_first("c1", p);
+    ck_assert(p[1].timestamp == t + 10 && p[1].value == 3.0);
+
+    r = wsp_cache_close(&c, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+START_TEST(test_cache_invalid)
+{
+    wsp_cache_t c;
+    WSP_CACHE_INIT(&c);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_cache_open(&c, m, 0, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input[] = {
+        { .timestamp = t, .value = 1.0 },
+        { .timestamp = t + 100000, .value = 2.0 },
+        { .timestamp = t - 100000, .value = 3.0 },
+        { .timestamp = t + 10, .value = 4.0 }
+    };
+
+    r = wsp_cache_add(&c, "c1", input, 4, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_cache_flush(&c, 0, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    // only the invalid points are dropped.
+    ck_assert_int_eq(c.flushes, 1);
+    ck_assert_int_eq(c.flushed_points, 2);
+    ck_assert_int_eq(c.failed, 2);
+    ck_assert_int_eq(c.last_error.type, WSP_ERROR_RETENTION);
+
+    wsp_point_t p[2];
+
+    fetch_first("c1", p);
+    ck_assert(p[0].timestamp == t && p[0].value == 1.0);
+    ck_assert(p[1].timestamp == t + 10 && p[1].value == 4.0);
+
+    r = wsp_cache_close(&c, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+/*
+ * A full cache is flushed down to its low water mark, metrics which can not
+ * be written are counted but only reported by explicit flushes.
+ */
+START_TEST(test_cache_full)
+{
+    wsp_cache_t c;
+    WSP_CACHE_INIT(&c);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    c.max_points = 100;
+
+    r = wsp_cache_open(&c, m, 0, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input[] = { { .timestamp = t, .value = 1.0 } };
+
+    r = wsp_cache_add(&c, "c1", input, 1, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    char path[32];
+    int i;
+
+    // none of these databases exist.
+    for (i = 0; i < 100; i++) {
+        snprintf(path, sizeof(path), "missing%d", i);
+
+        r = wsp_cache_add(&c, path, input, 1, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    }
+
+    ck_assert_int_eq(c.points, 90);
+    ck_assert_int_eq(c.metrics, 90);
+    ck_assert_int_eq(c.failed + c.flushed_points, 11);
+
+    // every metric is written even though some fail.
+    r = wsp_cache_flush(&c, 0, &e);
+    ck_assert_int_eq(r, WSP_ERROR);
+    ck_assert_int_eq(e.type, WSP_ERROR_IO);
+    ck_assert_int_eq(c.metrics, 0);
+    ck_assert_int_eq(c.failed, 100);
+    ck_assert_int_eq(c.flushed_points, 1);
+
+    wsp_point_t p[2];
+
+    fetch_first("c1", p);
+    ck_assert(p[0].timestamp == t && p[0].value == 1.0);
+
+    WSP_ERROR_INIT(&e);
+
+    r = wsp_cache_close(&c, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+Suite *
+test_suite_main() {
+    Suite *s = suite_create("main");
+    TCase *tc_core = tcase_create("Whisper cache");
+
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, test_cache_flush);
+    tcase_add_test(tc_core, test_cache_fetch);
+    tcase_add_test(tc_core, test_cache_invalid);
+    tcase_add_test(tc_core, test_cache_full);
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main() {
+    Suite *s = test_suite_main();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}
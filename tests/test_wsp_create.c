@@ -1,7 +1,10 @@
 #include <check.h>
+#include <string.h>
 
 #include "../src/wsp.h"
 #include "../src/wsp_memfs.h"
+#include "../src/wsp_io_memory.h"
+#include "../src/wsp_buffer.h"
 
 #include "check_utils.h"
 
@@ -86,6 +89,37 @@ START_TEST(test_decreasing_retention)
 }
 END_TEST
 
+START_TEST(test_overlapping_archives)
+{
+    wsp_archive_input_t archives[] = {
+        { .spp = 60, .count = 10 },
+        { .spp = 120, .count = 10 }
+    };
+
+    size_t archive_count = sizeof(archives) / sizeof(wsp_archive_input_t);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    ck_assert_int_eq(
+        WSP_OK, wsp_create("a5", archives, archive_count, a, xff, m, &e)
+    );
+
+    wsp_memfs_t *mf = wsp_memfs_find(&memfs_ctx, "a5");
+    ck_assert(mf != NULL);
+
+    // point the second archive at the first one.
+    wsp_archive_b *table = (wsp_archive_b *)((char *)mf->memory + sizeof(wsp_metadata_b));
+    memcpy(table[1].offset, table[0].offset, sizeof(table[0].offset));
+
+    wsp_t w;
+    WSP_INIT(&w);
+
+    ck_assert_int_eq(WSP_ERROR, wsp_open(&w, "a5", m, WSP_READ, &e));
+    ck_assert_int_eq(WSP_ERROR_ARCHIVE, e.type);
+}
+END_TEST
+
 Suite *
 test_suite_main() {
     Suite *s = suite_create("main");
@@ -95,6 +129,7 @@ test_suite_main() {
     tcase_add_test(tc_core, test_empty_archive_2);
     tcase_add_test(tc_core, test_write_and_read_back);
     tcase_add_test(tc_core, test_decreasing_retention);
+    tcase_add_test(tc_core, test_overlapping_archives);
 
     suite_add_tcase(s, tc_core);
     return s;
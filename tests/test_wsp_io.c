@@ -0,0 +1,1475 @@
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "../src/wsp.h"
+#include "../src/wsp_buffer.h"
+#include "../src/wsp_io_mmap.h"
+#include "../src/wsp_io_uring.h"
+#include "../src/wsp_block_cache.h"
+
+#include "check_utils.h"
+
+wsp_aggregation_t a = WSP_AVERAGE;
+float xff = 0.5;
+
+char dir[] = "/tmp/wsp_io_XXXXXX";
+char db[256];
+char db2[256];
+
+void setup()
+{
+    ck_assert(mkdtemp(dir) != NULL);
+    snprintf(db, sizeof(db), "%s/io1", dir);
+    snprintf(db2, sizeof(db2), "%s/io2", dir);
+}
+
+void teardown()
+{
+    unlink(db);
+    unlink(db2);
+    rmdir(dir);
+    snprintf(dir, sizeof(dir), "/tmp/wsp_io_XXXXXX");
+}
+
+/*
+ * Create a database with the given mapping, write a batch of points and read
+ * them back.
+ */
+static void check_mapping(wsp_mapping_t m)
+{
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 100 },
+        { .spp = 20, .count = 100 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_create(db, archives, 2, a, xff, m, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_t w;
+    WSP_INIT(&w);
+
+    r = wsp_open(&w, db, m, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(w.archives_count, 2);
+
+    wsp_point_input_t input[] = {
+        { .timestamp = 900, .value = 1.0 },
+        { .timestamp = 910, .value = 2.0 },
+        { .timestamp = 920, .value = 3.0 }
+    };
+
+    r = wsp_update_many_now(&w, input, 3, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_close(&w, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_open(&w, db, m, WSP_READ, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_t p[3];
+    uint32_t s;
+
+    r = wsp_fetch_time_points(&w, w.archives, 900, 920, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 3);
+    ck_assert(p[0].timestamp == 900 && p[0].value == 1.0);
+    ck_assert(p[1].timestamp == 910 && p[1].value == 2.0);
+    ck_assert(p[2].timestamp == 920 && p[2].value == 3.0);
+
+    r = wsp_fetch_time_points(&w, w.archives + 1, 900, 900, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert(p[0].timestamp == 900 && p[0].value == 1.5);
+
+    r = wsp_close(&w, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+
+/*
+ * Write points which wrap around the end of the archive, so that both reads
+ * and writes are split in two ranges.
+ */
+static void check_wrap(wsp_mapping_t m)
+{
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 10 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_create(db, archives, 1, a, xff, m, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_t w;
+    WSP_INIT(&w);
+
+    r = wsp_open(&w, db, m, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input[6];
+    int i;
+
+    // the base ends up at slot 0 and the batch starts at slot 7.
+    input[0].timestamp = 1000;
+    input[0].value = 0;
+
+    r = wsp_update_now(&w, input, 1050, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    for (i = 0; i < 6; i++) {
+        input[i].timestamp = 1070 + i * 10;
+        input[i].value = i + 1;
+    }
+
+    r = wsp_update_many_now(&w, input, 6, 1120, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_t p[6];
+    uint32_t s;
+
+    r = wsp_fetch_time_points(&w, w.archives, 1070, 1120, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 6);
+
+    for (i = 0; i < 6; i++) {
+        ck_assert(p[i].timestamp == 1070 + i * 10 && p[i].value == i + 1);
+    }
+
+    r = wsp_close(&w, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    unlink(db);
+}
+
+START_TEST(test_io_mmap)
+{
+    check_mapping(WSP_MMAP);
+}
+END_TEST
+
+START_TEST(test_io_mmap_windowed)
+{
+    // a bit over three windows worth of points.
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 300000 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_create(db, archives, 1, a, xff, WSP_MMAP, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_t w;
+    WSP_INIT(&w);
+
+    r = wsp_open(&w, db, WSP_MMAP, WSP_READ | WSP_WRITE | WSP_WINDOWED, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_io_mmap_inst_t *self = (wsp_io_mmap_inst_t *)w.io_instance;
+
+    // only the header has been touched.
+    ck_assert(self->map == NULL);
+    ck_assert_int_eq(self->maps, 1);
+
+    wsp_point_input_t input[] = {
+        { .timestamp = 1000000, .value = 1.0 },
+        { .timestamp = 1000010, .value = 2.0 }
+    };
+
+    r = wsp_update_many_now(&w, input, 2, 1000020, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_t p[2];
+    uint32_t s;
+
+    r = wsp_fetch_time_points(&w, w.archives, 1000000, 1000010, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 2);
+    ck_assert(p[0].timestamp == 1000000 && p[0].value == 1.0);
+    ck_assert(p[1].timestamp == 1000010 && p[1].value == 2.0);
+
+    ck_assert(self->maps <= WSP_MMAP_WINDOWS);
+
+    r = wsp_close(&w, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    // written through the windows.
+    r = wsp_open(&w, db, WSP_MMAP, WSP_READ, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_fetch_time_points(&w, w.archives, 1000000, 1000010, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert(p[0].timestamp == 1000000 && p[0].value == 1.0);
+    ck_assert(p[1].timestamp == 1000010 && p[1].value == 2.0);
+
+    r = wsp_close(&w, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+START_TEST(test_io_pread)
+{
+    check_mapping(WSP_PREAD);
+}
+END_TEST
+
+START_TEST(test_io_direct)
+{
+    check_mapping(WSP_DIRECT);
+
+    wsp_block_cache_stats_t stats;
+    wsp_block_cache_stats(&stats);
+    ck_assert(stats.hits > 0);
+}
+END_TEST
+
+START_TEST(test_io_direct_budget)
+{
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 10000 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    // a single block for every shard.
+    r = wsp_block_cache_set_size(WSP_BLOCK_CACHE_SHARDS * WSP_BLOCK_SIZE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_create(db, archives, 1, a, xff, WSP_DIRECT, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_t w;
+    WSP_INIT(&w);
+
+    r = wsp_open(&w, db, WSP_DIRECT, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    // spans every block of the file.
+    static wsp_point_input_t input[10000];
+    int i;
+
+    for (i = 0; i < 10000; i++) {
+        input[i].timestamp = 1000 + i * 10;
+        input[i].value = i;
+    }
+
+    r = wsp_update_many_now(&w, input, 10000, 100990, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_block_cache_stats_t stats;
+    wsp_block_cache_stats(&stats);
+    ck_assert(stats.count <= WSP_BLOCK_CACHE_SHARDS);
+    ck_assert(stats.evictions > 0);
+
+    static wsp_point_t p[10000];
+    uint32_t s;
+
+    r = wsp_fetch_time_points(&w, w.archives, 1000, 100990, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 10000);
+
+    for (i = 0; i < 10000; i++) {
+        ck_assert(p[i].timestamp == 1000 + i * 10 && p[i].value == i);
+    }
+
+    wsp_close(&w, &e);
+
+    wsp_block_cache_free();
+
+    r = wsp_block_cache_set_size(WSP_BLOCK_CACHE_DEFAULT_SIZE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+START_TEST(test_io_cached)
+{
+    wsp_mapping_t mappings[] = {
+        WSP_FILE, WSP_PREAD
+    };
+
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 1000 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+    size_t i;
+
+    for (i = 0; i < sizeof(mappings) / sizeof(mappings[0]); i++) {
+        wsp_block_cache_free();
+
+        r = wsp_create(db, archives, 1, a, xff, WSP_MMAP, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_t w;
+        WSP_INIT(&w);
+
+        r = wsp_open(&w, db, mappings[i], WSP_READ | WSP_WRITE | WSP_CACHED, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_point_input_t input[] = {
+            { .timestamp = 1000000, .value = 1.0 },
+            { .timestamp = 1000010, .value = 2.0 }
+        };
+
+        r = wsp_update_many_now(&w, input, 2, 1000010, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_block_cache_stats_t before;
+        wsp_block_cache_stats(&before);
+
+        /*
+         * opening while the writer is still open is served from the cache,
+         * including the written points.
+         */
+        wsp_t reader;
+        WSP_INIT(&reader);
+
+        r = wsp_open(&reader, db, mappings[i], WSP_READ | WSP_CACHED, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_point_t p[2];
+        uint32_t s;
+
+        r = wsp_fetch_time_points(&reader, reader.archives, 1000000, 1000010, p, &s, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+        ck_assert_int_eq(s, 2);
+        ck_assert(p[0].timestamp == 1000000 && p[0].value == 1.0);
+        ck_assert(p[1].timestamp == 1000010 && p[1].value == 2.0);
+
+        r = wsp_close(&reader, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_close(&w, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_block_cache_stats_t after;
+        wsp_block_cache_stats(&after);
+        ck_assert(after.hits > before.hits);
+        ck_assert(after.misses == before.misses);
+    }
+
+    wsp_block_cache_free();
+}
+END_TEST
+
+/*
+ * Writes made by another process between opens must not be hidden by blocks
+ * cached before them.
+ */
+START_TEST(test_io_cached_external)
+{
+    wsp_mapping_t mappings[] = {
+        WSP_FILE, WSP_PREAD, WSP_DIRECT
+    };
+
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 1000 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+    size_t i;
+
+    for (i = 0; i < sizeof(mappings) / sizeof(mappings[0]); i++) {
+        wsp_block_cache_free();
+        unlink(db);
+
+        r = wsp_create(db, archives, 1, a, xff, WSP_MMAP, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_t w;
+        WSP_INIT(&w);
+
+        wsp_point_input_t input[] = {
+            { .timestamp = 1000000, .value = 1.0 },
+            { .timestamp = 1000000, .value = 2.0 }
+        };
+
+        r = wsp_open(&w, db, mappings[i], WSP_READ | WSP_WRITE | WSP_CACHED, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_update_now(&w, input, 1000010, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_close(&w, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        // make sure the modification time moves on.
+        struct timespec delay = { .tv_sec = 0, .tv_nsec = 50000000 };
+        nanosleep(&delay, NULL);
+
+        // written like another process would, without the cache.
+        r = wsp_open(&w, db, WSP_PREAD, WSP_READ | WSP_WRITE, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_update_now(&w, input + 1, 1000010, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_close(&w, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_open(&w, db, mappings[i], WSP_READ | WSP_CACHED, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_point_t p;
+        uint32_t s;
+
+        r = wsp_fetch_time_points(&w, w.archives, 1000000, 1000000, &p, &s, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+        ck_assert_int_eq(s, 1);
+        ck_assert_msg(p.timestamp == 1000000 && p.value == 2.0, "mapping %zu", i);
+
+        r = wsp_close(&w, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    }
+
+    wsp_block_cache_free();
+}
+END_TEST
+
+/*
+ * Read the first point of a database through a cached handle.
+ */
+static void cached_read(const char *path)
+{
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    wsp_t w;
+    WSP_INIT(&w);
+
+    r = wsp_open(&w, path, WSP_PREAD, WSP_READ | WSP_CACHED, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_t p;
+
+    r = wsp_load_points(&w, w.archives, 0, 1, &p, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_close(&w, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+
+/*
+ * Files are only remembered while they have cached blocks, and invalidating
+ * one file leaves the blocks of others alone.
+ */
+START_TEST(test_io_cached_files)
+{
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 1000 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+    int i;
+
+    wsp_block_cache_free();
+
+    r = wsp_create(db, archives, 1, a, xff, WSP_PREAD, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_create(db2, archives, 1, a, xff, WSP_PREAD, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    cached_read(db);
+    cached_read(db2);
+
+    wsp_block_cache_stats_t stats;
+    wsp_block_cache_stats(&stats);
+    ck_assert_int_eq(stats.files, 2);
+
+    struct stat st;
+    ck_assert(stat(db, &st) == 0);
+    __wsp_block_cache_invalidate(st.st_dev, st.st_ino);
+
+    wsp_block_cache_stats_t before;
+    wsp_block_cache_stats(&before);
+    ck_assert_int_eq(before.files, 1);
+
+    cached_read(db2);
+
+    wsp_block_cache_stats_t after;
+    wsp_block_cache_stats(&after);
+    ck_assert(after.hits > before.hits);
+    ck_assert(after.misses == before.misses);
+
+    // a single block for every shard, every new file evicts older ones.
+    r = wsp_block_cache_set_size(WSP_BLOCK_CACHE_SHARDS * WSP_BLOCK_SIZE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    for (i = 0; i < 200; i++) {
+        unlink(db);
+
+        r = wsp_create(db, archives, 1, a, xff, WSP_PREAD, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        cached_read(db);
+    }
+
+    wsp_block_cache_stats(&stats);
+    ck_assert(stats.files <= stats.count);
+
+    wsp_block_cache_free();
+
+    wsp_block_cache_stats(&stats);
+    ck_assert_int_eq(stats.files, 0);
+
+    r = wsp_block_cache_set_size(WSP_BLOCK_CACHE_DEFAULT_SIZE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+typedef struct {
+    wsp_t *w;
+    int done;
+    int torn;
+} concurrent_t;
+
+static void *concurrent_reader(void *arg)
+{
+    concurrent_t *c = (concurrent_t *)arg;
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    while (!__atomic_load_n(&c->done, __ATOMIC_ACQUIRE)) {
+        wsp_point_t p[4];
+        uint32_t s;
+
+        if (wsp_fetch_time_points(c->w, c->w->archives, 1000000, 1000030, p, &s, &e) == WSP_ERROR) {
+            __atomic_store_n(&c->torn, 1, __ATOMIC_RELAXED);
+            break;
+        }
+
+        // every update writes the same value to all four points.
+        if (p[0].value != p[1].value || p[0].value != p[2].value || p[0].value != p[3].value) {
+            __atomic_store_n(&c->torn, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    return NULL;
+}
+
+START_TEST(test_io_concurrent)
+{
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 1000 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_create(db, archives, 1, a, xff, WSP_MMAP, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_t w;
+    WSP_INIT(&w);
+
+    // readers must not touch the handle.
+    r = wsp_open(&w, db, WSP_PREAD, WSP_READ | WSP_WRITE | WSP_CONCURRENT, &e);
+    ck_assert(r==WSP_ERROR && e.type == WSP_ERROR_IO_MODE);
+
+    r = wsp_open(&w, db, WSP_MMAP, WSP_READ | WSP_WRITE | WSP_CONCURRENT, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input[4];
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        input[i].timestamp = 1000000 + i * 10;
+        input[i].value = 0;
+    }
+
+    r = wsp_update_many_now(&w, input, 4, 1000030, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    concurrent_t c = { .w = &w, .done = 0, .torn = 0 };
+    pthread_t readers[2];
+
+    for (i = 0; i < 2; i++) {
+        ck_assert(pthread_create(readers + i, NULL, concurrent_reader, &c) == 0);
+    }
+
+    int n;
+
+    for (n = 1; n <= 20000; n++) {
+        for (i = 0; i < 4; i++) {
+            input[i].value = n;
+        }
+
+        r = wsp_update_many_now(&w, input, 4, 1000030, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    }
+
+    __atomic_store_n(&c.done, 1, __ATOMIC_RELEASE);
+
+    for (i = 0; i < 2; i++) {
+        pthread_join(readers[i], NULL);
+    }
+
+    ck_assert(!c.torn);
+
+    ck_assert(w.seq % 2 == 0);
+
+    r = wsp_close(&w, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+/*
+ * Check if another open file description can take the lock.
+ */
+static int is_locked(const char *path)
+{
+    int fn = open(path, O_RDONLY);
+    ck_assert(fn != -1);
+
+    int locked = flock(fn, LOCK_EX | LOCK_NB) == -1 && errno == EWOULDBLOCK;
+
+    close(fn);
+    return locked;
+}
+
+START_TEST(test_io_lock)
+{
+    wsp_mapping_t mappings[] = {
+        WSP_MMAP, WSP_FILE, WSP_PREAD, WSP_DIRECT
+    };
+
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 1000 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+    size_t i;
+
+    for (i = 0; i < sizeof(mappings) / sizeof(mappings[0]); i++) {
+        r = wsp_create(db, archives, 1, a, xff, WSP_MMAP, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_t w;
+        WSP_INIT(&w);
+
+        r = wsp_open(&w, db, mappings[i], WSP_READ | WSP_WRITE | WSP_LOCK, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        // unbalanced.
+        r = wsp_unlock(&w, &e);
+        ck_assert(r==WSP_ERROR && e.type == WSP_ERROR_LOCK);
+
+        r = wsp_lock(&w, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+        ck_assert(is_locked(db));
+
+        r = wsp_lock(&w, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_point_input_t input[] = {
+            { .timestamp = 1000000, .value = 1.0 },
+            { .timestamp = 1000010, .value = 2.0 }
+        };
+
+        // taken and released within the held lock.
+        r = wsp_update_many_now(&w, input, 2, 1000010, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+        ck_assert(is_locked(db));
+
+        r = wsp_unlock(&w, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+        ck_assert(is_locked(db));
+
+        r = wsp_unlock(&w, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+        ck_assert(!is_locked(db));
+
+        // locked on its own and released afterwards.
+        r = wsp_update_now(&w, input, 1000010, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+        ck_assert(!is_locked(db));
+
+        wsp_point_t p[2];
+        uint32_t s;
+
+        r = wsp_fetch_time_points(&w, w.archives, 1000000, 1000010, p, &s, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+        ck_assert_int_eq(s, 2);
+        ck_assert(p[0].timestamp == 1000000 && p[0].value == 1.0);
+        ck_assert(p[1].timestamp == 1000010 && p[1].value == 2.0);
+
+        r = wsp_close(&w, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    }
+}
+END_TEST
+
+/*
+ * Points written by another handle while unlocked must not be lost by a
+ * locked handle which has read the file before.
+ */
+START_TEST(test_io_lock_shared)
+{
+    wsp_mapping_t mappings[] = {
+        WSP_MMAP, WSP_FILE, WSP_FILE, WSP_PREAD, WSP_PREAD, WSP_DIRECT
+    };
+
+    int flags[] = {
+        0, 0, WSP_CACHED, 0, WSP_CACHED, 0
+    };
+
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 1000 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+    size_t i;
+
+    for (i = 0; i < sizeof(mappings) / sizeof(mappings[0]); i++) {
+        unlink(db);
+
+        r = wsp_create(db, archives, 1, a, xff, WSP_MMAP, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_t w1, w2;
+        WSP_INIT(&w1);
+        WSP_INIT(&w2);
+
+        r = wsp_open(&w1, db, mappings[i], WSP_READ | WSP_WRITE | WSP_LOCK | flags[i], &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        // buffers or caches the base points.
+        r = wsp_lock(&w1, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_unlock(&w1, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        // make sure the modification time moves on.
+        struct timespec delay = { .tv_sec = 0, .tv_nsec = 50000000 };
+        nanosleep(&delay, NULL);
+
+        r = wsp_open(&w2, db, WSP_MMAP, WSP_READ | WSP_WRITE | WSP_LOCK, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_point_input_t input[] = {
+            { .timestamp = 1000000, .value = 1.0 },
+            { .timestamp = 1000010, .value = 2.0 },
+            { .timestamp = 1000020, .value = 3.0 }
+        };
+
+        r = wsp_update_many_now(&w2, input, 2, 1000020, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_update_now(&w1, input + 2, 1000020, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_close(&w1, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_point_t p[3];
+        uint32_t s;
+
+        r = wsp_fetch_time_points(&w2, w2.archives, 1000000, 1000020, p, &s, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+        ck_assert_int_eq(s, 3);
+        ck_assert_msg(p[0].timestamp == 1000000 && p[0].value == 1.0, "mapping %zu", i);
+        ck_assert_msg(p[1].timestamp == 1000010 && p[1].value == 2.0, "mapping %zu", i);
+        ck_assert_msg(p[2].timestamp == 1000020 && p[2].value == 3.0, "mapping %zu", i);
+
+        r = wsp_close(&w2, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    }
+}
+END_TEST
+
+/*
+ * Blocks cached by a locked handle are kept across locks as long as nobody
+ * else writes to the file.
+ */
+START_TEST(test_io_lock_cached)
+{
+    wsp_mapping_t mappings[] = {
+        WSP_FILE, WSP_PREAD, WSP_DIRECT
+    };
+
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 1000 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+    size_t i;
+
+    for (i = 0; i < sizeof(mappings) / sizeof(mappings[0]); i++) {
+        wsp_block_cache_free();
+        unlink(db);
+
+        r = wsp_create(db, archives, 1, a, xff, WSP_MMAP, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_t w;
+        WSP_INIT(&w);
+
+        r = wsp_open(&w, db, mappings[i], WSP_READ | WSP_WRITE | WSP_LOCK | WSP_CACHED, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_point_input_t input[] = {
+            { .timestamp = 1000000, .value = 1.0 },
+            { .timestamp = 1000010, .value = 2.0 }
+        };
+
+        r = wsp_update_many_now(&w, input, 2, 1000010, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_block_cache_stats_t before;
+        wsp_block_cache_stats(&before);
+
+        r = wsp_lock(&w, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_point_t p[2];
+        uint32_t s;
+
+        r = wsp_fetch_time_points(&w, w.archives, 1000000, 1000010, p, &s, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+        ck_assert_int_eq(s, 2);
+        ck_assert(p[0].timestamp == 1000000 && p[0].value == 1.0);
+        ck_assert(p[1].timestamp == 1000010 && p[1].value == 2.0);
+
+        r = wsp_unlock(&w, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_block_cache_stats_t after;
+        wsp_block_cache_stats(&after);
+        ck_assert_msg(after.hits > before.hits, "mapping %zu", i);
+        ck_assert_msg(after.misses == before.misses, "mapping %zu", i);
+
+        r = wsp_close(&w, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    }
+
+    wsp_block_cache_free();
+}
+END_TEST
+
+START_TEST(test_io_wrap)
+{
+    check_wrap(WSP_MMAP);
+    check_wrap(WSP_MEMORY);
+    check_wrap(WSP_PREAD);
+    check_wrap(WSP_DIRECT);
+#ifdef WSP_WITH_URING
+    check_wrap(WSP_URING);
+#endif
+}
+END_TEST
+
+START_TEST(test_io_advise)
+{
+    wsp_mapping_t mappings[] = {
+        WSP_MMAP, WSP_FILE, WSP_PREAD, WSP_DIRECT
+    };
+
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 1000 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_create(db, archives, 1, a, xff, WSP_MMAP, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    size_t i;
+
+    for (i = 0; i < sizeof(mappings) / sizeof(mappings[0]); i++) {
+        wsp_t w;
+        WSP_INIT(&w);
+
+        r = wsp_open(&w, db, mappings[i], WSP_READ, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_advise(&w, NULL, 0, 0, WSP_ADVICE_POPULATE, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_advise(&w, w.archives, 0, 0, WSP_ADVICE_SEQUENTIAL, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        // wraps around the end of the archive.
+        r = wsp_advise(&w, w.archives, 990, 20, WSP_ADVICE_WILLNEED, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_advise(&w, w.archives, 0, 0, WSP_ADVICE_RANDOM, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        if (mappings[i] == WSP_DIRECT) {
+            // the whole file was loaded into the block cache.
+            wsp_block_cache_stats_t stats;
+            wsp_block_cache_stats(&stats);
+            ck_assert(stats.count >= 3);
+        }
+
+        r = wsp_close(&w, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    }
+
+    wsp_block_cache_free();
+}
+END_TEST
+
+/*
+ * Stored points are only compared by mappings which can read them for free.
+ */
+START_TEST(test_io_skip_unchanged)
+{
+    wsp_mapping_t mappings[] = { WSP_MMAP, WSP_PREAD };
+    uint64_t skipped[] = { 1, 0 };
+
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 100 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_create(db, archives, 1, a, xff, WSP_MMAP, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    size_t i;
+
+    for (i = 0; i < sizeof(mappings) / sizeof(mappings[0]); i++) {
+        wsp_t w;
+        WSP_INIT(&w);
+
+        r = wsp_open(&w, db, mappings[i], WSP_READ | WSP_WRITE | WSP_SKIP_UNCHANGED, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        ck_assert_int_eq(w.io_view, mappings[i] == WSP_MMAP);
+
+        wsp_point_input_t input = { .timestamp = 900, .value = 1.0 };
+
+        r = wsp_update_now(&w, &input, 1000, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_update_now(&w, &input, 1000, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        ck_assert_int_eq(w.stats.skipped_writes, skipped[i]);
+
+        r = wsp_close(&w, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    }
+}
+END_TEST
+
+START_TEST(test_io_sync)
+{
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 1000 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_create(db, archives, 1, a, xff, WSP_MMAP, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_t w;
+    WSP_INIT(&w);
+
+    r = wsp_set_sync(&w, WSP_SYNC_CLOSE, 0, &e);
+    ck_assert(r==WSP_ERROR && e.type == WSP_ERROR_NOT_OPEN);
+
+    r = wsp_open(&w, db, WSP_MMAP, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_set_sync(&w, (wsp_sync_t)(WSP_SYNC_FULL + 1), 0, &e);
+    ck_assert(r==WSP_ERROR && e.type == WSP_ERROR_IO_MODE);
+    ck_assert(w.sync == WSP_SYNC_NONE);
+
+    WSP_ERROR_INIT(&e);
+
+    wsp_point_input_t untracked = { .timestamp = 5000, .value = 1.0 };
+
+    // without a policy nothing is tracked.
+    r = wsp_update_now(&w, &untracked, 9000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(w.dirty.length, 0);
+
+    r = wsp_set_sync(&w, WSP_SYNC_CLOSE, 0, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input[] = {
+        { .timestamp = 5000, .value = 1.0 },
+        { .timestamp = 5010, .value = 2.0 },
+        { .timestamp = 8000, .value = 3.0 }
+    };
+
+    r = wsp_update_now(&w, input + 0, 9000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_update_now(&w, input + 2, 9000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    // adjacent to the first range.
+    r = wsp_update_now(&w, input + 1, 9000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    ck_assert_int_eq(w.dirty.length, 2);
+    ck_assert(w.dirty.ranges[0].size == 2 * sizeof(wsp_point_b));
+    ck_assert(w.dirty.ranges[1].size == sizeof(wsp_point_b));
+
+    r = wsp_sync(&w, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(w.dirty.length, 0);
+
+    // the interval has passed on the next write.
+    r = wsp_set_sync(&w, WSP_SYNC_PERIODIC, 60, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    w.sync_last -= 60;
+
+    r = wsp_update_now(&w, input + 0, 9000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(w.dirty.length, 0);
+
+    r = wsp_close(&w, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+START_TEST(test_io_open_at)
+{
+    wsp_mapping_t mappings[] = {
+        WSP_MMAP, WSP_FILE, WSP_PREAD, WSP_DIRECT
+    };
+
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 100 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_create(db, archives, 1, a, xff, WSP_MMAP, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    int dirfd = open(dir, O_RDONLY | O_DIRECTORY);
+    ck_assert(dirfd != -1);
+
+    size_t i;
+
+    for (i = 0; i < sizeof(mappings) / sizeof(mappings[0]); i++) {
+        wsp_t w;
+        WSP_INIT(&w);
+
+        r = wsp_open_at(&w, dirfd, "io1", mappings[i], WSP_READ | WSP_WRITE, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        wsp_point_input_t input = { .timestamp = 900 + i * 10, .value = i };
+
+        r = wsp_update_now(&w, &input, 1000, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_close(&w, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    }
+
+    wsp_t w;
+    WSP_INIT(&w);
+
+    r = wsp_open_fd(&w, openat(dirfd, "io1", O_RDONLY), WSP_PREAD, WSP_READ, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_t p[4];
+    uint32_t s;
+
+    r = wsp_fetch_time_points(&w, w.archives, 900, 930, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 4);
+
+    for (i = 0; i < 4; i++) {
+        ck_assert(p[i].timestamp == 900 + i * 10 && p[i].value == i);
+    }
+
+    r = wsp_close(&w, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    // not backed by a file.
+    r = wsp_open_fd(&w, openat(dirfd, "io1", O_RDONLY), WSP_MEMORY, WSP_READ, &e);
+    ck_assert(r == WSP_ERROR);
+
+    close(dirfd);
+}
+END_TEST
+
+#ifdef WSP_WITH_URING
+START_TEST(test_io_uring)
+{
+    check_mapping(WSP_URING);
+}
+END_TEST
+
+/*
+ * A failed queued write is reported to the handle which queued it, not to
+ * whichever handle happens to submit it.
+ */
+START_TEST(test_io_uring_error)
+{
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 100 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_create(db, archives, 1, a, xff, WSP_URING, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_create(db2, archives, 1, a, xff, WSP_URING, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_t w1, w2;
+    WSP_INIT(&w1);
+    WSP_INIT(&w2);
+
+    // writes of a read only descriptor fail when they complete.
+    r = wsp_open(&w1, db, WSP_URING, WSP_READ, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_open(&w2, db2, WSP_URING, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input = { .timestamp = 900, .value = 1.0 };
+
+    r = wsp_update_now(&w1, &input, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    // submits the failing write of w1.
+    r = wsp_update_now(&w2, &input, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_close(&w2, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_close(&w1, &e);
+    ck_assert(r==WSP_ERROR && e.type == WSP_ERROR_IO && e.syserr == EBADF);
+
+    WSP_ERROR_INIT(&e);
+
+    r = wsp_uring_free(&e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+/*
+ * Updates of databases with several archives only batch with WSP_LAZY, the
+ * rollup of every other update reads and submits right away.
+ */
+START_TEST(test_io_uring_rollups)
+{
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 100 },
+        { .spp = 20, .count = 100 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_create(db, archives, 2, a, xff, WSP_URING, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_create(db2, archives, 2, a, xff, WSP_URING, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_t w1, w2;
+    WSP_INIT(&w1);
+    WSP_INIT(&w2);
+
+    r = wsp_open(&w1, db, WSP_URING, WSP_READ | WSP_WRITE | WSP_LAZY, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_open(&w2, db2, WSP_URING, WSP_READ | WSP_WRITE | WSP_LAZY, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    uint64_t submits = wsp_uring_ctx.submits;
+
+    wsp_point_input_t input = { .timestamp = 900, .value = 1.0 };
+
+    r = wsp_update_now(&w1, &input, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_update_now(&w2, &input, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    ck_assert_int_eq(wsp_uring_ctx.queued, 2);
+    ck_assert_int_eq(wsp_uring_ctx.submits, submits);
+
+    r = wsp_uring_submit(&e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(wsp_uring_ctx.submits, submits + 1);
+
+    // rolls the pending updates up.
+    r = wsp_close(&w1, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_close(&w2, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_open(&w1, db, WSP_URING, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_t p[1];
+    uint32_t s;
+
+    r = wsp_fetch_time_points(&w1, w1.archives + 1, 900, 900, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert(p[0].timestamp == 900 && p[0].value == 1.0);
+
+    submits = wsp_uring_ctx.submits;
+    input.timestamp = 920;
+
+    // without WSP_LAZY the rollup into the second archive submits.
+    r = wsp_update_now(&w1, &input, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(wsp_uring_ctx.submits, submits + 1);
+
+    r = wsp_close(&w1, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_uring_free(&e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+/*
+ * A rewrite only replaces the newest queued write which overlaps it, older
+ * writes are overwritten by whatever was queued after them.
+ */
+START_TEST(test_io_uring_overlap)
+{
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 100 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_create(db, archives, 1, a, xff, WSP_URING, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_t w;
+    WSP_INIT(&w);
+
+    r = wsp_open(&w, db, WSP_URING, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    long offset = w.archives[0].offset;
+    char first[12], wide[24], second[12], third[12], result[24];
+
+    memset(first, 'a', sizeof(first));
+    memset(wide, 'b', sizeof(wide));
+    memset(second, 'c', sizeof(second));
+    memset(third, 'd', sizeof(third));
+
+    uint64_t merged = wsp_uring_ctx.merged;
+
+    r = w.io->write(&w, offset, sizeof(first), first, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = w.io->write(&w, offset, sizeof(wide), wide, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    // the first write is hidden behind the wide one.
+    r = w.io->write(&w, offset, sizeof(second), second, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(wsp_uring_ctx.queued, 3);
+    ck_assert_int_eq(wsp_uring_ctx.merged, merged);
+
+    r = w.io->write(&w, offset, sizeof(third), third, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(wsp_uring_ctx.queued, 3);
+    ck_assert_int_eq(wsp_uring_ctx.merged, merged + 1);
+
+    r = w.io->read_into(&w, offset, sizeof(result), result, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert(memcmp(result, third, sizeof(third)) == 0);
+    ck_assert(memcmp(result + sizeof(third), wide + sizeof(third), sizeof(third)) == 0);
+
+    r = wsp_close(&w, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_uring_free(&e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+START_TEST(test_io_uring_batch)
+{
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 100 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_create(db, archives, 1, a, xff, WSP_URING, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_create(db2, archives, 1, a, xff, WSP_URING, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_t w1, w2;
+    WSP_INIT(&w1);
+    WSP_INIT(&w2);
+
+    r = wsp_open(&w1, db, WSP_URING, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_open(&w2, db2, WSP_URING, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    uint64_t submits = wsp_uring_ctx.submits;
+
+    wsp_point_input_t input = { .timestamp = 900, .value = 1.0 };
+
+    r = wsp_update_now(&w1, &input, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    input.value = 2.0;
+
+    r = wsp_update_now(&w2, &input, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    // the second write replaces the first one while queued.
+    r = wsp_update_now(&w2, &input, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    ck_assert_int_eq(wsp_uring_ctx.queued, 2);
+    ck_assert_int_eq(wsp_uring_ctx.submits, submits);
+
+    r = wsp_uring_submit(&e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(wsp_uring_ctx.submits, submits + 1);
+    ck_assert_int_eq(wsp_uring_ctx.queued, 0);
+
+    wsp_point_t p[1];
+    uint32_t s;
+
+    r = wsp_fetch_time_points(&w2, w2.archives, 900, 900, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert(p[0].timestamp == 900 && p[0].value == 2.0);
+
+    wsp_close(&w1, &e);
+    wsp_close(&w2, &e);
+
+    r = wsp_uring_free(&e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+#endif
+
+Suite *
+test_suite_main() {
+    Suite *s = suite_create("main");
+    TCase *tc_core = tcase_create("Whisper I/O");
+
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, test_io_mmap);
+    tcase_add_test(tc_core, test_io_mmap_windowed);
+    tcase_add_test(tc_core, test_io_pread);
+    tcase_add_test(tc_core, test_io_direct);
+    tcase_add_test(tc_core, test_io_direct_budget);
+    tcase_add_test(tc_core, test_io_cached);
+    tcase_add_test(tc_core, test_io_cached_external);
+    tcase_add_test(tc_core, test_io_cached_files);
+    tcase_add_test(tc_core, test_io_wrap);
+    tcase_add_test(tc_core, test_io_concurrent);
+    tcase_add_test(tc_core, test_io_lock);
+    tcase_add_test(tc_core, test_io_lock_shared);
+    tcase_add_test(tc_core, test_io_lock_cached);
+    tcase_add_test(tc_core, test_io_advise);
+    tcase_add_test(tc_core, test_io_skip_unchanged);
+    tcase_add_test(tc_core, test_io_sync);
+    tcase_add_test(tc_core, test_io_open_at);
+#ifdef WSP_WITH_URING
+    tcase_add_test(tc_core, test_io_uring);
+    tcase_add_test(tc_core, test_io_uring_batch);
+    tcase_add_test(tc_core, test_io_uring_overlap);
+    tcase_add_test(tc_core, test_io_uring_rollups);
+    tcase_add_test(tc_core, test_io_uring_error);
+#endif
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main() {
+    Suite *s = test_suite_main();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}
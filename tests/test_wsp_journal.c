@@ -0,0 +1,362 @@
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <math.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "../src/wsp.h"
+#include "../src/wsp_journal.h"
+#include "../src/wsp_memfs.h"
+
+#include "check_utils.h"
+
+wsp_mapping_t m = WSP_MEMORY;
+wsp_aggregation_t a = WSP_AVERAGE;
+float xff = 0.5;
+
+char dir[] = "/tmp/wsp_journal_XXXXXX";
+char db[256];
+
+void setup()
+{
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 100 },
+        { .spp = 20, .count = 100 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    ck_assert(mkdtemp(dir) != NULL);
+    snprintf(db, sizeof(db), "%s/j1", dir);
+
+    ck_assert_int_eq(
+        WSP_OK, wsp_create(db, archives, 2, a, xff, m, &e)
+    );
+}
+
+void teardown()
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", dir, WSP_JOURNAL_NAME);
+    unlink(path);
+    rmdir(dir);
+    snprintf(dir, sizeof(dir), "/tmp/wsp_journal_XXXXXX");
+}
+
+static void fetch_first(wsp_point_t *p)
+{
+    wsp_t w;
+    WSP_INIT(&w);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+    uint32_t s;
+
+    r = wsp_open(&w, db, m, WSP_READ, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_fetch_time_points(&w, w.archives, 900, 910, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 2);
+
+    wsp_close(&w, &e);
+}
+
+START_TEST(test_journal_apply)
+{
+    wsp_journal_t j;
+    WSP_JOURNAL_INIT(&j);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    // no room for the name of the journal.
+    char longdir[WSP_JOURNAL_PATH_MAX];
+    memset(longdir, 'a', sizeof(longdir) - 8);
+    longdir[sizeof(longdir) - 8] = '\0';
+
+    r = wsp_journal_open(&j, longdir, m, 60000, &e);
+    ck_assert(r==WSP_ERROR && e.type == WSP_ERROR_JOURNAL);
+
+    WSP_ERROR_INIT(&e);
+
+    r = wsp_journal_open(&j, dir, m, 60000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input1[] = { { .timestamp = 900, .value = 1.0 } };
+    wsp_point_input_t input2[] = { { .timestamp = 910, .value = 2.0 } };
+
+    r = wsp_journal_append_now(&j, "j1", input1, 1, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_journal_append_now(&j, "j1", input2, 1, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    // both records are covered by the same group commit window.
+    ck_assert_int_eq(j.commits, 0);
+
+    wsp_point_t p[2];
+
+    fetch_first(p);
+    ck_assert(isnan(p[0].value) && isnan(p[1].value));
+
+    r = wsp_journal_apply(&j, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(j.commits, 1);
+    ck_assert_int_eq(j.applied, 2);
+    ck_assert_int_eq(j.failed, 0);
+
+    fetch_first(p);
+    ck_assert(p[0].timestamp == 900 && p[0].value == 1.0);
+    ck_assert(p[1].timestamp == 910 && p[1].value == 2.0);
+
+    r = wsp_journal_close(&j, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+START_TEST(test_journal_replay)
+{
+    wsp_journal_t j;
+    WSP_JOURNAL_INIT(&j);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_journal_open(&j, dir, m, 60000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input[] = {
+        { .timestamp = 900, .value = 3.0 },
+        { .timestamp = 910, .value = 4.0 }
+    };
+
+    r = wsp_journal_append_now(&j, "j1", input, 2, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_journal_commit(&j, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    // crash before the records are applied.
+    close(j.fd);
+    free(j.buf);
+    WSP_JOURNAL_INIT(&j);
+
+    wsp_point_t p[2];
+
+    fetch_first(p);
+    ck_assert(isnan(p[0].value) && isnan(p[1].value));
+
+    r = wsp_journal_open(&j, dir, m, 60000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(j.applied, 1);
+
+    fetch_first(p);
+    ck_assert(p[0].timestamp == 900 && p[0].value == 3.0);
+    ck_assert(p[1].timestamp == 910 && p[1].value == 4.0);
+
+    r = wsp_journal_close(&j, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+START_TEST(test_journal_torn)
+{
+    wsp_journal_t j;
+    WSP_JOURNAL_INIT(&j);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_journal_open(&j, dir, m, 60000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t first[] = { { .timestamp = 900, .value = 1.0 } };
+    wsp_point_input_t second[] = { { .timestamp = 910, .value = 2.0 } };
+    wsp_point_input_t third[] = { { .timestamp = 900, .value = 5.0 } };
+
+    r = wsp_journal_append_now(&j, "j1", first, 1, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_journal_commit(&j, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    struct stat st;
+    ck_assert(fstat(j.fd, &st) == 0);
+
+    // let the next commit write a few bytes and then run out of space.
+    struct rlimit limit, saved;
+    ck_assert(getrlimit(RLIMIT_FSIZE, &saved) == 0);
+    limit = saved;
+    limit.rlim_cur = st.st_size + 4;
+    signal(SIGXFSZ, SIG_IGN);
+    ck_assert(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+
+    r = wsp_journal_append_now(&j, "j1", second, 1, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_journal_commit(&j, &e);
+    ck_assert_int_eq(r, WSP_ERROR);
+    ck_assert_int_eq(e.type, WSP_ERROR_IO);
+
+    ck_assert(setrlimit(RLIMIT_FSIZE, &saved) == 0);
+    signal(SIGXFSZ, SIG_DFL);
+
+    ck_assert(fstat(j.fd, &st) == 0);
+    ck_assert_int_eq(st.st_size, j.committed);
+
+    r = wsp_journal_commit(&j, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_journal_append_now(&j, "j1", third, 1, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_journal_commit(&j, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    // crash, every committed record is replayed in order.
+    close(j.fd);
+    free(j.buf);
+    WSP_JOURNAL_INIT(&j);
+
+    r = wsp_journal_open(&j, dir, m, 60000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(j.applied, 3);
+
+    wsp_point_t p[2];
+
+    fetch_first(p);
+    ck_assert(p[0].timestamp == 900 && p[0].value == 5.0);
+    ck_assert(p[1].timestamp == 910 && p[1].value == 2.0);
+
+    r = wsp_journal_close(&j, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+START_TEST(test_journal_retry)
+{
+    wsp_journal_t j;
+    WSP_JOURNAL_INIT(&j);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_journal_open(&j, dir, m, 60000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input1[] = { { .timestamp = 900, .value = 1.0 } };
+    wsp_point_input_t input2[] = { { .timestamp = 910, .value = 2.0 } };
+    wsp_point_input_t future[] = { { .timestamp = 2000, .value = 3.0 } };
+
+    // j2 does not exist yet.
+    r = wsp_journal_append_now(&j, "j2", input2, 1, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_journal_append_now(&j, "j1", future, 1, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_journal_append_now(&j, "j1", input1, 1, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_journal_apply(&j, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(j.applied, 1);
+    ck_assert_int_eq(j.failed, 1);
+    ck_assert_int_eq(j.retried, 1);
+
+    // only the record for j2 is left in the journal.
+    struct stat st;
+    ck_assert(fstat(j.fd, &st) == 0);
+    ck_assert(st.st_size > 0 && (size_t)st.st_size == j.committed);
+
+    r = wsp_journal_apply(&j, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(j.retried, 2);
+
+    // crash, the kept record is replayed once j2 exists.
+    close(j.fd);
+    free(j.buf);
+    WSP_JOURNAL_INIT(&j);
+
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 100 }
+    };
+
+    char db2[256];
+    snprintf(db2, sizeof(db2), "%s/j2", dir);
+
+    r = wsp_create(db2, archives, 1, a, xff, m, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_journal_open(&j, dir, m, 60000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(j.applied, 1);
+    ck_assert_int_eq(j.retried, 0);
+    ck_assert_int_eq(j.committed, 0);
+
+    ck_assert(fstat(j.fd, &st) == 0);
+    ck_assert_int_eq(st.st_size, 0);
+
+    wsp_t w;
+    WSP_INIT(&w);
+
+    wsp_point_t p;
+    uint32_t s;
+
+    r = wsp_open(&w, db2, m, WSP_READ, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_fetch_time_points(&w, w.archives, 910, 910, &p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 1);
+    ck_assert(p.timestamp == 910 && p.value == 2.0);
+
+    wsp_close(&w, &e);
+
+    r = wsp_journal_close(&j, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+Suite *
+test_suite_main() {
+    Suite *s = suite_create("main");
+    TCase *tc_core = tcase_create("Whisper journal");
+
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, test_journal_apply);
+    tcase_add_test(tc_core, test_journal_replay);
+    tcase_add_test(tc_core, test_journal_torn);
+    tcase_add_test(tc_core, test_journal_retry);
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main() {
+    Suite *s = test_suite_main();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,289 @@
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "../src/wsp.h"
+#include "../src/wsp_pool.h"
+
+#include "check_utils.h"
+
+#define DATABASES 24
+
+wsp_mapping_t m = WSP_MMAP;
+wsp_aggregation_t a = WSP_AVERAGE;
+float xff = 0.5;
+
+char dir[] = "/tmp/wsp_pool_XXXXXX";
+char subdirs[3][256];
+char dbs[DATABASES][512];
+char other[256];
+
+off_t total_size;
+
+wsp_time_t t;
+
+void setup()
+{
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    ck_assert(mkdtemp(dir) != NULL);
+
+    snprintf(subdirs[0], sizeof(subdirs[0]), "%s/a", dir);
+    snprintf(subdirs[1], sizeof(subdirs[1]), "%s/a/b", dir);
+    snprintf(subdirs[2], sizeof(subdirs[2]), "%s/c", dir);
+
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        ck_assert(mkdir(subdirs[i], 0700) == 0);
+    }
+
+    total_size = 0;
+
+    // databases of very different sizes spread over the tree.
+    for (i = 0; i < DATABASES; i++) {
+        wsp_archive_input_t archives[] = {
+            { .spp = 10, .count = 100 + (i % 4) * 10000 }
+        };
+
+        snprintf(dbs[i], sizeof(dbs[i]), "%s/db%d.wsp", i % 4 == 3 ? dir : subdirs[i % 3], i);
+
+        ck_assert_int_eq(
+            WSP_OK, wsp_create(dbs[i], archives, 1, a, xff, m, &e)
+        );
+
+        struct stat st;
+        ck_assert(stat(dbs[i], &st) == 0);
+        total_size += st.st_size;
+    }
+
+    snprintf(other, sizeof(other), "%s/a/other.txt", dir);
+
+    FILE *fp = fopen(other, "w");
+    ck_assert(fp != NULL);
+    fclose(fp);
+
+    t = wsp_time_floor(wsp_time_now(), 10) - 50;
+}
+
+void teardown()
+{
+    int i;
+
+    for (i = 0; i < DATABASES; i++) {
+        unlink(dbs[i]);
+    }
+
+    unlink(other);
+
+    for (i = 2; i >= 0; i--) {
+        rmdir(subdirs[i]);
+    }
+
+    rmdir(dir);
+    snprintf(dir, sizeof(dir), "/tmp/wsp_pool_XXXXXX");
+}
+
+typedef struct {
+    wsp_pool_t *pool;
+    uint64_t visited;
+} job_ctx_t;
+
+/*
+ * Write a single point to every database.
+ */
+static wsp_return_t update_job(void *ctx, const char *path, wsp_error_t *e)
+{
+    job_ctx_t *c = (job_ctx_t *)ctx;
+
+    __atomic_fetch_add(&c->visited, 1, __ATOMIC_RELAXED);
+
+    wsp_t w;
+    WSP_INIT(&w);
+
+    if (wsp_open(&w, path, m, WSP_READ | WSP_WRITE, e) == WSP_ERROR) {
+        return WSP_ERROR;
+    }
+
+    wsp_point_input_t point = { .timestamp = t, .value = 42.0 };
+
+    wsp_return_t result = wsp_update(&w, &point, e);
+
+    wsp_error_t close_e;
+    WSP_ERROR_INIT(&close_e);
+    wsp_close(&w, &close_e);
+
+    return result;
+}
+
+/*
+ * Fails for every file below the first subdirectory.
+ */
+static wsp_return_t fail_job(void *ctx, const char *path, wsp_error_t *e)
+{
+    job_ctx_t *c = (job_ctx_t *)ctx;
+
+    wsp_pool_stats_t stats;
+    wsp_pool_stats(c->pool, &stats);
+
+    // progress is visible while the walk runs.
+    if (stats.files == 0 || stats.elapsed < 0) {
+        e->type = WSP_ERROR_IO_INVALID;
+        return WSP_ERROR;
+    }
+
+    if (strncmp(path, subdirs[0], strlen(subdirs[0])) == 0) {
+        e->type = WSP_ERROR_IO;
+        return WSP_ERROR;
+    }
+
+    return WSP_OK;
+}
+
+START_TEST(test_pool_walk)
+{
+    wsp_pool_t pool;
+    WSP_POOL_INIT(&pool);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_pool_open(&pool, 4, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    job_ctx_t ctx = { .pool = &pool, .visited = 0 };
+
+    r = wsp_pool_walk(&pool, dir, ".wsp", update_job, &ctx, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_pool_stats_t stats;
+    wsp_pool_stats(&pool, &stats);
+
+    ck_assert_int_eq(ctx.visited, DATABASES);
+    ck_assert_int_eq(stats.files, DATABASES);
+    ck_assert_int_eq(stats.completed, DATABASES);
+    ck_assert_int_eq(stats.failed, 0);
+    ck_assert_int_eq(stats.bytes, total_size);
+    ck_assert(stats.elapsed >= 0);
+
+    // elapsed stops with the walk.
+    double elapsed = stats.elapsed;
+    struct timespec delay = { .tv_sec = 0, .tv_nsec = 20000000 };
+    nanosleep(&delay, NULL);
+
+    wsp_pool_stats(&pool, &stats);
+    ck_assert(stats.elapsed == elapsed);
+
+    wsp_point_t p;
+    uint32_t s;
+    int i;
+
+    for (i = 0; i < DATABASES; i++) {
+        wsp_t w;
+        WSP_INIT(&w);
+
+        r = wsp_open(&w, dbs[i], m, WSP_READ, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_fetch_time_points(&w, w.archives, t, t, &p, &s, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+        ck_assert_int_eq(s, 1);
+        ck_assert(p.timestamp == t && p.value == 42.0);
+
+        wsp_close(&w, &e);
+    }
+
+    // without a suffix other files are visited too.
+    ctx.visited = 0;
+
+    r = wsp_pool_walk(&pool, dir, NULL, fail_job, &ctx, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_pool_stats(&pool, &stats);
+
+    ck_assert_int_eq(stats.files, DATABASES + 1);
+    ck_assert_int_eq(stats.completed, DATABASES + 1);
+
+    // everything below a fails, other.txt included.
+    uint64_t failed = 1;
+
+    for (i = 0; i < DATABASES; i++) {
+        if (i % 4 != 3 && i % 3 != 2) {
+            failed++;
+        }
+    }
+
+    ck_assert_int_eq(stats.failed, failed);
+    ck_assert_int_eq(stats.last_error.type, WSP_ERROR_IO);
+
+    r = wsp_pool_close(&pool, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+START_TEST(test_pool_errors)
+{
+    wsp_pool_t pool;
+    WSP_POOL_INIT(&pool);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    job_ctx_t ctx = { .pool = &pool, .visited = 0 };
+
+    r = wsp_pool_walk(&pool, dir, NULL, update_job, &ctx, &e);
+    ck_assert(r==WSP_ERROR && e.type == WSP_ERROR_NOT_OPEN);
+
+    r = wsp_pool_open(&pool, 1, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_pool_walk(&pool, "/nonexistent", NULL, update_job, &ctx, &e);
+    ck_assert(r==WSP_ERROR && e.type == WSP_ERROR_OPEN);
+
+    r = wsp_pool_walk(&pool, dbs[0], NULL, update_job, &ctx, &e);
+    ck_assert(r==WSP_ERROR && e.type == WSP_ERROR_OPEN);
+
+    ck_assert_int_eq(ctx.visited, 0);
+
+    r = wsp_pool_close(&pool, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_pool_close(&pool, &e);
+    ck_assert(r==WSP_ERROR && e.type == WSP_ERROR_NOT_OPEN);
+}
+END_TEST
+
+Suite *
+test_suite_main() {
+    Suite *s = suite_create("main");
+    TCase *tc_core = tcase_create("Whisper pool");
+
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, test_pool_walk);
+    tcase_add_test(tc_core, test_pool_errors);
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main() {
+    Suite *s = test_suite_main();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,265 @@
+#include <check.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "../src/wsp.h"
+#include "../src/wsp_ring.h"
+#include "../src/wsp_memfs.h"
+
+#include "check_utils.h"
+
+#define PRODUCERS 4
+#define POINTS 500
+
+wsp_mapping_t m = WSP_MEMORY;
+wsp_aggregation_t a = WSP_AVERAGE;
+float xff = 0.5;
+
+wsp_time_t t;
+
+void setup()
+{
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 10000 },
+        { .spp = 100, .count = 10000 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    ck_assert_int_eq(
+        WSP_OK, wsp_create("r1", archives, 2, a, xff, m, &e)
+    );
+
+    ck_assert_int_eq(
+        WSP_OK, wsp_create("r2", archives, 2, a, xff, m, &e)
+    );
+
+    t = wsp_time_floor(wsp_time_now(), 100) - 50000;
+}
+
+void teardown()
+{
+}
+
+typedef struct {
+    wsp_ring_t *ring;
+    wsp_t *w;
+    int producer;
+} producer_t;
+
+/*
+ * Every producer writes its own slots, one point at a time, retrying while
+ * the ring is full.
+ */
+static void *produce(void *arg)
+{
+    producer_t *p = (producer_t *)arg;
+
+    wsp_error_t e;
+
+    int i;
+
+    for (i = 0; i < POINTS; i++) {
+        wsp_point_input_t input = {
+            .timestamp = t + (i * PRODUCERS + p->producer) * 10,
+            .value = i * PRODUCERS + p->producer
+        };
+
+        do {
+            WSP_ERROR_INIT(&e);
+        } while (wsp_ring_push(p->ring, p->w, &input, 1, &e) == WSP_ERROR && e.type == WSP_ERROR_FULL);
+
+        if (e.type != WSP_ERROR_NONE) {
+            return (void *)1;
+        }
+    }
+
+    return NULL;
+}
+
+START_TEST(test_ring_push)
+{
+    wsp_ring_t ring;
+    WSP_RING_INIT(&ring);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+    size_t count;
+
+    wsp_t w;
+    WSP_INIT(&w);
+
+    r = wsp_open(&w, "r1", m, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_ring_open(&ring, 3, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(ring.capacity, 4);
+
+    wsp_point_input_t input[WSP_RING_BATCH * 3];
+
+    int i;
+
+    for (i = 0; i < WSP_RING_BATCH * 3; i++) {
+        input[i].timestamp = t + i * 10;
+        input[i].value = i;
+    }
+
+    // spans three slots.
+    r = wsp_ring_push(&ring, &w, input, WSP_RING_BATCH * 3, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    // needs two slots, only one is left.
+    r = wsp_ring_push(&ring, &w, input, WSP_RING_BATCH + 1, &e);
+    ck_assert(r==WSP_ERROR && e.type == WSP_ERROR_FULL);
+    ck_assert_int_eq(ring.full, 1);
+
+    WSP_ERROR_INIT(&e);
+
+    r = wsp_ring_drain(&ring, &count, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(count, WSP_RING_BATCH * 3);
+    ck_assert_int_eq(ring.drained, WSP_RING_BATCH * 3);
+
+    r = wsp_ring_drain(&ring, &count, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(count, 0);
+
+    // room again, wrapping around the end of the slots.
+    r = wsp_ring_push(&ring, &w, input, WSP_RING_BATCH + 1, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_ring_drain(&ring, &count, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(count, WSP_RING_BATCH + 1);
+    ck_assert_int_eq(ring.failed, 0);
+
+    wsp_point_t p[WSP_RING_BATCH * 3];
+    uint32_t s;
+
+    r = wsp_fetch_time_points(&w, w.archives, t, t + (WSP_RING_BATCH * 3 - 1) * 10, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, WSP_RING_BATCH * 3);
+
+    for (i = 0; i < WSP_RING_BATCH * 3; i++) {
+        ck_assert(p[i].timestamp == t + i * 10 && p[i].value == i);
+    }
+
+    r = wsp_ring_close(&ring, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_ring_push(&ring, &w, input, 1, &e);
+    ck_assert(r==WSP_ERROR && e.type == WSP_ERROR_NOT_OPEN);
+
+    wsp_close(&w, &e);
+}
+END_TEST
+
+START_TEST(test_ring_producers)
+{
+    wsp_ring_t ring;
+    WSP_RING_INIT(&ring);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+    size_t count;
+
+    wsp_t w1, w2;
+    WSP_INIT(&w1);
+    WSP_INIT(&w2);
+
+    r = wsp_open(&w1, "r1", m, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_open(&w2, "r2", m, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    // small enough for the producers to fill it.
+    r = wsp_ring_open(&ring, 16, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    pthread_t threads[PRODUCERS];
+    producer_t producers[PRODUCERS];
+
+    int i;
+
+    for (i = 0; i < PRODUCERS; i++) {
+        producers[i].ring = &ring;
+        producers[i].w = i % 2 == 0 ? &w1 : &w2;
+        producers[i].producer = i;
+        ck_assert(pthread_create(threads + i, NULL, produce, producers + i) == 0);
+    }
+
+    size_t total = 0;
+
+    // the consumer runs while the producers are pushing.
+    while (total < PRODUCERS * POINTS) {
+        r = wsp_ring_drain(&ring, &count, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+        total += count;
+    }
+
+    for (i = 0; i < PRODUCERS; i++) {
+        void *result;
+        ck_assert(pthread_join(threads[i], &result) == 0);
+        ck_assert(result == NULL);
+    }
+
+    ck_assert_int_eq(total, PRODUCERS * POINTS);
+    ck_assert_int_eq(ring.drained, PRODUCERS * POINTS);
+    ck_assert_int_eq(ring.failed, 0);
+
+    wsp_point_t p[PRODUCERS * POINTS];
+    uint32_t s;
+
+    r = wsp_fetch_time_points(&w1, w1.archives, t, t + (PRODUCERS * POINTS - 1) * 10, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, PRODUCERS * POINTS);
+
+    for (i = 0; i < PRODUCERS * POINTS; i++) {
+        ck_assert(p[i].timestamp == t + i * 10);
+
+        // even producers write r1, odd ones r2.
+        if (i % PRODUCERS % 2 == 0) {
+            ck_assert(p[i].value == i);
+        }
+        else {
+            ck_assert(isnan(p[i].value));
+        }
+    }
+
+    r = wsp_ring_close(&ring, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_close(&w1, &e);
+    wsp_close(&w2, &e);
+}
+END_TEST
+
+Suite *
+test_suite_main() {
+    Suite *s = suite_create("main");
+    TCase *tc_core = tcase_create("Whisper ring");
+
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, test_ring_push);
+    tcase_add_test(tc_core, test_ring_producers);
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main() {
+    Suite *s = test_suite_main();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}
@@ -1,4 +1,5 @@
 #include <check.h>
+#include <math.h>
 
 #include "../src/wsp.h"
 #include "../src/wsp_memfs.h"
@@ -73,6 +74,619 @@ START_TEST(test_update_aggregation_1)
 }
 END_TEST
 
+START_TEST(test_update_many_1)
+{
+    wsp_t w;
+    WSP_INIT(&w);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_open(&w, "a1", m, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input[] = {
+        { .timestamp = 930, .value = 7.0 },
+        { .timestamp = 900, .value = 1.0 },
+        { .timestamp = 915, .value = 2.0 },
+        { .timestamp = 910, .value = 3.0 },
+        { .timestamp = 920, .value = 5.0 }
+    };
+
+    r = wsp_update_many_now(&w, input, 5, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(w.stats.coalesced, 1);
+
+    wsp_point_t p1[4];
+    uint32_t s1;
+
+    wsp_point_t p2[2];
+    uint32_t s2;
+
+    wsp_point_t p3[2];
+    uint32_t s3;
+
+    r = wsp_fetch_time_points(&w, w.archives, 900, 930, p1, &s1, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s1, 4);
+
+    r = wsp_fetch_time_points(&w, w.archives + 1, 900, 920, p2, &s2, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s2, 2);
+
+    r = wsp_fetch_time_points(&w, w.archives + 2, 880, 920, p3, &s3, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s3, 2);
+
+    // last write to slot 910 wins.
+    ck_assert(p1[0].timestamp == 900 && p1[0].value == 1.0);
+    ck_assert(p1[1].timestamp == 910 && p1[1].value == 3.0);
+    ck_assert(p1[2].timestamp == 920 && p1[2].value == 5.0);
+    ck_assert(p1[3].timestamp == 930 && p1[3].value == 7.0);
+
+    ck_assert(p2[0].timestamp == 900 && p2[0].value == 2.0);
+    ck_assert(p2[1].timestamp == 920 && p2[1].value == 6.0);
+
+    ck_assert(p3[0].timestamp == 880 && p3[0].value == 2.0);
+    ck_assert(p3[1].timestamp == 920 && p3[1].value == 6.0);
+}
+END_TEST
+
+START_TEST(test_update_many_coalesce)
+{
+    wsp_t w;
+    WSP_INIT(&w);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_open(&w, "a1", m, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    // 500 and 510 are only covered by the second archive.
+    wsp_point_input_t input[] = {
+        { .timestamp = 500, .value = 1.0 },
+        { .timestamp = 1500, .value = 2.0 },
+        { .timestamp = 510, .value = 4.0 },
+        { .timestamp = 1505, .value = 6.0 },
+        { .timestamp = 1510, .value = 3.0 }
+    };
+
+    r = wsp_update_many_now(&w, input, 5, 2000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(w.stats.coalesced, 2);
+
+    wsp_point_t p[2];
+    uint32_t s;
+
+    r = wsp_fetch_time_points(&w, w.archives, 1500, 1510, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 2);
+    ck_assert(p[0].timestamp == 1500 && p[0].value == 6.0);
+    ck_assert(p[1].timestamp == 1510 && p[1].value == 3.0);
+
+    r = wsp_fetch_time_points(&w, w.archives + 1, 500, 500, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 1);
+    ck_assert(p[0].timestamp == 500 && p[0].value == 4.0);
+
+    // rolled up from the winning points only.
+    r = wsp_fetch_time_points(&w, w.archives + 1, 1500, 1500, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 1);
+    ck_assert(p[0].timestamp == 1500 && p[0].value == 4.5);
+
+    r = wsp_fetch_time_points(&w, w.archives + 2, 480, 480, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 1);
+    ck_assert(p[0].timestamp == 480 && p[0].value == 4.0);
+
+    r = wsp_fetch_time_points(&w, w.archives + 2, 1480, 1480, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 1);
+    ck_assert(p[0].timestamp == 1480 && p[0].value == 4.5);
+
+    wsp_close(&w, &e);
+}
+END_TEST
+
+START_TEST(test_update_many_future)
+{
+    wsp_t w;
+    WSP_INIT(&w);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_open(&w, "a1", m, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input[] = {
+        { .timestamp = 900, .value = 1.0 },
+        { .timestamp = 1010, .value = 2.0 }
+    };
+
+    r = wsp_update_many_now(&w, input, 2, 1000, &e);
+    ck_assert_int_eq(r, WSP_ERROR);
+    ck_assert_int_eq(e.type, WSP_ERROR_FUTURE_TIMESTAMP);
+
+    wsp_point_t p1[1];
+    uint32_t s1;
+
+    // nothing should have been written.
+    r = wsp_fetch_time_points(&w, w.archives, 900, 900, p1, &s1, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s1, 1);
+    ck_assert(isnan(p1[0].value));
+}
+END_TEST
+
+START_TEST(test_revalidate)
+{
+    wsp_t w1, w2;
+    WSP_INIT(&w1);
+    WSP_INIT(&w2);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_open(&w1, "a1", m, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_open(&w2, "a1", m, WSP_READ, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input = { .timestamp = 900, .value = 4.0 };
+    r = wsp_update_now(&w1, &input, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    ck_assert_int_eq(w1.archives[0].base.timestamp, 900);
+    ck_assert_int_eq(w2.archives[0].base.timestamp, 0);
+
+    r = wsp_revalidate(&w2, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(w2.archives[0].base.timestamp, 900);
+
+    wsp_point_t p1[1];
+    uint32_t s1;
+
+    r = wsp_fetch_time_points(&w2, w2.archives, 900, 900, p1, &s1, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s1, 1);
+    ck_assert(p1[0].timestamp == 900 && p1[0].value == 4.0);
+}
+END_TEST
+
+START_TEST(test_incremental_rollup)
+{
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 100 },
+        { .spp = 20, .count = 100 },
+        { .spp = 40, .count = 100 }
+    };
+
+    wsp_point_input_t input[] = {
+        { .timestamp = 900, .value = 1.0 },
+        { .timestamp = 910, .value = 3.0 },
+        { .timestamp = 910, .value = 2.0 },
+        { .timestamp = 920, .value = 9.0 },
+        { .timestamp = 900, .value = 0.5 },
+        { .timestamp = 950, .value = 4.0 },
+        { .timestamp = 890, .value = 6.0 },
+        { .timestamp = 960, .value = 8.0 },
+        { .timestamp = 920, .value = 1.0 }
+    };
+
+    wsp_point_input_t batch[] = {
+        { .timestamp = 970, .value = 2.0 },
+        { .timestamp = 940, .value = 3.0 },
+        { .timestamp = 980, .value = 7.0 }
+    };
+
+    wsp_aggregation_t aggregations[] = {
+        WSP_AVERAGE, WSP_SUM, WSP_LAST, WSP_MAX, WSP_MIN
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+    uint32_t i, j, k;
+
+    for (k = 0; k < 5; k++) {
+        wsp_t w1, w2;
+        WSP_INIT(&w1);
+        WSP_INIT(&w2);
+
+        r = wsp_create("i1", archives, 3, aggregations[k], xff, m, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_create("i2", archives, 3, aggregations[k], xff, m, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_open(&w1, "i1", m, WSP_READ | WSP_WRITE, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_open(&w2, "i2", m, WSP_READ | WSP_WRITE | WSP_INCREMENTAL, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        for (i = 0; i < sizeof(input) / sizeof(input[0]); i++) {
+            r = wsp_update_now(&w1, input + i, 1000, &e);
+            ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+            r = wsp_update_now(&w2, input + i, 1000, &e);
+            ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+        }
+
+        r = wsp_update_many_now(&w1, batch, 3, 1000, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_update_many_now(&w2, batch, 3, 1000, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        for (i = 0; i < 3; i++) {
+            wsp_point_t p1[12], p2[12];
+            uint32_t s1, s2;
+
+            r = wsp_fetch_time_points(&w1, w1.archives + i, 880, 990, p1, &s1, &e);
+            ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+            r = wsp_fetch_time_points(&w2, w2.archives + i, 880, 990, p2, &s2, &e);
+            ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+            ck_assert_int_eq(s1, s2);
+
+            for (j = 0; j < s1; j++) {
+                ck_assert_int_eq(p1[j].timestamp, p2[j].timestamp);
+                ck_assert(
+                    p1[j].value == p2[j].value ||
+                    (isnan(p1[j].value) && isnan(p2[j].value))
+                );
+            }
+        }
+
+        wsp_close(&w1, &e);
+        wsp_close(&w2, &e);
+    }
+}
+END_TEST
+
+START_TEST(test_lazy_rollup)
+{
+    wsp_t w1, w2;
+    WSP_INIT(&w1);
+    WSP_INIT(&w2);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_open(&w1, "a1", m, WSP_READ | WSP_WRITE | WSP_LAZY, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_open(&w2, "a1", m, WSP_READ, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input[] = {
+        { .timestamp = 900, .value = 1.0 },
+        { .timestamp = 910, .value = 3.0 },
+        { .timestamp = 920, .value = 5.0 }
+    };
+
+    uint32_t i;
+
+    for (i = 0; i < 3; i++) {
+        r = wsp_update_now(&w1, input + i, 1000, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    }
+
+    wsp_point_t p[2];
+    uint32_t s;
+
+    // the lower archives have not been touched yet.
+    r = wsp_revalidate(&w2, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    r = wsp_fetch_time_points(&w2, w2.archives + 1, 900, 920, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 2);
+    ck_assert(isnan(p[0].value) && isnan(p[1].value));
+
+    // fetching from a lower archive flushes pending rollups.
+    r = wsp_fetch_time_points(&w1, w1.archives + 1, 900, 920, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 2);
+    ck_assert(p[0].timestamp == 900 && p[0].value == 2.0);
+    ck_assert(p[1].timestamp == 920 && p[1].value == 5.0);
+
+    wsp_point_input_t late = { .timestamp = 930, .value = 7.0 };
+    r = wsp_update_many_now(&w1, &late, 1, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_flush_rollups(&w1, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_revalidate(&w2, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    r = wsp_fetch_time_points(&w2, w2.archives + 2, 920, 920, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 1);
+    ck_assert(p[0].timestamp == 920 && p[0].value == 6.0);
+
+    r = wsp_close(&w1, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    wsp_close(&w2, &e);
+}
+END_TEST
+
+START_TEST(test_skip_unchanged)
+{
+    wsp_t w;
+    WSP_INIT(&w);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_open(&w, "a1", m, WSP_READ | WSP_WRITE | WSP_SKIP_UNCHANGED, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input = { .timestamp = 900, .value = 1.0 };
+
+    r = wsp_update_now(&w, &input, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(w.stats.skipped_writes, 0);
+
+    // same value again, no archive is touched.
+    r = wsp_update_now(&w, &input, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(w.stats.skipped_writes, 3);
+    ck_assert_int_eq(w.stats.skipped_points, 3);
+
+    input.value = 2.0;
+
+    r = wsp_update_now(&w, &input, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(w.stats.skipped_writes, 3);
+
+    wsp_point_t p[1];
+    uint32_t s;
+
+    r = wsp_fetch_time_points(&w, w.archives + 2, 880, 880, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 1);
+    ck_assert(p[0].timestamp == 880 && p[0].value == 2.0);
+
+    wsp_close(&w, &e);
+}
+END_TEST
+
+START_TEST(test_backfill)
+{
+    wsp_t w;
+    WSP_INIT(&w);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_open(&w, "a1", m, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    // moves the base so that the backfilled range wraps around.
+    wsp_point_input_t first = { .timestamp = 500, .value = 0.0 };
+    r = wsp_update_now(&w, &first, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input[92];
+    int i;
+
+    // older than the retention of the database.
+    input[0].timestamp = 0;
+    input[0].value = 42.0;
+
+    for (i = 1; i < 91; i++) {
+        input[i].timestamp = 100 + (i - 1) * 10;
+        input[i].value = input[i].timestamp / 10;
+    }
+
+    // replaces 990.
+    input[91].timestamp = 995;
+    input[91].value = 1.0;
+
+    r = wsp_backfill_now(&w, input, 92, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_t p[90];
+    uint32_t s;
+
+    r = wsp_fetch_time_points(&w, w.archives, 100, 990, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 90);
+
+    for (i = 0; i < 89; i++) {
+        ck_assert(p[i].timestamp == 100 + i * 10);
+        ck_assert(p[i].value == 10 + i);
+    }
+
+    ck_assert(p[89].timestamp == 990 && p[89].value == 1.0);
+
+    r = wsp_fetch_time_points(&w, w.archives + 1, 100, 120, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 2);
+    ck_assert(p[0].timestamp == 100 && p[0].value == 10.5);
+    ck_assert(p[1].timestamp == 120 && p[1].value == 12.5);
+
+    r = wsp_fetch_time_points(&w, w.archives + 2, 80, 120, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 2);
+    ck_assert(p[0].timestamp == 80 && p[0].value == 10.5);
+    ck_assert(p[1].timestamp == 120 && p[1].value == 13.5);
+
+    wsp_close(&w, &e);
+}
+END_TEST
+
+START_TEST(test_backfill_truncated)
+{
+    wsp_t w;
+    WSP_INIT(&w);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_open(&w, "a1", m, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t first = { .timestamp = 3000, .value = 3.0 };
+    r = wsp_update_now(&w, &first, 4000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    // spans every slot of the archive.
+    wsp_point_input_t input[] = {
+        { .timestamp = 40, .value = 1.0 },
+        { .timestamp = 2000, .value = 2.0 },
+        { .timestamp = 4000, .value = 4.0 }
+    };
+
+    r = wsp_backfill_now(&w, input, 3, 4000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_archive_t *archive = w.archives + 2;
+    ck_assert(archive->base.timestamp != 0);
+
+    wsp_point_t p[100];
+    uint32_t s;
+
+    r = wsp_fetch_time_points(&w, archive, 40, 80, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 2);
+    ck_assert(p[0].timestamp == 40 && p[0].value == 1.0);
+    ck_assert(isnan(p[1].value));
+
+    r = wsp_fetch_time_points(&w, archive, 2000, 4000, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 51);
+
+    ck_assert(p[0].timestamp == 2000 && p[0].value == 2.0);
+    ck_assert(p[25].timestamp == 3000 && p[25].value == 3.0);
+    ck_assert(p[50].timestamp == 4000 && p[50].value == 4.0);
+
+    for (s = 1; s < 50; s++) {
+        if (s != 25) {
+            ck_assert(isnan(p[s].value));
+        }
+    }
+
+    wsp_close(&w, &e);
+
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 10 }
+    };
+
+    r = wsp_create("a2", archives, 1, a, xff, m, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_open(&w, "a2", m, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t full[11];
+
+    for (s = 0; s < 11; s++) {
+        full[s].timestamp = 1000 + s * 10;
+        full[s].value = s;
+    }
+
+    // exactly one point for every slot.
+    r = wsp_backfill_now(&w, full, 10, 1095, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_fetch_time_points(&w, w.archives, 1000, 1090, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 10);
+
+    for (s = 0; s < 10; s++) {
+        ck_assert(p[s].timestamp == 1000 + s * 10 && p[s].value == s);
+    }
+
+    // one more than the archive holds, the oldest shares its slot with 1100.
+    full[0].timestamp = 1001;
+    full[0].value = 20.0;
+
+    r = wsp_backfill_now(&w, full, 11, 1100, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_fetch_time_points(&w, w.archives, 1010, 1100, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 10);
+
+    for (s = 0; s < 10; s++) {
+        ck_assert(p[s].timestamp == 1010 + s * 10 && p[s].value == s + 1);
+    }
+
+    wsp_close(&w, &e);
+}
+END_TEST
+
+START_TEST(test_increment)
+{
+    wsp_t w;
+    WSP_INIT(&w);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    r = wsp_open(&w, "a1", m, WSP_READ | WSP_WRITE, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_increment_now(&w, 900, 1.0, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_increment_now(&w, 905, 2.0, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_increment_now(&w, 910, 4.0, 1000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_t p[2];
+    uint32_t s;
+
+    r = wsp_fetch_time_points(&w, w.archives, 900, 910, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert_int_eq(s, 2);
+    ck_assert(p[0].timestamp == 900 && p[0].value == 3.0);
+    ck_assert(p[1].timestamp == 910 && p[1].value == 4.0);
+
+    r = wsp_fetch_time_points(&w, w.archives + 1, 900, 900, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert(p[0].timestamp == 900 && p[0].value == 3.5);
+
+    // one full rotation later the slot is stale and starts over.
+    r = wsp_increment_now(&w, 1900, 5.0, 2000, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_fetch_time_points(&w, w.archives, 1900, 1900, p, &s, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    ck_assert(p[0].timestamp == 1900 && p[0].value == 5.0);
+
+    wsp_close(&w, &e);
+}
+END_TEST
+
 Suite *
 test_suite_main() {
     Suite *s = suite_create("main");
@@ -81,6 +695,16 @@ test_suite_main() {
     tcase_add_checked_fixture(tc_core, setup, teardown);
 
     tcase_add_test(tc_core, test_update_aggregation_1);
+    tcase_add_test(tc_core, test_update_many_1);
+    tcase_add_test(tc_core, test_update_many_coalesce);
+    tcase_add_test(tc_core, test_update_many_future);
+    tcase_add_test(tc_core, test_revalidate);
+    tcase_add_test(tc_core, test_incremental_rollup);
+    tcase_add_test(tc_core, test_lazy_rollup);
+    tcase_add_test(tc_core, test_skip_unchanged);
+    tcase_add_test(tc_core, test_backfill);
+    tcase_add_test(tc_core, test_backfill_truncated);
+    tcase_add_test(tc_core, test_increment);
 
     suite_add_tcase(s, tc_core);
     return s;
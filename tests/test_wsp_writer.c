@@ -0,0 +1,379 @@
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "../src/wsp.h"
+#include "../src/wsp_writer.h"
+
+#include "check_utils.h"
+
+#define DATABASES 8
+#define PRODUCERS 4
+#define POINTS 50
+
+wsp_mapping_t m = WSP_MMAP;
+wsp_aggregation_t a = WSP_AVERAGE;
+float xff = 0.5;
+
+char dir[] = "/tmp/wsp_writer_XXXXXX";
+char dbs[DATABASES][256];
+
+wsp_time_t t;
+
+void setup()
+{
+    wsp_archive_input_t archives[] = {
+        { .spp = 10, .count = 1000 },
+        { .spp = 100, .count = 1000 }
+    };
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    ck_assert(mkdtemp(dir) != NULL);
+
+    int i;
+
+    for (i = 0; i < DATABASES; i++) {
+        snprintf(dbs[i], sizeof(dbs[i]), "%s/db%d", dir, i);
+
+        ck_assert_int_eq(
+            WSP_OK, wsp_create(dbs[i], archives, 2, a, xff, m, &e)
+        );
+    }
+
+    t = wsp_time_floor(wsp_time_now(), 100) - 5000;
+}
+
+void teardown()
+{
+    int i;
+
+    for (i = 0; i < DATABASES; i++) {
+        unlink(dbs[i]);
+    }
+
+    rmdir(dir);
+    snprintf(dir, sizeof(dir), "/tmp/wsp_writer_XXXXXX");
+}
+
+typedef struct {
+    wsp_writer_t *wr;
+    int producer;
+} producer_t;
+
+/*
+ * Every producer writes its own slots of every database, one point at a
+ * time.
+ */
+static void *produce(void *arg)
+{
+    producer_t *p = (producer_t *)arg;
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    int i, j;
+
+    for (i = 0; i < POINTS; i++) {
+        for (j = 0; j < DATABASES; j++) {
+            wsp_point_input_t input = {
+                .timestamp = t + (i * PRODUCERS + p->producer) * 10,
+                .value = j * 1000 + i * PRODUCERS + p->producer
+            };
+
+            if (wsp_writer_submit(p->wr, dbs[j], &input, 1, &e) == WSP_ERROR) {
+                return (void *)1;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+START_TEST(test_writer_submit)
+{
+    wsp_writer_t wr;
+    WSP_WRITER_INIT(&wr);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    wr.max_queued = 16;
+
+    r = wsp_writer_open(&wr, 3, m, 0, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    pthread_t threads[PRODUCERS];
+    producer_t producers[PRODUCERS];
+
+    int i, j;
+
+    for (i = 0; i < PRODUCERS; i++) {
+        producers[i].wr = &wr;
+        producers[i].producer = i;
+        ck_assert(pthread_create(threads + i, NULL, produce, producers + i) == 0);
+    }
+
+    for (i = 0; i < PRODUCERS; i++) {
+        void *result;
+        ck_assert(pthread_join(threads[i], &result) == 0);
+        ck_assert(result == NULL);
+    }
+
+    r = wsp_writer_flush(&wr, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_writer_stats_t stats;
+    wsp_writer_stats(&wr, &stats);
+
+    ck_assert_int_eq(stats.queued, 0);
+    ck_assert_int_eq(stats.written, DATABASES * PRODUCERS * POINTS);
+    ck_assert_int_eq(stats.failed, 0);
+    ck_assert_int_eq(stats.opens, DATABASES);
+    ck_assert_int_eq(stats.evictions, 0);
+
+    wsp_point_t p[PRODUCERS * POINTS];
+    uint32_t s;
+
+    for (j = 0; j < DATABASES; j++) {
+        wsp_t w;
+        WSP_INIT(&w);
+
+        r = wsp_open(&w, dbs[j], m, WSP_READ, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_fetch_time_points(
+            &w, w.archives, t, t + (PRODUCERS * POINTS - 1) * 10, p, &s, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+        ck_assert_int_eq(s, PRODUCERS * POINTS);
+
+        for (i = 0; i < PRODUCERS * POINTS; i++) {
+            ck_assert(p[i].timestamp == t + i * 10);
+            ck_assert(p[i].value == j * 1000 + i);
+        }
+
+        wsp_close(&w, &e);
+    }
+
+    r = wsp_writer_close(&wr, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+START_TEST(test_writer_handles)
+{
+    wsp_writer_t wr;
+    WSP_WRITER_INIT(&wr);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    wr.max_handles = 2;
+
+    // a single worker owns every database.
+    r = wsp_writer_open(&wr, 1, m, 0, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input[] = {
+        { .timestamp = t, .value = 1.0 },
+        { .timestamp = t + 10, .value = 2.0 }
+    };
+
+    int i;
+
+    for (i = 0; i < DATABASES; i++) {
+        r = wsp_writer_submit(&wr, dbs[i], input, 2, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    }
+
+    // close writes everything still queued.
+    r = wsp_writer_close(&wr, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_writer_close(&wr, &e);
+    ck_assert(r==WSP_ERROR && e.type == WSP_ERROR_NOT_OPEN);
+
+    wsp_point_t p[2];
+    uint32_t s;
+
+    for (i = 0; i < DATABASES; i++) {
+        wsp_t w;
+        WSP_INIT(&w);
+
+        r = wsp_open(&w, dbs[i], m, WSP_READ, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+        r = wsp_fetch_time_points(&w, w.archives, t, t + 10, p, &s, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+        ck_assert_int_eq(s, 2);
+        ck_assert(p[0].value == 1.0 && p[1].value == 2.0);
+
+        wsp_close(&w, &e);
+    }
+}
+END_TEST
+
+START_TEST(test_writer_stats)
+{
+    wsp_writer_t wr;
+    WSP_WRITER_INIT(&wr);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    wr.max_handles = 2;
+
+    // not thread safe.
+    r = wsp_writer_open(&wr, 1, WSP_URING, 0, &e);
+    ck_assert(r==WSP_ERROR && e.type == WSP_ERROR_IO_MODE);
+
+    r = wsp_writer_open(&wr, 1, WSP_MEMORY, 0, &e);
+    ck_assert(r==WSP_ERROR && e.type == WSP_ERROR_IO_MODE);
+
+    WSP_ERROR_INIT(&e);
+
+    r = wsp_writer_open(&wr, 1, m, 0, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input[] = {
+        { .timestamp = t, .value = 1.0 },
+        { .timestamp = t + 10, .value = 2.0 }
+    };
+
+    int i;
+
+    for (i = 0; i < DATABASES; i++) {
+        r = wsp_writer_submit(&wr, dbs[i], input, 2, &e);
+        ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+    }
+
+    r = wsp_writer_submit(&wr, "/nonexistent/db", input, 2, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    r = wsp_writer_flush(&wr, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_writer_stats_t stats;
+    wsp_writer_stats(&wr, &stats);
+
+    ck_assert_int_eq(stats.written, DATABASES * 2);
+    ck_assert_int_eq(stats.failed, 2);
+    ck_assert_int_eq(stats.opens, DATABASES);
+    ck_assert_int_eq(stats.evictions, DATABASES - 2);
+    ck_assert(stats.last_error.type != WSP_ERROR_NONE);
+
+    r = wsp_writer_close(&wr, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+}
+END_TEST
+
+/*
+ * Wait until the writer has written count points.
+ */
+static void wait_written(wsp_writer_t *wr, uint64_t count)
+{
+    wsp_writer_stats_t stats;
+
+    while (1) {
+        wsp_writer_stats(wr, &stats);
+
+        if (stats.written + stats.failed >= count) {
+            break;
+        }
+
+        struct timespec delay = { .tv_sec = 0, .tv_nsec = 1000000 };
+        nanosleep(&delay, NULL);
+    }
+
+    ck_assert_int_eq(stats.written, count);
+}
+
+/*
+ * Databases which fail to close, here because their pending rollups can not
+ * be read back, are reported when evicted and when the writer is closed.
+ */
+START_TEST(test_writer_close_errors)
+{
+    wsp_writer_t wr;
+    WSP_WRITER_INIT(&wr);
+
+    wsp_error_t e;
+    WSP_ERROR_INIT(&e);
+
+    wsp_return_t r;
+
+    wr.max_handles = 1;
+
+    r = wsp_writer_open(&wr, 1, WSP_PREAD, WSP_LAZY, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wsp_point_input_t input[] = {
+        { .timestamp = t, .value = 1.0 },
+        { .timestamp = t + 10, .value = 2.0 }
+    };
+
+    r = wsp_writer_submit(&wr, dbs[0], input, 2, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wait_written(&wr, 2);
+    ck_assert(truncate(dbs[0], 0) == 0);
+
+    // evicts the first database.
+    r = wsp_writer_submit(&wr, dbs[1], input, 2, &e);
+    ck_assert_msg(r==WSP_OK, wsp_strerror(&e));
+
+    wait_written(&wr, 4);
+
+    wsp_writer_stats_t stats;
+    wsp_writer_stats(&wr, &stats);
+
+    ck_assert_int_eq(stats.evictions, 1);
+    ck_assert_int_eq(stats.close_failed, 1);
+    ck_assert_int_eq(stats.failed, 0);
+    ck_assert(stats.last_error.type == WSP_ERROR_IO);
+
+    ck_assert(truncate(dbs[1], 0) == 0);
+
+    r = wsp_writer_close(&wr, &e);
+    ck_assert(r==WSP_ERROR && e.type == WSP_ERROR_IO);
+    ck_assert(wr.workers == NULL);
+}
+END_TEST
+
+Suite *
+test_suite_main() {
+    Suite *s = suite_create("main");
+    TCase *tc_core = tcase_create("Whisper writer");
+
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    tcase_add_test(tc_core, test_writer_submit);
+    tcase_add_test(tc_core, test_writer_handles);
+    tcase_add_test(tc_core, test_writer_close_errors);
+    tcase_add_test(tc_core, test_writer_stats);
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main() {
+    Suite *s = test_suite_main();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}